@@ -0,0 +1,116 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Compares the interpreter's dispatch engines on the same workloads.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "console/console.h"
+#include "image.h"
+
+using namespace nes;
+using namespace nes::test;
+
+struct workload {
+    std::string_view name;
+    std::vector<std::uint8_t> program;
+};
+
+const auto workloads = std::vector<workload>{
+    /* Copies a page of ROM into RAM, over and over. */
+    {"copy", {
+        0xa2, 0x00,         // $8000: LDX #$00
+        0xbd, 0x00, 0x81,   // $8002: LDA $8100,X
+        0x9d, 0x00, 0x03,   // $8005: STA $0300,X
+        0xe8,               // $8008: INX
+        0xd0, 0xf7,         // $8009: BNE $8002
+        0x4c, 0x00, 0x80,   // $800b: JMP $8000
+    }},
+    /* Arithmetic on a page of RAM through an indirect pointer. */
+    {"arithmetic", {
+        0xa9, 0x00,         // $8000: LDA #$00
+        0x85, 0xf0,         // $8002: STA $f0
+        0xa9, 0x02,         // $8004: LDA #$02
+        0x85, 0xf1,         // $8006: STA $f1
+        0xa0, 0x00,         // $8008: LDY #$00
+        0xb1, 0xf0,         // $800a: LDA ($f0),Y
+        0x18,               // $800c: CLC
+        0x69, 0x03,         // $800d: ADC #$03
+        0x4a,               // $800f: LSR A
+        0x91, 0xf0,         // $8010: STA ($f0),Y
+        0xc8,               // $8012: INY
+        0xd0, 0xf5,         // $8013: BNE $800a
+        0x4c, 0x08, 0x80,   // $8015: JMP $8008
+    }},
+    /* Subroutine calls with stack traffic and data-dependent branches. */
+    {"subroutine", {
+        0xa2, 0x00,         // $8000: LDX #$00
+        0x20, 0x10, 0x80,   // $8002: JSR $8010
+        0xca,               // $8005: DEX
+        0xd0, 0xfa,         // $8006: BNE $8002
+        0x4c, 0x00, 0x80,   // $8008: JMP $8000
+        0xea, 0xea, 0xea, 0xea, 0xea,
+        0x48,               // $8010: PHA
+        0x8a,               // $8011: TXA
+        0x29, 0x0f,         // $8012: AND #$0f
+        0xc9, 0x07,         // $8014: CMP #$07
+        0x90, 0x02,         // $8016: BCC $801a
+        0xe6, 0x20,         // $8018: INC $20
+        0x68,               // $801a: PLA
+        0x60,               // $801b: RTS
+    }},
+};
+
+/**
+ *  Runs the workload for the given number of cycles, returning the emulated
+ *  speed in millions of cycles per second.
+ */
+template<typename Dispatch>
+auto measure(const workload& work, std::int64_t cycles) -> double
+{
+    auto system = basic_console<ricoh_2a03, Dispatch>{nrom_image(work.program)};
+    const auto start = std::chrono::steady_clock::now();
+    const auto executed = system.cpu.processor().interpret(cycles);
+    const auto stop = std::chrono::steady_clock::now();
+    return executed / std::chrono::duration<double>(stop - start).count() / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    const auto cycles = std::int64_t{argc > 1 ? std::stoll(argv[1]) : 100'000'000};
+    if (!threaded_dispatch::supported)
+        std::cout << "Computed goto is not supported: threaded dispatch falls back to switch.\n";
+
+    std::cout << std::left << std::setw(12) << "workload"
+        << std::right << std::setw(12) << "switch" << std::setw(12) << "threaded" << "  (Mcycles/s)\n";
+    for (const auto& work : workloads) {
+        const auto switched = measure<switch_dispatch>(work, cycles);
+        const auto threaded = measure<threaded_dispatch>(work, cycles);
+        std::cout << std::left << std::setw(12) << work.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << switched << std::setw(12) << threaded << '\n';
+    }
+    return 0;
+}
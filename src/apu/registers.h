@@ -0,0 +1,157 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "../byte.h"
+#include "../memory/segment.h"
+#include "../scheduler.h"
+
+namespace nes {
+/**
+ *  APU and I/O registers, mapped at $4000-$401f.
+ *  Like the PPU, the APU is caught up on access rather than run in lockstep.
+ *  Of its timing, only the frame counter is visible to the processor: in
+ *  four-step mode it sets the frame interrupt flag, and raises the frame IRQ,
+ *  at the end of every sequence unless inhibited.
+ */
+class registers {
+public:
+    /**
+     *  Connects the APU to the scheduler through which it raises the frame IRQ.
+     */
+    void connect(scheduler& events) noexcept
+    {
+        _events = &events;
+        reschedule();
+    }
+
+    /**
+     *  Emulates the frame counter up to the given timestamp, in CPU cycles.
+     */
+    void catch_up(std::int64_t timestamp) noexcept
+    {
+        if (timestamp <= _timestamp) return;
+        if (interrupting() && last_interrupt(timestamp) > _timestamp) _frame_interrupt = true;
+        _timestamp = timestamp;
+        reschedule();
+    }
+
+    /**
+     *  Reading the status register clears the frame interrupt flag.
+     */
+    auto read(word address) -> byte
+    {
+        if (address != 0x4015) return byte{0};
+
+        const auto result = byte{_frame_interrupt ? 0x40 : 0x00};
+        acknowledge();
+        return result;
+    }
+
+    /**
+     *  Writing OAMDMA requests a transfer of the given page to OAM, which the
+     *  processor performs when it delivers the event.
+     *  Writing the frame counter restarts its sequence in the selected mode.
+     */
+    void write(word address, byte data)
+    {
+        if (address == 0x4014) {
+            _dma_page = data;
+            if (_events != nullptr) _events->schedule(event::oam_dma, _timestamp);
+            return;
+        }
+        if (address != 0x4017) return;
+
+        _five_step = data & 0x80;
+        _inhibit = data & 0x40;
+        if (_inhibit) acknowledge();
+        _sequence = _timestamp;
+        if (_events != nullptr) _events->cancel(event::frame_irq);
+        reschedule();
+    }
+
+    /**
+     *  Address of the page most recently requested for OAM DMA.
+     */
+    constexpr auto dma_page() const noexcept -> word
+    {
+        return word{_dma_page, byte{0x00}};
+    }
+
+    static constexpr address_range range{0x4000, 0x4020};
+
+    static constexpr bool contains(word address) noexcept
+    {
+        return range.contains(address);
+    }
+
+private:
+    static constexpr std::int64_t sequence_length = 29830;
+    static constexpr std::int64_t interrupt_offset = 29829;
+
+    constexpr bool interrupting() const noexcept
+    {
+        return !_five_step && !_inhibit;
+    }
+
+    /**
+     *  Timestamp of the last end of sequence at or before the given one,
+     *  which lies before the start of the sequence if there is none yet.
+     */
+    constexpr auto last_interrupt(std::int64_t timestamp) const noexcept -> std::int64_t
+    {
+        const auto elapsed = timestamp - _sequence - interrupt_offset;
+        if (elapsed < 0) return _sequence - 1;
+        return timestamp - elapsed % sequence_length;
+    }
+
+    void acknowledge() noexcept
+    {
+        _frame_interrupt = false;
+        if (_events != nullptr) _events->acknowledge(event::frame_irq);
+    }
+
+    /**
+     *  Schedules the next frame IRQ, unless one is pending already.
+     */
+    void reschedule() noexcept
+    {
+        if (_events == nullptr) return;
+
+        if (!interrupting()) {
+            _events->cancel(event::frame_irq);
+        } else if (_events->when(event::frame_irq) == scheduler::never) {
+            const auto last = last_interrupt(_timestamp);
+            const auto next = last < _sequence ? _sequence + interrupt_offset : last + sequence_length;
+            _events->schedule(event::frame_irq, next);
+        }
+    }
+
+    scheduler* _events = nullptr;
+    std::int64_t _timestamp = 0;
+    std::int64_t _sequence = 0;
+    bool _five_step = false;
+    bool _inhibit = false;
+    bool _frame_interrupt = false;
+    byte _dma_page = byte{0x00};
+};
+}
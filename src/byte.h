@@ -28,6 +28,7 @@
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <type_traits>
 
 namespace nes {
 /**
@@ -86,12 +87,12 @@ public:
 
     constexpr auto as_signed() const
     {
-        return bitwise_wrapper<std::make_signed_t<T>>{static_cast<std::make_signed_t<T>>(_value)};
+        return static_cast<std::make_signed_t<T>>(_value);
     }
 
     constexpr auto as_unsigned() const
     {
-        return bitwise_wrapper<std::make_unsigned_t<T>>{static_cast<std::make_unsigned_t<T>>(_value)};
+        return static_cast<std::make_unsigned_t<T>>(_value);
     }
 
     constexpr auto increment(int step = 1) -> Derived&
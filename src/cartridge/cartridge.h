@@ -19,17 +19,38 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <vector>
-#include <experimental/filesystem>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 #include "../byte.h"
+#include "../memory/segment.h"
+#include "../scheduler.h"
+#include "database.h"
+#include "mapper.h"
 #include "rom.h"
 
 namespace nes {
-namespace fs = std::experimental::filesystem;
+namespace fs = std::filesystem;
 /**
  *  Implements the functionality associated with the Nintendo cartridge boards.
+ *  The ROM file is immutable and shared between all cartridges made from it,
+ *  each of which owns only its RAM and the state of its mapper.
+ *  PRG ROM is seen through the windows of a bank table, which the mapper
+ *  moves on writes to its registers. Switched windows are reported to the
+ *  memory bus through remapped(), upon which it updates the pages behind
+ *  them, so that reads from ROM stay direct loads without any copying.
+ *  Boards without CHR ROM have CHR RAM instead, of the size given by the
+ *  header but at least 8 KB, and all boards are given 8 KB of PRG RAM at
+ *  $6000-$7fff.
+ *  Boards with a scanline counter are caught up like the other devices, and
+ *  raise their IRQ through the scheduler.
  */
 class cartridge {
 public:
@@ -37,34 +58,158 @@ public:
         cartridge{read_rom(path)}
     {}
 
+    cartridge(const fs::path path, const rom_database& database) :
+        cartridge{read_rom(path, database)}
+    {}
+
     cartridge(rom_file file) :
-        _prg_rom(file.prg_rom),
-        _chr_rom(file.chr_rom),
-        _prg_lower{span<byte>{_prg_rom.data(), 0x4000}, word{0x8000}, word{0x4000}},
-        _prg_upper{span<byte>{_prg_rom.data() + 0x4000, 0x4000}, word{0xc000}, word{0x4000}}
+        cartridge{std::make_shared<const rom_file>(std::move(file))}
+    {}
+
+    cartridge(shared_rom rom) :
+        _rom{std::move(rom)},
+        _chr_ram(_rom->chr_rom.empty() ? std::max<std::size_t>(_rom->chr_ram_size + _rom->chr_nvram_size, 0x2000) : 0, byte{0x00}),
+        _banks{_rom->prg_rom, _rom->chr_rom.empty() ? span<const byte>{_chr_ram} : _rom->chr_rom},
+        _mapper{make_mapper(_rom->mapper)}
+    {
+        if (_rom->prg_rom.empty() || _rom->prg_rom.size() % 0x4000 != 0) throw std::runtime_error{"Invalid PRG ROM size in ROM file"};
+        if (_rom->chr_rom.size() % 0x2000 != 0) throw std::runtime_error{"Invalid CHR ROM size in ROM file"};
+
+        _banks.arrangement = _rom->four_screen_vram ? mirroring::four_screen
+            : _rom->vertical_mirroring ? mirroring::vertical : mirroring::horizontal;
+        std::visit([&](auto& board) { board.reset(_banks); }, _mapper);
+        _banks.switched();
+    }
+
+    /**
+     *  The bank table points into the CHR RAM, which moves along with the
+     *  cartridge, but would be shared by a copy.
+     */
+    cartridge(const cartridge&) = delete;
+    cartridge& operator=(const cartridge&) = delete;
+    cartridge(cartridge&&) = default;
+    cartridge& operator=(cartridge&&) = default;
+
+
+    /**
+     *  Connects the scanline counter, if any, to the scheduler through which
+     *  it raises the mapper IRQ.
+     */
+    void connect(scheduler& events) noexcept
     {
-        if (file.mapper != 0x00) throw std::runtime_error{"Unsupported mapper type: only mapper 0 is implemented"};
-        if (_prg_rom.size() > 0x8000) throw std::runtime_error{"Unsupported PRG ROM size in ROM file: bank switching is not yet supported"};
-        if (_chr_rom.size() > 0x2000) throw std::runtime_error{"Unsupported CHR ROM size in ROM file: bank switching is not yet supported"};
+        if (auto board = std::get_if<mmc3>(&_mapper)) board->connect(events);
+    }
+
+    /**
+     *  Emulates the scanline counter, if any, up to the given timestamp, in
+     *  CPU cycles.
+     */
+    void catch_up(std::int64_t timestamp) noexcept
+    {
+        if (auto board = std::get_if<mmc3>(&_mapper)) board->catch_up(timestamp * dots_per_cycle);
+    }
+
+    /**
+     *  The PPU reports the dot within each rendered scanline at which its
+     *  address line A12 rises, from the given dot on, whenever that changes.
+     */
+    void retime(std::int64_t dot, std::int64_t rise) noexcept
+    {
+        if (auto board = std::get_if<mmc3>(&_mapper)) board->retime(dot, rise);
     }
 
 
     constexpr auto read(word address) const -> byte
     {
-        if (address < 0xc000) return _prg_lower.read(address);
-        else return _prg_lower.read(address);
+        if (address < 0x6000) return byte{0x00};
+        if (address < 0x8000) return _prg_ram.read(address);
+        return _banks.read_prg(address);
+    }
+
+    void write(word address, byte data)
+    {
+        if (address < 0x6000) return;
+        if (address < 0x8000) return _prg_ram.write(address, data);
+        std::visit([&](auto& board) { board.write(_banks, address, data); }, _mapper);
+    }
+
+    /**
+     *  PRG RAM and ROM are read directly through the page table, and PRG RAM
+     *  is written directly as well. Writes to ROM go through the mapper.
+     */
+    constexpr auto read_page(word address) const noexcept -> const byte*
+    {
+        if (address < 0x6000) return nullptr;
+        if (address < 0x8000) return _prg_ram.page(address);
+        return _banks.prg_page(address);
+    }
+
+    constexpr auto write_page(word address) noexcept -> byte*
+    {
+        if (address < 0x6000 || address >= 0x8000) return nullptr;
+        return _prg_ram.page(address);
+    }
+
+    /**
+     *  Returns the addresses whose banks were switched since the last call.
+     */
+    constexpr auto remapped() noexcept -> address_range
+    {
+        return _banks.switched();
+    }
+
+    /**
+     *  Identifies the 8 KB PRG bank mapped at the given address, so that
+     *  code cached from one bank is not run from another.
+     */
+    constexpr auto bank(word address) const noexcept -> std::uint32_t
+    {
+        return address < 0x8000 ? 0 : _banks.prg_bank(address);
+    }
+
+    /**
+     *  The PPU's view of CHR memory at $0000-$1fff, through 1 KB windows.
+     *  Writes only take effect on boards with CHR RAM.
+     */
+    constexpr auto read_chr(word address) const -> byte
+    {
+        return _banks.read_chr(address);
     }
 
-    constexpr void write(word address, byte data)
+    void write_chr(word address, byte data)
     {
-        /* Writes to rom are a no-op. */
+        if (!_chr_ram.empty()) _chr_ram[_banks.chr_offset(address)] = data;
+    }
+
+    constexpr auto arrangement() const noexcept -> mirroring
+    {
+        return _banks.arrangement;
+    }
+
+    static constexpr address_range range{0x4020, 0x10000};
+
+    static constexpr bool contains(word address) noexcept
+    {
+        return range.contains(address);
+    }
+
+    /**
+     *  Reads from cartridge space have no side effects.
+     */
+    static constexpr bool idempotent(word) noexcept
+    {
+        return true;
     }
 
 private:
-    std::vector<byte> _prg_rom;
-    std::vector<byte> _chr_rom;
-    segment_view _prg_lower;
-    segment_view _prg_upper;
-    /* TODO: CHR ROM segment*/
+    static constexpr std::int64_t dots_per_cycle = 3;
+
+    shared_rom _rom;
+    std::vector<byte> _chr_ram;
+    bank_table _banks;
+    mapper _mapper;
+    segment<0x2000, 0x6000, 0x8000> _prg_ram = {};
 };
-}
\ No newline at end of file
+
+static_assert(!std::is_copy_constructible_v<cartridge> && std::is_move_constructible_v<cartridge>);
+}
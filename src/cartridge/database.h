@@ -0,0 +1,263 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Identification of ROM images by hash, to correct their headers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "rom.h"
+
+namespace nes {
+/**
+ *  ROM images are identified by the hashes of their PRG ROM followed by
+ *  their CHR ROM, as in the common ROM databases, so that the header and
+ *  any trainer play no part.
+ */
+struct rom_digest {
+    std::uint32_t crc32;
+    sha1_digest sha1;
+};
+
+/**
+ *  Hashes the image in a single pass over it, which for a mapped file is
+ *  also the pass that reads it from disk.
+ */
+inline auto digest(const rom_file& rom) -> rom_digest
+{
+    auto crc = crc32{};
+    auto hash = sha1{};
+    for (const auto region : {rom.prg_rom, rom.chr_rom}) {
+        crc.update(region);
+        hash.update(region);
+    }
+    return rom_digest{crc.value(), hash.digest()};
+}
+
+
+/**
+ *  What the database knows of a board, which replaces what the header says.
+ *  An entry with a SHA-1 of all zeroes matches on the CRC alone.
+ */
+struct rom_entry {
+    std::uint32_t crc32;
+    sha1_digest sha1;
+
+    std::uint16_t mapper;
+    std::uint8_t submapper;
+    bool vertical_mirroring;
+    bool four_screen_vram;
+    bool persistent_memory;
+    std::uint32_t prg_ram_size;
+    std::uint32_t prg_nvram_size;
+    std::uint32_t chr_ram_size;
+    std::uint32_t chr_nvram_size;
+    region timing;
+};
+
+/**
+ *  Entries are kept sorted by CRC, so that a lookup is a binary search; the
+ *  SHA-1 then tells apart the rare images that share a CRC.
+ */
+class rom_database {
+public:
+    explicit rom_database(std::vector<rom_entry> entries) :
+        _entries{std::move(entries)}
+    {
+        std::sort(_entries.begin(), _entries.end(), [](const auto& left, const auto& right) {
+            return left.crc32 < right.crc32;
+        });
+    }
+
+    auto find(const rom_digest& key) const -> const rom_entry*
+    {
+        const auto first = std::lower_bound(_entries.begin(), _entries.end(), key.crc32, [](const auto& entry, std::uint32_t crc) {
+            return entry.crc32 < crc;
+        });
+        for (auto entry = first; entry != _entries.end() && entry->crc32 == key.crc32; ++entry) {
+            if (entry->sha1 == sha1_digest{} || entry->sha1 == key.sha1) return &*entry;
+        }
+        return nullptr;
+    }
+
+    auto size() const noexcept -> std::size_t
+    {
+        return _entries.size();
+    }
+
+private:
+    std::vector<rom_entry> _entries;
+};
+
+
+/**
+ *  The tag of the first element of the given name in the text, without its
+ *  angle brackets, or nothing if there is none. The name must end where the
+ *  tag's name does, so that <rom> is not found in <prgrom>.
+ */
+inline auto xml_element(std::string_view text, std::string_view name) -> std::string_view
+{
+    for (auto start = text.find('<'); start != std::string_view::npos; start = text.find('<', start + 1)) {
+        const auto tag = text.substr(start + 1);
+        if (tag.substr(0, name.size()) != name) continue;
+        const auto end = tag.find('>');
+        if (end == std::string_view::npos) return {};
+        const auto next = tag[name.size()];
+        if (next == '/' || next == '>' || std::isspace(static_cast<unsigned char>(next))) return tag.substr(0, end);
+    }
+    return {};
+}
+
+/**
+ *  The value of the attribute of the given name in a tag, if present.
+ */
+inline auto xml_attribute(std::string_view tag, std::string_view name) -> std::optional<std::string_view>
+{
+    const auto pattern = std::string{name} + "=\"";
+    for (auto found = tag.find(pattern); found != std::string_view::npos; found = tag.find(pattern, found + 1)) {
+        if (found == 0 || !std::isspace(static_cast<unsigned char>(tag[found - 1]))) continue;
+        const auto start = found + pattern.size();
+        const auto end = tag.find('"', start);
+        if (end == std::string_view::npos) break;
+        return tag.substr(start, end - start);
+    }
+    return std::nullopt;
+}
+
+/**
+ *  Numeric attribute of a tag, which is zero if the attribute or the whole
+ *  element is absent.
+ */
+inline auto xml_number(std::string_view tag, std::string_view name, int base = 10) -> std::uint32_t
+{
+    const auto value = xml_attribute(tag, name);
+    if (!value) return 0;
+    auto result = std::uint32_t{0};
+    const auto [end, error] = std::from_chars(value->data(), value->data() + value->size(), result, base);
+    if (error != std::errc{} || end != value->data() + value->size()) throw std::runtime_error("Invalid ROM database.");
+    return result;
+}
+
+/**
+ *  Reads a database in the XML format of the NES 2.0 header database, in
+ *  which every <game> lists the hashes of its ROM and the fields of its
+ *  header. Only the elements used by identify() are read; games without a
+ *  CRC are left out.
+ *  The hashes of a <rom> cover all data after the header, which matches
+ *  digest() for every image but those with a trainer or PlayChoice ROM.
+ */
+inline auto read_database(const fs::path& path) -> rom_database
+{
+    if (!fs::exists(path)) throw std::invalid_argument("Non-existent file.");
+    const auto file = mapped_file{path};
+    const auto text = std::string_view{reinterpret_cast<const char*>(file.data()), file.size()};
+
+    auto entries = std::vector<rom_entry>{};
+    for (auto start = text.find("<game>"); start != std::string_view::npos; start = text.find("<game>", start + 1)) {
+        const auto end = text.find("</game>", start);
+        const auto game = text.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+
+        const auto rom = xml_element(game, "rom");
+        const auto crc = xml_attribute(rom, "crc32");
+        if (!crc) continue;
+
+        auto entry = rom_entry{};
+        entry.crc32 = xml_number(rom, "crc32", 16);
+        if (const auto sha1 = xml_attribute(rom, "sha1")) {
+            if (sha1->size() != 2 * entry.sha1.size()) throw std::runtime_error("Invalid ROM database.");
+            for (auto index = std::size_t{0}; index < entry.sha1.size(); ++index) {
+                const auto digits = sha1->data() + 2 * index;
+                const auto [last, error] = std::from_chars(digits, digits + 2, entry.sha1[index], 16);
+                if (error != std::errc{} || last != digits + 2) throw std::runtime_error("Invalid ROM database.");
+            }
+        }
+
+        const auto pcb = xml_element(game, "pcb");
+        const auto arrangement = xml_attribute(pcb, "mirroring").value_or("H");
+        entry.mapper = static_cast<std::uint16_t>(xml_number(pcb, "mapper"));
+        entry.submapper = static_cast<std::uint8_t>(xml_number(pcb, "submapper"));
+        entry.vertical_mirroring = arrangement == "V";
+        entry.four_screen_vram = arrangement == "4";
+        entry.persistent_memory = xml_number(pcb, "battery") != 0;
+        entry.prg_ram_size = xml_number(xml_element(game, "prgram"), "size");
+        entry.prg_nvram_size = xml_number(xml_element(game, "prgnvram"), "size");
+        entry.chr_ram_size = xml_number(xml_element(game, "chrram"), "size");
+        entry.chr_nvram_size = xml_number(xml_element(game, "chrnvram"), "size");
+        entry.timing = static_cast<region>(xml_number(xml_element(game, "console"), "region") & 0x3);
+        entries.push_back(entry);
+    }
+    return rom_database{std::move(entries)};
+}
+
+
+/**
+ *  Replaces the fields of the ROM's header by those of the database entry.
+ */
+inline void correct(rom_file& rom, const rom_entry& entry)
+{
+    rom.mapper = entry.mapper;
+    rom.submapper = entry.submapper;
+    rom.vertical_mirroring = entry.vertical_mirroring;
+    rom.four_screen_vram = entry.four_screen_vram;
+    rom.persistent_memory = entry.persistent_memory;
+    rom.prg_ram_size = entry.prg_ram_size;
+    rom.prg_nvram_size = entry.prg_nvram_size;
+    rom.chr_ram_size = entry.chr_ram_size;
+    rom.chr_nvram_size = entry.chr_nvram_size;
+    rom.timing = entry.timing;
+}
+
+/**
+ *  Looks the ROM up in the database, correcting its header by the entry
+ *  found, if any. Returns the entry.
+ */
+inline auto identify(rom_file& rom, const rom_database& database) -> const rom_entry*
+{
+    const auto entry = database.find(digest(rom));
+    if (entry != nullptr) correct(rom, *entry);
+    return entry;
+}
+
+/**
+ *  Reads the ROM file at the given path, as corrected by the database.
+ */
+inline auto read_rom(const fs::path& path, const rom_database& database) -> rom_file
+{
+    auto rom = read_rom(path);
+    identify(rom, database);
+    return rom;
+}
+}
@@ -0,0 +1,269 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Hashes by which ROM images are identified.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "../byte.h"
+#include "../memory/span.h"
+
+/**
+ *  Carry-less multiplication folds the CRC over 64 bytes at a time. It is
+ *  used where the compiler can target it per function, and only if the
+ *  processor turns out to support it.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define NES_PCLMUL 1
+#include <immintrin.h>
+#else
+#define NES_PCLMUL 0
+#endif
+
+namespace nes {
+namespace detail {
+/**
+ *  Remainder of every byte by the reflected polynomial $edb88320.
+ */
+constexpr auto make_crc32_table() noexcept -> std::array<std::uint32_t, 256>
+{
+    auto result = std::array<std::uint32_t, 256>{};
+    for (auto value = 0u; value < 256; ++value) {
+        auto remainder = value;
+        for (auto bit = 0; bit < 8; ++bit)
+            remainder = (remainder >> 1) ^ ((remainder & 1) ? 0xedb88320 : 0);
+        result[value] = remainder;
+    }
+    return result;
+}
+
+inline constexpr auto crc32_table = make_crc32_table();
+}
+
+/**
+ *  CRC-32 as used by zip and the common ROM databases: the reflected
+ *  polynomial $edb88320, with the register inverted before and after.
+ */
+class crc32 {
+public:
+    void update(span<const byte> data) noexcept
+    {
+#if NES_PCLMUL
+        if (data.size() >= 64 && accelerated()) {
+            const auto folded = data.size() & ~std::ptrdiff_t{15};
+            _state = fold(_state, data.data(), folded);
+            data = data.subspan(folded, data.size() - folded);
+        }
+#endif
+        _state = update(_state, data);
+    }
+
+    constexpr auto value() const noexcept -> std::uint32_t
+    {
+        return ~_state;
+    }
+
+    /**
+     *  Bytewise update of the register, through the table of remainders.
+     */
+    static constexpr auto update(std::uint32_t state, span<const byte> data) noexcept -> std::uint32_t
+    {
+        for (auto index = std::ptrdiff_t{0}; index < data.size(); ++index)
+            state = detail::crc32_table[(state ^ data[index]) & 0xff] ^ (state >> 8);
+        return state;
+    }
+
+private:
+#if NES_PCLMUL
+    static auto accelerated() noexcept -> bool
+    {
+        static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+        return supported;
+    }
+
+    __attribute__((target("pclmul,sse4.1")))
+    static auto load(const byte* from) noexcept -> __m128i
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+    }
+
+    __attribute__((target("pclmul,sse4.1")))
+    static auto fold_into(__m128i lane, __m128i constants, __m128i next) noexcept -> __m128i
+    {
+        const auto low = _mm_clmulepi64_si128(lane, constants, 0x00);
+        const auto high = _mm_clmulepi64_si128(lane, constants, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(low, high), next);
+    }
+
+    /**
+     *  Folds the register over a multiple of 16 bytes, at least 64, following
+     *  Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+     *  Instruction": four lanes are folded 64 bytes ahead at a time, then
+     *  into one, which is reduced to 32 bits by Barrett reduction. The
+     *  constants are powers of x modulo the polynomial, bit-reflected.
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    static auto fold(std::uint32_t state, const byte* data, std::ptrdiff_t size) noexcept -> std::uint32_t
+    {
+        auto x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(state)));
+        auto x2 = load(data + 0x10);
+        auto x3 = load(data + 0x20);
+        auto x4 = load(data + 0x30);
+        data += 0x40;
+        size -= 0x40;
+
+        const auto r2r1 = _mm_set_epi64x(0x00000001c6e41596, 0x0000000154442bd4);
+        for (; size >= 0x40; data += 0x40, size -= 0x40) {
+            x1 = fold_into(x1, r2r1, load(data));
+            x2 = fold_into(x2, r2r1, load(data + 0x10));
+            x3 = fold_into(x3, r2r1, load(data + 0x20));
+            x4 = fold_into(x4, r2r1, load(data + 0x30));
+        }
+
+        const auto r4r3 = _mm_set_epi64x(0x00000000ccaa009e, 0x00000001751997d0);
+        x1 = fold_into(x1, r4r3, x2);
+        x1 = fold_into(x1, r4r3, x3);
+        x1 = fold_into(x1, r4r3, x4);
+        for (; size >= 0x10; data += 0x10, size -= 0x10)
+            x1 = fold_into(x1, r4r3, load(data));
+
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(r4r3, x1, 0x01));
+
+        const auto mask32 = _mm_set_epi32(0, 0, 0, -1);
+        const auto r5 = _mm_set_epi64x(0, 0x0000000163cd6124);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), r5, 0x00));
+
+        const auto polynomials = _mm_set_epi64x(0x00000001f7011641, 0x00000001db710641);
+        auto reduced = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), polynomials, 0x10);
+        reduced = _mm_clmulepi64_si128(_mm_and_si128(reduced, mask32), polynomials, 0x00);
+        return static_cast<std::uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, reduced), 1));
+    }
+#endif
+
+    std::uint32_t _state = 0xffffffff;
+};
+
+static_assert([] {
+    constexpr auto check = std::array<byte, 9>{byte{'1'}, byte{'2'}, byte{'3'}, byte{'4'}, byte{'5'}, byte{'6'}, byte{'7'}, byte{'8'}, byte{'9'}};
+    return ~crc32::update(0xffffffff, span<const byte>{check}) == 0xcbf43926;
+}());
+
+
+/**
+ *  SHA-1, as given by FIPS 180-4.
+ */
+using sha1_digest = std::array<std::uint8_t, 20>;
+
+class sha1 {
+public:
+
+    constexpr void update(span<const byte> data) noexcept
+    {
+        for (auto index = std::ptrdiff_t{0}; index < data.size();) {
+            const auto offset = static_cast<std::ptrdiff_t>(_length % 64);
+            const auto count = std::min<std::ptrdiff_t>(64 - offset, data.size() - index);
+            for (auto next = std::ptrdiff_t{0}; next < count; ++next)
+                _block[offset + next] = data[index + next];
+            index += count;
+            _length += count;
+            if (_length % 64 == 0) compress();
+        }
+    }
+
+    /**
+     *  Pads the message and returns its digest. The hash can not be updated
+     *  any further afterwards.
+     */
+    constexpr auto digest() noexcept -> sha1_digest
+    {
+        const auto bits = _length * 8;
+        _block[_length++ % 64] = 0x80;
+        if (_length % 64 == 0) compress();
+        while (_length % 64 != 56) {
+            _block[_length++ % 64] = 0x00;
+            if (_length % 64 == 0) compress();
+        }
+        for (auto shift = 56; shift >= 0; shift -= 8)
+            _block[_length++ % 64] = static_cast<std::uint8_t>(bits >> shift);
+        compress();
+
+        auto result = sha1_digest{};
+        for (auto word = 0u; word < 5; ++word)
+            for (auto offset = 0u; offset < 4; ++offset)
+                result[4 * word + offset] = static_cast<std::uint8_t>(_state[word] >> (24 - 8 * offset));
+        return result;
+    }
+
+private:
+    static constexpr auto rotate(std::uint32_t value, int count) noexcept -> std::uint32_t
+    {
+        return (value << count) | (value >> (32 - count));
+    }
+
+    constexpr void compress() noexcept
+    {
+        std::uint32_t schedule[80] = {};
+        for (auto index = 0; index < 16; ++index) {
+            schedule[index] = std::uint32_t{_block[4 * index]} << 24 | std::uint32_t{_block[4 * index + 1]} << 16
+                | std::uint32_t{_block[4 * index + 2]} << 8 | std::uint32_t{_block[4 * index + 3]};
+        }
+        for (auto index = 16; index < 80; ++index)
+            schedule[index] = rotate(schedule[index - 3] ^ schedule[index - 8] ^ schedule[index - 14] ^ schedule[index - 16], 1);
+
+        auto a = _state[0], b = _state[1], c = _state[2], d = _state[3], e = _state[4];
+        const auto round = [&](std::uint32_t f, std::uint32_t k, std::uint32_t scheduled) {
+            const auto temporary = rotate(a, 5) + f + e + k + scheduled;
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = temporary;
+        };
+        for (auto index = 0; index < 20; ++index) round((b & c) | (~b & d), 0x5a827999, schedule[index]);
+        for (auto index = 20; index < 40; ++index) round(b ^ c ^ d, 0x6ed9eba1, schedule[index]);
+        for (auto index = 40; index < 60; ++index) round((b & c) | (b & d) | (c & d), 0x8f1bbcdc, schedule[index]);
+        for (auto index = 60; index < 80; ++index) round(b ^ c ^ d, 0xca62c1d6, schedule[index]);
+
+        _state[0] += a;
+        _state[1] += b;
+        _state[2] += c;
+        _state[3] += d;
+        _state[4] += e;
+    }
+
+    std::array<std::uint32_t, 5> _state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    std::array<std::uint8_t, 64> _block = {};
+    std::uint64_t _length = 0;
+};
+
+static_assert([] {
+    constexpr auto message = std::array<byte, 3>{byte{'a'}, byte{'b'}, byte{'c'}};
+    auto hash = sha1{};
+    hash.update(span<const byte>{message});
+    const auto result = hash.digest();
+    return result[0] == 0xa9 && result[1] == 0x99 && result[18] == 0xd8 && result[19] == 0x9d;
+}());
+}
@@ -0,0 +1,460 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Decompression of gzip and zip files, so that ROM sets can be kept packed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../byte.h"
+#include "../memory/span.h"
+#include "hash.h"
+
+namespace nes {
+/**
+ *  Decoder for DEFLATE streams, as described by RFC 1951.
+ *  The whole output is kept in memory, so it serves as the window for the
+ *  back-references itself, and is written only once. Huffman codes of up to
+ *  ten bits are decoded through a table indexed by the next bits of input;
+ *  longer ones are decoded canonically, one bit at a time.
+ */
+class inflater {
+public:
+    explicit inflater(span<const byte> input) noexcept :
+        _input{input}
+    {}
+
+    /**
+     *  Decodes the stream, appending to the output. Fails rather than let the
+     *  output grow beyond the given limit.
+     */
+    void inflate(std::vector<byte>& output, std::size_t limit)
+    {
+        for (auto last = false; !last;) {
+            last = bits(1);
+            switch (bits(2)) {
+            case 0:
+                stored(output, limit);
+                break;
+            case 1:
+                codes(output, limit, fixed().first, fixed().second);
+                break;
+            case 2:
+                dynamic();
+                codes(output, limit, _lengths, _distances);
+                break;
+            default:
+                throw std::runtime_error("Invalid compressed data.");
+            }
+        }
+    }
+
+    /**
+     *  Number of input bytes taken up by the stream, including the partially
+     *  used last one.
+     */
+    auto consumed() const noexcept -> std::ptrdiff_t
+    {
+        return _position - _count / 8;
+    }
+
+private:
+    static constexpr int fast_bits = 10;
+    static constexpr int max_bits = 15;
+
+    struct huffman {
+        std::array<std::uint16_t, max_bits + 1> counts;
+        std::array<std::uint16_t, 288> symbols;
+        std::array<std::uint16_t, 1 << fast_bits> fast;  // symbol << 4 | length, or 0 if longer
+    };
+
+    static constexpr std::array<std::uint16_t, 29> length_base = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static constexpr std::array<std::uint8_t, 29> length_extra = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static constexpr std::array<std::uint16_t, 30> distance_base = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static constexpr std::array<std::uint8_t, 30> distance_extra = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    void refill() noexcept
+    {
+        while (_count <= 56 && _position < _input.size()) {
+            _bits |= std::uint64_t{_input[_position++]} << _count;
+            _count += 8;
+        }
+    }
+
+    auto bits(int count) -> std::uint32_t
+    {
+        if (_count < count) refill();
+        if (_count < count) throw std::runtime_error("Truncated compressed data.");
+        const auto value = static_cast<std::uint32_t>(_bits & ((std::uint64_t{1} << count) - 1));
+        _bits >>= count;
+        _count -= count;
+        return value;
+    }
+
+    /**
+     *  Builds the decoding tables for a canonical Huffman code from its code
+     *  lengths. Incomplete codes are allowed, as for a single distance code;
+     *  decoding a code that is not in use fails.
+     */
+    static void build(huffman& code, const std::uint8_t* lengths, int count)
+    {
+        code.counts.fill(0);
+        for (auto symbol = 0; symbol < count; ++symbol) ++code.counts[lengths[symbol]];
+        code.counts[0] = 0;
+
+        auto left = 1;
+        for (auto length = 1; length <= max_bits; ++length) {
+            left = (left << 1) - code.counts[length];
+            if (left < 0) throw std::runtime_error("Invalid compressed data.");
+        }
+
+        auto offsets = std::array<std::uint16_t, max_bits + 2>{};
+        for (auto length = 1; length <= max_bits; ++length) offsets[length + 1] = offsets[length] + code.counts[length];
+        for (auto symbol = 0; symbol < count; ++symbol) {
+            if (lengths[symbol] != 0) code.symbols[offsets[lengths[symbol]]++] = static_cast<std::uint16_t>(symbol);
+        }
+
+        code.fast.fill(0);
+        auto next = 0u, index = 0u;
+        for (auto length = 1; length <= fast_bits; ++length, next <<= 1) {
+            for (auto symbol = 0; symbol < code.counts[length]; ++symbol, ++next, ++index) {
+                auto reversed = 0u;
+                for (auto bit = 0; bit < length; ++bit) reversed |= ((next >> bit) & 1) << (length - 1 - bit);
+                for (auto fill = reversed; fill < code.fast.size(); fill += 1u << length)
+                    code.fast[fill] = static_cast<std::uint16_t>(code.symbols[index] << 4 | length);
+            }
+        }
+    }
+
+    auto decode(const huffman& code) -> int
+    {
+        if (_count < fast_bits) refill();
+        if (_count >= fast_bits) {
+            const auto entry = code.fast[_bits & ((1u << fast_bits) - 1)];
+            if (entry != 0) {
+                _bits >>= entry & 0xf;
+                _count -= entry & 0xf;
+                return entry >> 4;
+            }
+        }
+
+        auto value = 0, first = 0, index = 0;
+        for (auto length = 1; length <= max_bits; ++length) {
+            value |= static_cast<int>(bits(1));
+            const int count = code.counts[length];
+            if (value - count < first) return code.symbols[index + (value - first)];
+            index += count;
+            first = (first + count) << 1;
+            value <<= 1;
+        }
+        throw std::runtime_error("Invalid compressed data.");
+    }
+
+    /**
+     *  Stored blocks start at a byte boundary, and are copied as they are.
+     */
+    void stored(std::vector<byte>& output, std::size_t limit)
+    {
+        bits(_count % 8);
+        _position -= _count / 8;
+        _bits = 0;
+        _count = 0;
+
+        if (_input.size() - _position < 4) throw std::runtime_error("Truncated compressed data.");
+        const auto length = std::uint32_t{_input[_position]} | std::uint32_t{_input[_position + 1]} << 8;
+        const auto complement = std::uint32_t{_input[_position + 2]} | std::uint32_t{_input[_position + 3]} << 8;
+        _position += 4;
+
+        if (length != (~complement & 0xffff)) throw std::runtime_error("Invalid compressed data.");
+        if (_input.size() - _position < length) throw std::runtime_error("Truncated compressed data.");
+        if (limit - output.size() < length) throw std::runtime_error("Compressed data larger than declared.");
+        output.insert(output.end(), _input.data() + _position, _input.data() + _position + length);
+        _position += length;
+    }
+
+    void codes(std::vector<byte>& output, std::size_t limit, const huffman& lengths, const huffman& distances)
+    {
+        for (;;) {
+            const auto symbol = decode(lengths);
+            if (symbol < 256) {
+                if (output.size() >= limit) throw std::runtime_error("Compressed data larger than declared.");
+                output.push_back(byte{static_cast<std::uint8_t>(symbol)});
+            } else if (symbol == 256) {
+                return;
+            } else {
+                const auto index = symbol - 257;
+                if (index >= 29) throw std::runtime_error("Invalid compressed data.");
+                const auto length = length_base[index] + bits(length_extra[index]);
+
+                const auto code = decode(distances);
+                if (code >= 30) throw std::runtime_error("Invalid compressed data.");
+                const auto distance = distance_base[code] + bits(distance_extra[code]);
+
+                if (distance > output.size()) throw std::runtime_error("Invalid compressed data.");
+                if (limit - output.size() < length) throw std::runtime_error("Compressed data larger than declared.");
+                const auto from = output.size() - distance;
+                for (auto offset = std::size_t{0}; offset < length; ++offset) {
+                    const auto value = output[from + offset];
+                    output.push_back(value);
+                }
+            }
+        }
+    }
+
+    /**
+     *  Dynamic blocks start with the code lengths of their codes, which are
+     *  themselves Huffman coded, and run-length encoded.
+     */
+    void dynamic()
+    {
+        static constexpr std::array<std::uint8_t, 19> order = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        const auto literals = static_cast<int>(bits(5)) + 257;
+        const auto distances = static_cast<int>(bits(5)) + 1;
+        const auto count = static_cast<int>(bits(4)) + 4;
+        if (literals > 286 || distances > 30) throw std::runtime_error("Invalid compressed data.");
+
+        auto lengths = std::array<std::uint8_t, 286 + 30>{};
+        for (auto index = 0; index < count; ++index) lengths[order[index]] = static_cast<std::uint8_t>(bits(3));
+        build(_lengths, lengths.data(), 19);
+
+        lengths.fill(0);
+        for (auto index = 0; index < literals + distances;) {
+            const auto symbol = decode(_lengths);
+            if (symbol < 16) {
+                lengths[index++] = static_cast<std::uint8_t>(symbol);
+                continue;
+            }
+
+            auto value = std::uint8_t{0};
+            auto repeat = 0;
+            if (symbol == 16) {
+                if (index == 0) throw std::runtime_error("Invalid compressed data.");
+                value = lengths[index - 1];
+                repeat = 3 + static_cast<int>(bits(2));
+            } else if (symbol == 17) {
+                repeat = 3 + static_cast<int>(bits(3));
+            } else {
+                repeat = 11 + static_cast<int>(bits(7));
+            }
+            if (index + repeat > literals + distances) throw std::runtime_error("Invalid compressed data.");
+            while (repeat-- > 0) lengths[index++] = value;
+        }
+
+        if (lengths[256] == 0) throw std::runtime_error("Invalid compressed data.");
+        build(_lengths, lengths.data(), literals);
+        build(_distances, lengths.data() + literals, distances);
+    }
+
+    static auto fixed() -> const std::pair<huffman, huffman>&
+    {
+        static const auto codes = [] {
+            auto lengths = std::array<std::uint8_t, 288 + 30>{};
+            std::fill_n(lengths.begin(), 144, 8);
+            std::fill_n(lengths.begin() + 144, 112, 9);
+            std::fill_n(lengths.begin() + 256, 24, 7);
+            std::fill_n(lengths.begin() + 280, 8, 8);
+            std::fill_n(lengths.begin() + 288, 30, 5);
+
+            auto result = std::pair<huffman, huffman>{};
+            build(result.first, lengths.data(), 288);
+            build(result.second, lengths.data() + 288, 30);
+            return result;
+        }();
+        return codes;
+    }
+
+    span<const byte> _input;
+    std::ptrdiff_t _position = 0;
+    std::uint64_t _bits = 0;
+    int _count = 0;
+    huffman _lengths = {};
+    huffman _distances = {};
+};
+
+
+namespace detail {
+/**
+ *  Little-endian field of a compressed file, checked against its end.
+ */
+inline auto little_endian(span<const byte> data, std::size_t offset, int size) -> std::uint32_t
+{
+    if (offset > static_cast<std::size_t>(data.size()) || static_cast<std::size_t>(data.size()) - offset < static_cast<std::size_t>(size)) throw std::runtime_error("Truncated compressed file.");
+    auto value = std::uint32_t{0};
+    for (auto index = 0; index < size; ++index) value |= std::uint32_t{data[offset + index]} << (8 * index);
+    return value;
+}
+
+/**
+ *  Inflates into a buffer of the declared size, which is the final one;
+ *  no more is reserved than the input could possibly expand to.
+ */
+inline auto inflate(span<const byte> input, std::size_t size, std::uint32_t crc) -> std::vector<byte>
+{
+    auto output = std::vector<byte>{};
+    output.reserve(std::min<std::size_t>(size, static_cast<std::size_t>(input.size()) * 1032 + 1));
+    inflater{input}.inflate(output, size);
+
+    auto check = crc32{};
+    check.update(output);
+    if (output.size() != size || check.value() != crc) throw std::runtime_error("Corrupted compressed file.");
+    return output;
+}
+}
+
+
+/**
+ *  gzip files start with $1f $8b, and zip archives with the signature of a
+ *  local file header.
+ */
+constexpr bool gzip_file(span<const byte> file)
+{
+    return file.size() >= 2 && file[0] == 0x1f && file[1] == 0x8b;
+}
+
+constexpr bool zip_file(span<const byte> file)
+{
+    return file.size() >= 4 && file[0] == 0x50 && file[1] == 0x4b && file[2] == 0x03 && file[3] == 0x04;
+}
+
+
+/**
+ *  Decompresses the first member of a gzip file, as described by RFC 1952.
+ *  The size it declares, in the last four bytes of the file, is taken as
+ *  the size of the output.
+ */
+inline auto gunzip(span<const byte> file) -> std::vector<byte>
+{
+    using detail::little_endian;
+    if (!gzip_file(file) || file.size() < 18 || file[2] != 8) throw std::runtime_error("Invalid gzip file.");
+
+    const auto flags = file[3];
+    auto position = std::size_t{10};
+    if (flags & 0x04) position += 2 + little_endian(file, position, 2);
+    for (const auto text : {0x08, 0x10}) {
+        if (!(flags & text)) continue;
+        while (little_endian(file, position, 1) != 0) ++position;
+        ++position;
+    }
+    if (flags & 0x02) position += 2;
+    if (position + 8 > static_cast<std::size_t>(file.size())) throw std::runtime_error("Truncated compressed file.");
+
+    const auto size = little_endian(file, file.size() - 4, 4);
+    const auto stream = file.subspan(static_cast<std::ptrdiff_t>(position), file.size() - static_cast<std::ptrdiff_t>(position));
+
+    auto output = std::vector<byte>{};
+    output.reserve(std::min<std::size_t>(size, static_cast<std::size_t>(stream.size()) * 1032 + 1));
+    auto decoder = inflater{stream};
+    decoder.inflate(output, size);
+
+    const auto trailer = position + decoder.consumed();
+    auto check = crc32{};
+    check.update(output);
+    if (check.value() != little_endian(file, trailer, 4) || output.size() != little_endian(file, trailer + 4, 4))
+        throw std::runtime_error("Corrupted compressed file.");
+    return output;
+}
+
+
+/**
+ *  Extracts the first .nes file from a zip archive, or its only file. Files
+ *  are found through the central directory at the end of the archive, and
+ *  may be stored or deflated.
+ */
+inline auto unzip(span<const byte> file) -> std::vector<byte>
+{
+    using detail::little_endian;
+    const auto size = static_cast<std::size_t>(file.size());
+    if (size < 22) throw std::runtime_error("Invalid zip file.");
+
+    auto end = size - 22;
+    const auto earliest = size > 22 + 0xffff ? size - 22 - 0xffff : 0;
+    while (little_endian(file, end, 4) != 0x06054b50) {
+        if (end == earliest) throw std::runtime_error("Invalid zip file.");
+        --end;
+    }
+
+    const auto entries = little_endian(file, end + 10, 2);
+    auto position = std::size_t{little_endian(file, end + 16, 4)};
+    auto chosen = std::size_t{0};
+    auto found = false;
+    for (auto entry = 0u; entry < entries && !found; ++entry) {
+        if (little_endian(file, position, 4) != 0x02014b50) throw std::runtime_error("Invalid zip file.");
+        const auto name_length = little_endian(file, position + 28, 2);
+        const auto extra_length = little_endian(file, position + 30, 2);
+        const auto comment_length = little_endian(file, position + 32, 2);
+        if (position + 46 + name_length > size) throw std::runtime_error("Truncated compressed file.");
+
+        auto name = std::string_view{reinterpret_cast<const char*>(file.data() + position + 46), name_length};
+        auto extension = std::string{name.substr(name.size() < 4 ? 0 : name.size() - 4)};
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char character) {
+            return static_cast<char>(std::tolower(character));
+        });
+        if (extension == ".nes" || entries == 1) {
+            chosen = position;
+            found = true;
+        }
+        position += 46 + name_length + extra_length + comment_length;
+    }
+    if (!found) throw std::runtime_error("No ROM file in zip archive.");
+
+    const auto flags = little_endian(file, chosen + 8, 2);
+    const auto method = little_endian(file, chosen + 10, 2);
+    const auto crc = little_endian(file, chosen + 16, 4);
+    const auto compressed = little_endian(file, chosen + 20, 4);
+    const auto uncompressed = little_endian(file, chosen + 24, 4);
+    const auto local = std::size_t{little_endian(file, chosen + 42, 4)};
+    if (flags & 0x01) throw std::runtime_error("Encrypted zip files are not supported.");
+
+    if (little_endian(file, local, 4) != 0x04034b50) throw std::runtime_error("Invalid zip file.");
+    const auto data = local + 30 + little_endian(file, local + 26, 2) + little_endian(file, local + 28, 2);
+    if (data > size || size - data < compressed) throw std::runtime_error("Truncated compressed file.");
+    const auto stream = file.subspan(static_cast<std::ptrdiff_t>(data), static_cast<std::ptrdiff_t>(compressed));
+
+    if (method == 0) {
+        auto output = std::vector<byte>(stream.begin(), stream.end());
+        auto check = crc32{};
+        check.update(output);
+        if (output.size() != uncompressed || check.value() != crc) throw std::runtime_error("Corrupted compressed file.");
+        return output;
+    }
+    if (method != 8) throw std::runtime_error("Unsupported zip compression method.");
+    return detail::inflate(stream, uncompressed, crc);
+}
+}
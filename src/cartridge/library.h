@@ -0,0 +1,306 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Index of the ROM files in a directory tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "database.h"
+#include "mapped_file.h"
+#include "rom.h"
+
+namespace nes {
+namespace fs = std::filesystem;
+
+/**
+ *  What the index records of a ROM file: enough to find it by hash or by
+ *  title, and to tell what it needs, without opening it. The header fields
+ *  are those corrected by the database the library was scanned with.
+ */
+struct library_entry {
+    std::string path;
+    rom_digest digest;
+    std::uint16_t mapper;
+    std::uint8_t submapper;
+    region timing;
+    bool vertical_mirroring;
+    bool four_screen_vram;
+    bool persistent_memory;
+    std::uint32_t prg_size;
+    std::uint32_t chr_size;
+    std::uint32_t prg_ram_size;
+    std::uint32_t prg_nvram_size;
+    std::uint32_t chr_ram_size;
+    std::uint32_t chr_nvram_size;
+
+    /**
+     *  Titles are the file names without extension, and without the .nes
+     *  left over from packed files such as .nes.gz.
+     */
+    auto title() const -> std::string
+    {
+        auto name = fs::path{path}.stem();
+        if (name.extension() == ".nes" || name.extension() == ".NES") name = name.stem();
+        return name.string();
+    }
+};
+
+
+/**
+ *  A library is built once by scanning a directory tree, on all cores, and
+ *  saved as a compact binary index. Later runs load the index and find a
+ *  ROM by a binary search on its CRC or its title, instead of crawling the
+ *  tree again.
+ *
+ *  The index is little-endian: the magic "NESI" and the entry count, each
+ *  as 32 bits, followed by every entry as its CRC-32, SHA-1, mapper (16),
+ *  submapper (8), region (8), flags (8) for vertical mirroring, four-screen
+ *  VRAM and persistent memory from the lowest bit up, PRG and CHR ROM sizes
+ *  and PRG RAM, PRG NVRAM, CHR RAM and CHR NVRAM sizes (32), and the length
+ *  of its path (16) followed by the path in UTF-8.
+ */
+class rom_library {
+public:
+    rom_library() = default;
+
+    explicit rom_library(std::vector<library_entry> entries) :
+        _entries{std::move(entries)}
+    {
+        sort();
+    }
+
+    /**
+     *  Indexes the .nes files under the given directory, and those packed in
+     *  .gz or .zip files. Files are spread over the threads through a shared
+     *  counter, and each is mapped, parsed and hashed by the thread that
+     *  takes it, and identified in the database. Files that can not be read
+     *  as ROMs are left out.
+     */
+    static auto scan(const fs::path& root, const rom_database& database = rom_database{{}},
+        unsigned threads = std::thread::hardware_concurrency()) -> rom_library
+    {
+        auto paths = std::vector<fs::path>{};
+        for (const auto& file : fs::recursive_directory_iterator{root, fs::directory_options::skip_permission_denied}) {
+            if (file.is_regular_file() && rom_extension(file.path())) paths.push_back(file.path());
+        }
+
+        auto found = std::vector<std::optional<library_entry>>(paths.size());
+        auto next = std::atomic<std::size_t>{0};
+        const auto work = [&] {
+            for (auto index = next++; index < paths.size(); index = next++)
+                found[index] = index_file(paths[index], database);
+        };
+
+        auto workers = std::vector<std::thread>{};
+        for (auto worker = 1u; worker < std::max(threads, 1u); ++worker) workers.emplace_back(work);
+        work();
+        for (auto& worker : workers) worker.join();
+
+        auto entries = std::vector<library_entry>{};
+        for (auto& entry : found) {
+            if (entry) entries.push_back(std::move(*entry));
+        }
+        return rom_library{std::move(entries)};
+    }
+
+    /**
+     *  Reads an index written by save().
+     */
+    static auto load(const fs::path& index) -> rom_library
+    {
+        if (!fs::exists(index)) throw std::invalid_argument("Non-existent file.");
+        const auto file = mapped_file{index};
+        auto reader = index_reader{file.data(), file.data() + file.size()};
+
+        if (reader.take(4) != magic) throw std::runtime_error("Invalid index file.");
+        const auto count = reader.take(4);
+
+        auto entries = std::vector<library_entry>{};
+        entries.reserve(std::min<std::size_t>(count, file.size() / minimum_entry));
+        for (auto entry = 0u; entry < count; ++entry) {
+            auto result = library_entry{};
+            result.digest.crc32 = static_cast<std::uint32_t>(reader.take(4));
+            for (auto& digit : result.digest.sha1) digit = static_cast<std::uint8_t>(reader.take(1));
+            result.mapper = static_cast<std::uint16_t>(reader.take(2));
+            result.submapper = static_cast<std::uint8_t>(reader.take(1));
+            result.timing = static_cast<region>(reader.take(1) & 0x3);
+            const auto flags = reader.take(1);
+            result.vertical_mirroring = (flags & 0x01) != 0;
+            result.four_screen_vram = (flags & 0x02) != 0;
+            result.persistent_memory = (flags & 0x04) != 0;
+            result.prg_size = static_cast<std::uint32_t>(reader.take(4));
+            result.chr_size = static_cast<std::uint32_t>(reader.take(4));
+            result.prg_ram_size = static_cast<std::uint32_t>(reader.take(4));
+            result.prg_nvram_size = static_cast<std::uint32_t>(reader.take(4));
+            result.chr_ram_size = static_cast<std::uint32_t>(reader.take(4));
+            result.chr_nvram_size = static_cast<std::uint32_t>(reader.take(4));
+            result.path = reader.text(reader.take(2));
+            entries.push_back(std::move(result));
+        }
+        return rom_library{std::move(entries)};
+    }
+
+    void save(const fs::path& index) const
+    {
+        auto output = std::vector<char>{};
+        const auto put = [&](std::uint64_t value, int size) {
+            for (auto offset = 0; offset < size; ++offset) output.push_back(static_cast<char>(value >> (8 * offset)));
+        };
+
+        put(magic, 4);
+        put(_entries.size(), 4);
+        for (const auto& entry : _entries) {
+            const auto path = entry.path.substr(0, 0xffff);
+            put(entry.digest.crc32, 4);
+            for (const auto digit : entry.digest.sha1) put(digit, 1);
+            put(entry.mapper, 2);
+            put(entry.submapper, 1);
+            put(static_cast<std::uint8_t>(entry.timing), 1);
+            put(entry.vertical_mirroring | entry.four_screen_vram << 1 | entry.persistent_memory << 2, 1);
+            put(entry.prg_size, 4);
+            put(entry.chr_size, 4);
+            put(entry.prg_ram_size, 4);
+            put(entry.prg_nvram_size, 4);
+            put(entry.chr_ram_size, 4);
+            put(entry.chr_nvram_size, 4);
+            put(path.size(), 2);
+            output.insert(output.end(), path.begin(), path.end());
+        }
+
+        auto file = std::ofstream{index, std::ios::binary | std::ios::trunc};
+        if (!file.write(output.data(), static_cast<std::streamsize>(output.size()))) throw std::runtime_error("Unable to write index file.");
+    }
+
+
+    /**
+     *  Finds a ROM by the CRC-32 of its PRG and CHR ROM.
+     */
+    auto find(std::uint32_t crc) const -> const library_entry*
+    {
+        const auto found = std::lower_bound(_entries.begin(), _entries.end(), crc, [](const auto& entry, std::uint32_t key) {
+            return entry.digest.crc32 < key;
+        });
+        return found != _entries.end() && found->digest.crc32 == crc ? &*found : nullptr;
+    }
+
+    /**
+     *  Finds a ROM by its title.
+     */
+    auto find(std::string_view title) const -> const library_entry*
+    {
+        const auto found = std::lower_bound(_titles.begin(), _titles.end(), title, [](const auto& entry, std::string_view key) {
+            return entry.first < key;
+        });
+        return found != _titles.end() && found->first == title ? &_entries[found->second] : nullptr;
+    }
+
+    auto entries() const noexcept -> const std::vector<library_entry>&
+    {
+        return _entries;
+    }
+
+private:
+    static constexpr std::uint64_t magic = 0x4953454e;  // "NESI" in little-endian order
+    static constexpr std::size_t minimum_entry = 4 + 20 + 2 + 1 + 1 + 1 + 6 * 4 + 2;
+
+    /**
+     *  Bounds-checked reading of little-endian fields from the index.
+     */
+    struct index_reader {
+        const byte* position;
+        const byte* end;
+
+        auto take(int size) -> std::uint64_t
+        {
+            if (end - position < size) throw std::runtime_error("Truncated index file.");
+            auto value = std::uint64_t{0};
+            for (auto offset = 0; offset < size; ++offset) value |= std::uint64_t{*position++} << (8 * offset);
+            return value;
+        }
+
+        auto text(std::uint64_t size) -> std::string
+        {
+            if (static_cast<std::uint64_t>(end - position) < size) throw std::runtime_error("Truncated index file.");
+            auto result = std::string(static_cast<std::size_t>(size), '\0');
+            for (auto& character : result) character = static_cast<char>(std::uint8_t{*position++});
+            return result;
+        }
+    };
+
+    static bool rom_extension(const fs::path& path)
+    {
+        auto extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char character) {
+            return static_cast<char>(std::tolower(character));
+        });
+        return extension == ".nes" || extension == ".gz" || extension == ".zip";
+    }
+
+    static auto index_file(const fs::path& path, const rom_database& database) -> std::optional<library_entry>
+    {
+        try {
+            auto rom = read_rom(path);
+            const auto hashes = digest(rom);
+            if (const auto entry = database.find(hashes)) correct(rom, *entry);
+            return library_entry{
+                path.string(), hashes, rom.mapper, rom.submapper, rom.timing,
+                rom.vertical_mirroring, rom.four_screen_vram, rom.persistent_memory,
+                static_cast<std::uint32_t>(rom.prg_rom.size()), static_cast<std::uint32_t>(rom.chr_rom.size()),
+                rom.prg_ram_size, rom.prg_nvram_size, rom.chr_ram_size, rom.chr_nvram_size
+            };
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+
+    /**
+     *  Entries are sorted by CRC, and the titles are kept as a second order
+     *  over them.
+     */
+    void sort()
+    {
+        std::sort(_entries.begin(), _entries.end(), [](const auto& left, const auto& right) {
+            return left.digest.crc32 < right.digest.crc32;
+        });
+
+        _titles.clear();
+        for (auto index = std::size_t{0}; index < _entries.size(); ++index) _titles.emplace_back(_entries[index].title(), index);
+        std::sort(_titles.begin(), _titles.end());
+    }
+
+    std::vector<library_entry> _entries;
+    std::vector<std::pair<std::string, std::size_t>> _titles;
+};
+}
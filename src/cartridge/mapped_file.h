@@ -0,0 +1,141 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../byte.h"
+
+namespace nes {
+namespace fs = std::filesystem;
+
+/**
+ *  A file mapped read-only into memory. Its pages are loaded by the operating
+ *  system as they are first touched, and are shared with every other mapping
+ *  of the same file, so that opening a file costs neither a copy nor an
+ *  allocation. The mapping is kept until the object is destroyed; moving it
+ *  does not move the memory.
+ */
+class mapped_file {
+public:
+    explicit mapped_file(const fs::path& path)
+    {
+#ifdef _WIN32
+        const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::invalid_argument("Unable to open file.");
+
+        auto size = LARGE_INTEGER{};
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw std::runtime_error("Unable to determine file size.");
+        }
+        _size = static_cast<std::size_t>(size.QuadPart);
+
+        if (_size != 0) {
+            const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                _data = static_cast<const byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        const auto file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) throw std::invalid_argument("Unable to open file.");
+
+        struct stat status;
+        if (::fstat(file, &status) != 0) {
+            ::close(file);
+            throw std::runtime_error("Unable to determine file size.");
+        }
+        _size = static_cast<std::size_t>(status.st_size);
+
+        if (_size != 0) {
+            const auto mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED) _data = static_cast<const byte*>(mapping);
+        }
+        ::close(file);
+#endif
+        if (_size != 0 && _data == nullptr) throw std::runtime_error("Unable to map file into memory.");
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept :
+        _data{std::exchange(other._data, nullptr)}, _size{std::exchange(other._size, 0)}
+    {}
+
+    mapped_file& operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other) {
+            unmap();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file()
+    {
+        unmap();
+    }
+
+
+    auto data() const noexcept -> const byte*
+    {
+        return _data;
+    }
+
+    auto size() const noexcept -> std::size_t
+    {
+        return _size;
+    }
+
+private:
+    void unmap() noexcept
+    {
+        if (_data == nullptr) return;
+#ifdef _WIN32
+        UnmapViewOfFile(_data);
+#else
+        ::munmap(const_cast<byte*>(_data), _size);
+#endif
+    }
+
+    const byte* _data = nullptr;
+    std::size_t _size = 0;
+};
+}
@@ -0,0 +1,527 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Mappers: the bank switching hardware on the cartridge boards.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <variant>
+
+#include "../byte.h"
+#include "../memory/segment.h"
+#include "../memory/span.h"
+#include "../scheduler.h"
+
+namespace nes {
+/**
+ *  Nametable arrangement selected by the board or by the mapper.
+ */
+enum class mirroring : std::uint8_t {
+    horizontal,
+    vertical,
+    single_lower,
+    single_upper,
+    four_screen
+};
+
+
+/**
+ *  The windows through which the CPU sees PRG ROM, in 8 KB units at
+ *  $8000-$ffff, and the PPU sees CHR memory, in 1 KB units at $0000-$1fff.
+ *  Every window is a pointer into the ROM image, which is shared and never
+ *  written, so that switching banks only moves a pointer and never copies.
+ *  Switched PRG windows are remembered, so that the memory bus can update
+ *  the pages behind them. Windows are empty until the mapper is reset.
+ */
+class bank_table {
+public:
+    static constexpr std::size_t prg_window = 0x2000;
+    static constexpr std::size_t chr_window = 0x400;
+
+    bank_table(span<const byte> prg, span<const byte> chr) :
+        _prg_rom{prg}, _chr{chr}
+    {}
+
+    /**
+     *  Maps the given bank, counted in units of the window size, wrapping
+     *  around the end of the ROM as the unconnected high bank lines do.
+     */
+    void map_prg(std::size_t window, std::size_t bank)
+    {
+        const auto count = _prg_rom.size() / prg_window;
+        const auto begin = static_cast<std::uint32_t>(0x8000 + window * prg_window);
+        _prg_banks[window] = bank % count;
+        _prg[window] = _prg_rom.data() + _prg_banks[window] * prg_window;
+
+        const auto end = static_cast<std::uint32_t>(begin + prg_window);
+        _switched = _switched.begin == _switched.end ? address_range{begin, end}
+            : address_range{std::min(_switched.begin, begin), std::max(_switched.end, end)};
+    }
+
+    void map_chr(std::size_t window, std::size_t bank)
+    {
+        const auto count = _chr.size() / chr_window;
+        _chr_banks[window] = bank % count;
+        _chr_windows[window] = _chr.data() + _chr_banks[window] * chr_window;
+    }
+
+    /**
+     *  Larger banks map onto consecutive windows.
+     */
+    void map_prg_16k(std::size_t window, std::size_t bank)
+    {
+        map_prg(2 * window, 2 * bank);
+        map_prg(2 * window + 1, 2 * bank + 1);
+    }
+
+    void map_prg_32k(std::size_t bank)
+    {
+        map_prg_16k(0, 2 * bank);
+        map_prg_16k(1, 2 * bank + 1);
+    }
+
+    void map_chr(std::size_t window, std::size_t bank, std::size_t size)
+    {
+        const auto windows = size / chr_window;
+        for (auto offset = 0u; offset < windows; ++offset)
+            map_chr(window * windows + offset, bank * windows + offset);
+    }
+
+    constexpr auto prg_banks() const noexcept -> std::size_t
+    {
+        return _prg_rom.size() / prg_window;
+    }
+
+    constexpr auto chr_banks() const noexcept -> std::size_t
+    {
+        return _chr.size() / chr_window;
+    }
+
+    constexpr auto read_prg(word address) const noexcept -> byte
+    {
+        return _prg[(address >> 13) & 0x3][address & 0x1fff];
+    }
+
+    /**
+     *  Host memory behind the 256-byte page of PRG ROM containing the given
+     *  address.
+     */
+    constexpr auto prg_page(word address) const noexcept -> const byte*
+    {
+        return _prg[(address >> 13) & 0x3] + (address & 0x1f00);
+    }
+
+    constexpr auto prg_bank(word address) const noexcept -> std::uint32_t
+    {
+        return static_cast<std::uint32_t>(_prg_banks[(address >> 13) & 0x3]);
+    }
+
+    constexpr auto read_chr(word address) const noexcept -> byte
+    {
+        return _chr_windows[(address >> 10) & 0x7][address & 0x3ff];
+    }
+
+    /**
+     *  Offset into CHR memory of the given address, for boards that write
+     *  to their own CHR RAM through the windows.
+     */
+    constexpr auto chr_offset(word address) const noexcept -> std::size_t
+    {
+        return _chr_banks[(address >> 10) & 0x7] * chr_window + (address & 0x3ff);
+    }
+
+    /**
+     *  Returns the range of addresses whose PRG windows were switched since
+     *  the last call, which is empty if there are none.
+     */
+    constexpr auto switched() noexcept -> address_range
+    {
+        const auto result = _switched;
+        _switched = address_range{0, 0};
+        return result;
+    }
+
+    mirroring arrangement = mirroring::horizontal;
+
+private:
+    span<const byte> _prg_rom;
+    span<const byte> _chr;
+    std::array<const byte*, 4> _prg = {};
+    std::array<std::size_t, 4> _prg_banks = {};
+    std::array<const byte*, 8> _chr_windows = {};
+    std::array<std::size_t, 8> _chr_banks = {};
+    address_range _switched = {0, 0};
+};
+
+
+/**
+ *  Mapper 0: fixed 16 or 32 KB of PRG ROM and 8 KB of CHR.
+ *  A 16 KB image is mirrored into both halves by the wrapping of banks.
+ */
+struct nrom {
+    void reset(bank_table& banks)
+    {
+        banks.map_prg_32k(0);
+        banks.map_chr(0, 0, 0x2000);
+    }
+
+    void write(bank_table&, word, byte) {}
+};
+
+
+/**
+ *  Mapper 1: MMC1. Registers are loaded serially, one bit per write, and
+ *  take effect on the fifth write. Writing a byte with bit 7 set resets the
+ *  shift register and fixes the last PRG bank at $c000.
+ */
+struct mmc1 {
+    void reset(bank_table& banks)
+    {
+        _control = 0x0c;
+        apply(banks);
+    }
+
+    void write(bank_table& banks, word address, byte data)
+    {
+        if (data & 0x80) {
+            _shift = 0x10;
+            _control |= 0x0c;
+            apply(banks);
+            return;
+        }
+
+        const auto complete = _shift & 0x01;
+        _shift = (_shift >> 1) | ((data & 0x01) << 4);
+        if (!complete) return;
+
+        switch ((address >> 13) & 0x3) {
+        case 0: _control = _shift; break;
+        case 1: _chr_lower = _shift; break;
+        case 2: _chr_upper = _shift; break;
+        case 3: _prg = _shift & 0x0f; break;
+        }
+        _shift = 0x10;
+        apply(banks);
+    }
+
+private:
+    void apply(bank_table& banks)
+    {
+        constexpr mirroring arrangements[] = {
+            mirroring::single_lower, mirroring::single_upper, mirroring::vertical, mirroring::horizontal
+        };
+        banks.arrangement = arrangements[_control & 0x3];
+
+        switch ((_control >> 2) & 0x3) {
+        case 0:
+        case 1:
+            banks.map_prg_32k(_prg >> 1);
+            break;
+        case 2:
+            banks.map_prg_16k(0, 0);
+            banks.map_prg_16k(1, _prg);
+            break;
+        case 3:
+            banks.map_prg_16k(0, _prg);
+            banks.map_prg_16k(1, banks.prg_banks() / 2 - 1);
+            break;
+        }
+
+        if (_control & 0x10) {
+            banks.map_chr(0, _chr_lower, 0x1000);
+            banks.map_chr(1, _chr_upper, 0x1000);
+        } else {
+            banks.map_chr(0, _chr_lower >> 1, 0x2000);
+        }
+    }
+
+    std::uint8_t _shift = 0x10;
+    std::uint8_t _control = 0x0c;
+    std::uint8_t _chr_lower = 0;
+    std::uint8_t _chr_upper = 0;
+    std::uint8_t _prg = 0;
+};
+
+
+/**
+ *  Mapper 2: UxROM. Switches the 16 KB bank at $8000; the last bank is
+ *  fixed at $c000.
+ */
+struct uxrom {
+    void reset(bank_table& banks)
+    {
+        banks.map_prg_16k(0, 0);
+        banks.map_prg_16k(1, banks.prg_banks() / 2 - 1);
+        banks.map_chr(0, 0, 0x2000);
+    }
+
+    void write(bank_table& banks, word, byte data)
+    {
+        banks.map_prg_16k(0, data);
+    }
+};
+
+
+/**
+ *  Mapper 3: CNROM. Fixed PRG ROM, switches all 8 KB of CHR at once.
+ */
+struct cnrom {
+    void reset(bank_table& banks)
+    {
+        banks.map_prg_32k(0);
+        banks.map_chr(0, 0, 0x2000);
+    }
+
+    void write(bank_table& banks, word, byte data)
+    {
+        banks.map_chr(0, data, 0x2000);
+    }
+};
+
+
+/**
+ *  Mapper 4: MMC3. Eight bank registers, selected through $8000 and written
+ *  through $8001, map two 2 KB and four 1 KB CHR banks and two 8 KB PRG
+ *  banks; the other two PRG windows hold the last two banks.
+ *
+ *  The IRQ counter is clocked by rises of PPU address line A12, which happen
+ *  once per rendered scanline at a dot that depends on the pattern tables in
+ *  use. Rather than following the PPU address bus, the counter is given that
+ *  dot by the PPU whenever it changes, counts the rises in closed form when
+ *  caught up, and schedules the IRQ for the rise at which it reaches zero.
+ */
+struct mmc3 {
+    /**
+     *  Connects the counter to the scheduler through which it raises its IRQ.
+     */
+    void connect(scheduler& events) noexcept
+    {
+        _events = &events;
+        reschedule();
+    }
+
+    /**
+     *  Counts the rises of A12 up to the given dot. The IRQ is only predicted
+     *  again once the pending one has been delivered.
+     */
+    void catch_up(std::int64_t dot) noexcept
+    {
+        if (dot > _dot) {
+            if (_rise >= 0) clock(rises(dot) - rises(_dot));
+            _dot = dot;
+        }
+        if (_events != nullptr && _events->when(event::mapper_irq) == scheduler::never) reschedule();
+    }
+
+    /**
+     *  Sets the dot within each rendered scanline at which A12 rises, or -1
+     *  if it does not, from the given dot on.
+     */
+    void retime(std::int64_t dot, std::int64_t rise) noexcept
+    {
+        catch_up(dot);
+        if (rise == _rise) return;
+        _rise = rise;
+        reschedule();
+    }
+
+    void reset(bank_table& banks)
+    {
+        banks.map_prg(3, banks.prg_banks() - 1);
+        apply(banks);
+    }
+
+    void write(bank_table& banks, word address, byte data)
+    {
+        const auto odd = address & 0x1;
+        switch ((address >> 13) & 0x3) {
+        case 0:
+            if (odd) _registers[_select & 0x7] = data;
+            else _select = data;
+            apply(banks);
+            break;
+        case 1:
+            if (!odd && banks.arrangement != mirroring::four_screen)
+                banks.arrangement = (data & 0x1) ? mirroring::horizontal : mirroring::vertical;
+            break;
+        case 2:
+            if (odd) {
+                _counter = 0;
+                _irq_reload = true;
+            } else {
+                _irq_latch = data;
+            }
+            reschedule();
+            break;
+        case 3:
+            _irq_enabled = odd;
+            if (!_irq_enabled && _events != nullptr) _events->acknowledge(event::mapper_irq);
+            reschedule();
+            break;
+        }
+    }
+
+private:
+    static constexpr std::int64_t dots_per_cycle = 3;
+    static constexpr std::int64_t dots_per_scanline = 341;
+    static constexpr std::int64_t dots_per_frame = 262 * dots_per_scanline;
+
+    /**
+     *  A12 rises on the 240 visible scanlines and on the pre-render line.
+     */
+    static constexpr std::int64_t rises_per_frame = 241;
+    static constexpr std::int64_t prerender_line = 261;
+
+    /**
+     *  Number of rises at or before the given dot, with the current timing.
+     */
+    constexpr auto rises(std::int64_t dot) const noexcept -> std::int64_t
+    {
+        const auto position = dot % dots_per_frame;
+        const auto frames = dot / dots_per_frame * rises_per_frame;
+        if (position < _rise) return frames;
+
+        const auto line = (position - _rise) / dots_per_scanline;
+        return frames + std::min<std::int64_t>(line, 239) + 1 + (line >= prerender_line ? 1 : 0);
+    }
+
+    /**
+     *  The dot of the given rise, counting from zero.
+     */
+    constexpr auto rise(std::int64_t index) const noexcept -> std::int64_t
+    {
+        const auto within = index % rises_per_frame;
+        const auto line = within < 240 ? within : prerender_line;
+        return index / rises_per_frame * dots_per_frame + line * dots_per_scanline + _rise;
+    }
+
+    /**
+     *  Clocks the counter the given number of times. It is reloaded when
+     *  clocked at zero or after a reload request, and decremented otherwise,
+     *  so that it runs through the latch and zero periodically.
+     */
+    constexpr void clock(std::int64_t count) noexcept
+    {
+        if (count <= 0) return;
+        if (_counter == 0 || _irq_reload) {
+            _counter = _irq_latch;
+            _irq_reload = false;
+            --count;
+        }
+        if (count <= _counter) {
+            _counter = static_cast<std::uint8_t>(_counter - count);
+            return;
+        }
+        count -= _counter + 1;
+        _counter = static_cast<std::uint8_t>(_irq_latch - count % (_irq_latch + 1));
+    }
+
+    /**
+     *  Schedules the IRQ for the first CPU cycle by which the counter has
+     *  been clocked to zero, if enabled and A12 rises at all.
+     */
+    void reschedule() noexcept
+    {
+        if (_events == nullptr) return;
+        if (!_irq_enabled || _rise < 0) return _events->cancel(event::mapper_irq);
+
+        const auto clocks = (_counter == 0 || _irq_reload) ? _irq_latch + 1 : std::int64_t{_counter};
+        const auto dot = rise(rises(_dot) + clocks - 1);
+        _events->schedule(event::mapper_irq, (dot + dots_per_cycle - 1) / dots_per_cycle);
+    }
+
+    void apply(bank_table& banks)
+    {
+        const auto inverted = (_select & 0x80) ? 4u : 0u;
+        banks.map_chr(0 ^ inverted, _registers[0] & 0xfe);
+        banks.map_chr(1 ^ inverted, _registers[0] | 0x01);
+        banks.map_chr(2 ^ inverted, _registers[1] & 0xfe);
+        banks.map_chr(3 ^ inverted, _registers[1] | 0x01);
+        banks.map_chr(4 ^ inverted, _registers[2]);
+        banks.map_chr(5 ^ inverted, _registers[3]);
+        banks.map_chr(6 ^ inverted, _registers[4]);
+        banks.map_chr(7 ^ inverted, _registers[5]);
+
+        const auto second_last = banks.prg_banks() - 2;
+        const auto swapped = (_select & 0x40) != 0;
+        banks.map_prg(swapped ? 2 : 0, _registers[6]);
+        banks.map_prg(1, _registers[7]);
+        banks.map_prg(swapped ? 0 : 2, second_last);
+    }
+
+    std::uint8_t _select = 0;
+    std::array<std::uint8_t, 8> _registers = {0, 2, 4, 5, 6, 7, 0, 1};
+    std::uint8_t _irq_latch = 0;
+    std::uint8_t _counter = 0;
+    bool _irq_reload = false;
+    bool _irq_enabled = false;
+
+    scheduler* _events = nullptr;
+    std::int64_t _dot = 0;
+    std::int64_t _rise = -1;
+};
+
+
+/**
+ *  Mapper 7: AxROM. Switches all 32 KB of PRG ROM at once, and selects one
+ *  of the nametables for single-screen mirroring.
+ */
+struct axrom {
+    void reset(bank_table& banks)
+    {
+        banks.map_prg_32k(0);
+        banks.map_chr(0, 0, 0x2000);
+        banks.arrangement = mirroring::single_lower;
+    }
+
+    void write(bank_table& banks, word, byte data)
+    {
+        banks.map_prg_32k(data & 0x07);
+        banks.arrangement = (data & 0x10) ? mirroring::single_upper : mirroring::single_lower;
+    }
+};
+
+
+using mapper = std::variant<nrom, mmc1, uxrom, cnrom, mmc3, axrom>;
+
+/**
+ *  Selects the mapper for the iNES mapper number. Submappers are not told
+ *  apart yet.
+ */
+inline auto make_mapper(std::uint16_t number) -> mapper
+{
+    switch (number) {
+    case 0: return nrom{};
+    case 1: return mmc1{};
+    case 2: return uxrom{};
+    case 3: return cnrom{};
+    case 4: return mmc3{};
+    case 7: return axrom{};
+    default: throw std::runtime_error{"Unsupported mapper type: " + std::to_string(number)};
+    }
+}
+}
@@ -23,23 +23,52 @@
 #include <cstdint>
 #include <stdexcept>
 #include <filesystem>
-#include <fstream>
-#include <string_view>
+#include <limits>
+#include <memory>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "../byte.h"
+#include "../memory/span.h"
+#include "inflate.h"
+#include "mapped_file.h"
+
 namespace nes {
-namespace fs = std::experimental::filesystem;
+namespace fs = std::filesystem;
 
 /**
- *  iNES format is used.
+ *  iNES format is used, and its NES 2.0 extension where the header says so.
  *  For documentation of the header and file format, see https://wiki.nesdev.com/w/index.php/INES
+ *  and https://wiki.nesdev.com/w/index.php/NES_2.0
  */
 using prg_rom_unit = std::array<byte, 0x4000>;
 using chr_rom_unit = std::array<byte, 0x2000>;
 
+/**
+ *  The memory holding a ROM file: the file itself, mapped into memory, or a
+ *  buffer for images that are put together in memory.
+ */
+using rom_image = std::variant<std::vector<byte>, mapped_file>;
+
+/**
+ *  CPU and PPU timing the game was made for.
+ */
+enum class region : std::uint8_t {
+    ntsc,
+    pal,
+    multiple,
+    dendy
+};
+
+/**
+ *  The regions of a ROM file are views into its image, which it owns, so
+ *  that nothing is copied while loading. Moving a ROM file keeps them valid.
+ */
 struct rom_file {
-    std::uint8_t mapper;    // Currently, only 0 is supported
+    bool nes2;
+    std::uint16_t mapper;
+    std::uint8_t submapper;     // NES 2.0 only
 
     // Flags 6
     bool vertical_mirroring;
@@ -50,84 +79,163 @@ struct rom_file {
     // Flags 7
     bool vs_unisystem;
     bool playchoice;
-    
-    std::vector<byte> trainer;  // 0 or 512 bytes
-    std::vector<byte> prg_rom;  // In 16 KB units
-    std::vector<byte> chr_rom;  // In 8 KB units
-    std::vector<byte> playchoice_data; // 0 or 8 KB
+
+    // Bytes 10-12 in NES 2.0, implied by the board or byte 8 and 9 in iNES
+    std::uint32_t prg_ram_size;
+    std::uint32_t prg_nvram_size;
+    std::uint32_t chr_ram_size;
+    std::uint32_t chr_nvram_size;
+    region timing;
+
+    span<const byte> trainer;  // 0 or 512 bytes
+    span<const byte> prg_rom;  // In 16 KB units
+    span<const byte> chr_rom;  // In 8 KB units
+    span<const byte> playchoice_data; // 0 or 8 KB
+
+    rom_image image;
 };
 
+/**
+ *  ROM files are not changed once read, so that one can be shared by any
+ *  number of cartridges.
+ */
+using shared_rom = std::shared_ptr<const rom_file>;
 
 
 /**
- *  Small convenience wrappers for file reading.
+ *  iNES headers should start with the byte combination $4e $45 $53 $1a,
+ *  which is NES followed by an EOF character.
  */
-template<typename Container>
-void read(std::ifstream& file, Container& destination, std::ptrdiff_t count)
+constexpr bool valid_header(span<const byte> header)
 {
-    using value_type = typename Container::value_type;
-    std::copy_n(std::istream_iterator<value_type>{file}, count, destination.begin());
+    return header.size() >= 16 && (header[0] == 0x4E && header[1] == 0x45 && header[2] == 0x53 && header[3] == 0x1a);
 }
 
-template<typename Type>
-void read(std::ifstream& file, std::vector<Type>& destination, std::ptrdiff_t count)
+
+/**
+ *  NES 2.0 headers have bit 3 of byte 7 set and bit 2 clear.
+ */
+constexpr bool nes2_header(span<const byte> header)
 {
-    destination.reserve(count);
-    std::copy_n(std::istream_iterator<Type>{file}, count, destination.begin());
+    return (header[7] & 0x0c) == 0x08;
 }
 
-
 /**
- *  iNES headers should start with the byte combination $4e $45 $53 $1a,
- *  which is NES followed by an EOF character.
+ *  NES 2.0 ROM sizes are counted in units, unless the upper nibble is $f, in
+ *  which case the lower byte holds an exponent and multiplier: 2^E * (2M + 1)
+ *  bytes. Sizes that do not fit any file are saturated.
  */
-constexpr bool valid_header(const std::array<byte, 16>& header)
+constexpr auto rom_size(std::uint32_t lower, std::uint32_t upper, std::uint64_t unit) -> std::uint64_t
 {
-    return (header[0] == 0x4E && header[1] == 0x45 && header[2] == 0x53 && header[3] == 0x1a);
-}
+    if (upper != 0xf) return (upper << 8 | lower) * unit;
 
+    const auto exponent = lower >> 2;
+    const auto multiplier = (lower & 0x3) * 2 + 1;
+    if (exponent >= 48) return std::numeric_limits<std::uint64_t>::max();
+    return (std::uint64_t{1} << exponent) * multiplier;
+}
 
 /**
- *  Reads the iNES file header into the given ROM object.
+ *  NES 2.0 RAM sizes are given as shift counts: 64 << shift bytes, or none.
  */
-void read_header(std::ifstream& file, rom_file& result)
+constexpr auto ram_size(std::uint32_t shift) -> std::uint32_t
 {
-    std::array<byte, 16> header;
-    read(file, header, 16);
-
-    if (!valid_header(header)) throw std::runtime_error("Invalid file format or corrupted file.");
+    return shift == 0 ? 0 : std::uint32_t{64} << shift;
+}
 
-    result.vertical_mirroring = header[6].bit(0);
-    result.persistent_memory = header[6].bit(1);
-    result.trainer_present = header[6].bit(2);
-    result.four_screen_vram = header[6].bit(3);
-    result.vs_unisystem = header[7].bit(0);
-    result.playchoice = header[7].bit(1);
+static_assert(rom_size(0x02, 0x0, 0x4000) == 0x8000);
+static_assert(rom_size(0x01, 0x1, 0x2000) == 0x202000);
+static_assert(rom_size(0x4e, 0xf, 0x4000) == 0x5 << 19);
+static_assert(ram_size(7) == 0x2000);
 
-    result.mapper = (header[6] >> 4) | (header[7] & 0xf0);
 
-    result.prg_rom.resize(header[4] * 0x4000);
-    result.chr_rom.resize(header[5] * 0x2000);
+/**
+ *  Reads the iNES file header at the start of the image into the given ROM
+ *  object, and locates the regions it describes within the image.
+ *  Headers of iNES files written by old tools often have garbage, such as a
+ *  signature, in bytes 7 to 15; if bytes 12 to 15 are not clear, only the
+ *  fields of byte 6 are trusted.
+ */
+inline void read_header(span<const byte> image, rom_file& result)
+{
+    if (!valid_header(image)) throw std::runtime_error("Invalid file format or corrupted file.");
+
+    result.nes2 = nes2_header(image);
+    const auto garbage = !result.nes2 && (image[12] | image[13] | image[14] | image[15]) != 0;
+    const auto flags7 = garbage ? byte{0x00} : image[7];
+
+    result.vertical_mirroring = image[6].bit(0);
+    result.persistent_memory = image[6].bit(1);
+    result.trainer_present = image[6].bit(2);
+    result.four_screen_vram = image[6].bit(3);
+    result.vs_unisystem = flags7.bit(0);
+    result.playchoice = flags7.bit(1);
+
+    result.mapper = (image[6] >> 4) | (flags7 & 0xf0);
+    result.submapper = 0;
+
+    auto prg_size = rom_size(image[4], 0, 0x4000);
+    auto chr_size = rom_size(image[5], 0, 0x2000);
+    if (result.nes2) {
+        result.mapper |= (image[8] & 0x0f) << 8;
+        result.submapper = image[8] >> 4;
+        prg_size = rom_size(image[4], image[9] & 0x0f, 0x4000);
+        chr_size = rom_size(image[5], image[9] >> 4, 0x2000);
+        result.prg_ram_size = ram_size(image[10] & 0x0f);
+        result.prg_nvram_size = ram_size(image[10] >> 4);
+        result.chr_ram_size = ram_size(image[11] & 0x0f);
+        result.chr_nvram_size = ram_size(image[11] >> 4);
+        result.timing = static_cast<region>(image[12] & 0x03);
+    } else {
+        const auto prg_ram = (garbage || image[8] == 0 ? 1u : static_cast<std::uint32_t>(image[8])) * 0x2000;
+        result.prg_ram_size = result.persistent_memory ? 0 : prg_ram;
+        result.prg_nvram_size = result.persistent_memory ? prg_ram : 0;
+        result.chr_ram_size = chr_size == 0 ? 0x2000 : 0;
+        result.chr_nvram_size = 0;
+        result.timing = !garbage && image[9].bit(0) ? region::pal : region::ntsc;
+    }
+
+    auto offset = std::uint64_t{16};
+    const auto locate = [&](std::uint64_t size) {
+        if (image.size() - offset < size) throw std::runtime_error("Truncated ROM file.");
+        const auto found = image.subspan(static_cast<std::ptrdiff_t>(offset), static_cast<std::ptrdiff_t>(size));
+        offset += size;
+        return found;
+    };
+
+    result.trainer = result.trainer_present ? locate(0x200) : span<const byte>{};
+    result.prg_rom = locate(prg_size);
+    result.chr_rom = locate(chr_size);
+    result.playchoice_data = result.playchoice ? locate(0x2000) : span<const byte>{};
 }
 
 
 /**
- *  Reads from the file path given.
+ *  Reads a ROM file from its image, which it takes ownership of.
  */
-auto read_rom(const fs::path& path) -> rom_file
+inline auto read_rom(rom_image image) -> rom_file
 {
-    if (!fs::exists(path)) throw std::invalid_argument("Non-existent file.");
-    auto file = std::ifstream{path, std::ios::binary};
-    if (!file.is_open()) throw std::invalid_argument("Unable to open file.");
-
     rom_file result;
-    read_header(file, result);
-    
-    if (result.trainer_present) read(file, result.trainer, 0x200);
-    read(file, result.prg_rom, result.prg_rom.size());
-    read(file, result.chr_rom, result.chr_rom.size());
-    if (result.playchoice) read(file, result.playchoice_data, 0x2000);
-    
+    result.image = std::move(image);
+    const auto contents = std::visit([](const auto& storage) {
+        return span<const byte>{storage.data(), static_cast<std::ptrdiff_t>(storage.size())};
+    }, result.image);
+    read_header(contents, result);
     return result;
 }
-}
\ No newline at end of file
+
+/**
+ *  Reads from the file path given, by mapping the file into memory.
+ *  gzip and zip files, told apart by their signature, are inflated from the
+ *  mapping straight into the buffer that becomes the image.
+ */
+inline auto read_rom(const fs::path& path) -> rom_file
+{
+    if (!fs::exists(path)) throw std::invalid_argument("Non-existent file.");
+    auto file = mapped_file{path};
+    const auto contents = span<const byte>{file.data(), static_cast<std::ptrdiff_t>(file.size())};
+    if (gzip_file(contents)) return read_rom(rom_image{gunzip(contents)});
+    if (zip_file(contents)) return read_rom(rom_image{unzip(contents)});
+    return read_rom(rom_image{std::move(file)});
+}
+}
@@ -19,13 +19,50 @@
 
 #pragma once
 
+#include <utility>
+
+#include "../apu/registers.h"
+#include "../cartridge/cartridge.h"
 #include "../cpu/cpu.h"
+#include "../ppu/ppu.h"
 
 namespace nes {
-class console {
-public:
+/**
+ *  The devices connected as on the console, running a single cartridge.
+ *  The bus and the CPU refer to each other, so whichever is built first is
+ *  handed the other before its lifetime starts. The bus is built first, and
+ *  only binds its devices then; its page table, which asks them for their
+ *  memory, is built once all of them exist.
+ */
+template<typename Variant, typename Dispatch>
+struct basic_console {
+    using processor_type = basic_processor<Variant, Dispatch>;
+
+    explicit basic_console(rom_file rom) :
+        cart{std::move(rom)}, memory{cpu, ppu, apu, cart}, cpu{memory}
+    {
+        memory.remap();
+        ppu.connect(cpu.processor().events());
+        apu.connect(cpu.processor().events());
+        cart.connect(cpu.processor().events());
+        ppu.connect(cart);
+        cpu.processor().reset();
+    }
 
-    cpu _cpu;
-    //ppu _ppu;
+    basic_console(const basic_console&) = delete;
+    basic_console& operator=(const basic_console&) = delete;
+
+    auto processor() -> processor_type&
+    {
+        return cpu.processor();
+    }
+
+    nes::ppu ppu;
+    registers apu;
+    cartridge cart;
+    typename processor_type::memory memory;
+    basic_cpu<Variant, Dispatch> cpu;
 };
+
+using console = basic_console<ricoh_2a03, default_dispatch>;
 }
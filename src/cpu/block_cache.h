@@ -0,0 +1,177 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Cache of pre-decoded basic blocks of 6502 code.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../byte.h"
+
+namespace nes {
+/**
+ *  A basic block is a run of straight-line code ending in a control flow
+ *  instruction or at the end of its page. Its instructions are decoded once
+ *  into micro-ops, with their operands already read and their base cycles
+ *  summed over the block, so that executing the block needs no instruction
+ *  fetches from memory.
+ *
+ *  Blocks are keyed by their address and the bank mapped there, so that
+ *  switching banks makes other blocks visible instead of requiring a flush.
+ *  Writes invalidate all blocks in the written page by bumping its version;
+ *  stale blocks are detected and rebuilt when they are next looked up.
+ *  Blocks never cross a page boundary, so every block depends on one page only.
+ */
+template<typename Handler>
+class block_cache {
+public:
+    struct micro_op {
+        Handler handler;
+        word operand;
+        word next;
+        std::uint8_t code;
+        std::uint8_t cycles;
+        bool writes;
+    };
+
+    /**
+     *  Blocks that run often enough are translated to native code; the
+     *  translation is tagged with the code generation it was made in. The
+     *  bank a block was decoded from is kept to notice it being switched out
+     *  by the block itself. Besides its base cycles, a block records the most
+     *  it can take once page crossings and taken branches are added, so that
+     *  it is only run when every instruction in it starts within the batch.
+     */
+    struct block {
+        std::vector<micro_op> ops;
+        std::uint32_t cycles = 0;
+        std::uint32_t worst = 0;
+        std::uint32_t version = 0;
+        std::uint32_t bank = 0;
+        bool idle = false;
+        std::uint32_t executions = 0;
+        std::uint32_t generation = 0;
+        void* native = nullptr;
+    };
+
+    /**
+     *  Only code in internal RAM and cartridge space is cached. The stack page
+     *  is excluded, as pushes bypass the memory bus, and I/O registers cannot
+     *  be fetched from without side effects.
+     */
+    static constexpr bool cacheable(word address) noexcept
+    {
+        return (address < 0x2000 && (address & 0x700) != 0x100) || address >= 0x6000;
+    }
+
+    /**
+     *  Returns the up-to-date block starting at the given address, or nullptr
+     *  if it has not been decoded yet, has since been invalidated, or no block
+     *  could be decoded there.
+     */
+    auto find(word address, std::uint32_t bank) -> block*
+    {
+        const auto key = make_key(address, bank);
+        auto& entry = _lookaside[address & (lookaside_size - 1)];
+        if (entry.key != key || entry.value == nullptr) {
+            const auto found = _blocks.find(key);
+            if (found == _blocks.end()) return nullptr;
+            entry = {key, &found->second};
+        }
+        const auto valid = entry.value->version == version(address) && !entry.value->ops.empty();
+        return valid ? entry.value : nullptr;
+    }
+
+    /**
+     *  Returns an empty block for the given address, to be filled by the decoder.
+     */
+    auto insert(word address, std::uint32_t bank) -> block&
+    {
+        auto& result = _blocks[make_key(address, bank)];
+        result.ops.clear();
+        result.cycles = 0;
+        result.worst = 0;
+        result.version = version(address);
+        result.bank = bank;
+        result.idle = false;
+        result.executions = 0;
+        result.generation = 0;
+        result.native = nullptr;
+        return result;
+    }
+
+    constexpr void invalidate(word address) noexcept
+    {
+        ++_versions[page(address)];
+    }
+
+    constexpr auto version(word address) const noexcept -> std::uint32_t
+    {
+        return _versions[page(address)];
+    }
+
+    /**
+     *  Index of the version counter covering the given address.
+     */
+    static constexpr auto page(word address) noexcept -> std::uint8_t
+    {
+        return address.high() & mirror(address);
+    }
+
+    /**
+     *  Version counters by page, for code that checks them directly.
+     */
+    auto versions() noexcept -> std::uint32_t*
+    {
+        return _versions.data();
+    }
+
+private:
+    static constexpr std::size_t lookaside_size = 1024;
+
+    struct entry {
+        std::uint32_t key = 0;
+        block* value = nullptr;
+    };
+
+    static constexpr auto make_key(word address, std::uint32_t bank) noexcept -> std::uint32_t
+    {
+        return bank << 16 | address;
+    }
+
+    /**
+     *  Internal RAM is mirrored every 2 KB, so writes through one mirror must
+     *  invalidate code fetched through another: mirrors share their versions.
+     */
+    static constexpr auto mirror(word address) noexcept -> std::uint8_t
+    {
+        return address < 0x2000 ? 0x07 : 0xff;
+    }
+
+    std::unordered_map<std::uint32_t, block> _blocks;
+    std::array<entry, lookaside_size> _lookaside;
+    std::array<std::uint32_t, 256> _versions = {};
+};
+}
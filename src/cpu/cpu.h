@@ -19,9 +19,21 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
 #include "../byte.h"
+#include "../scheduler.h"
 #include "../memory/memory.h"
+#include "../memory/segment.h"
 #include "../memory/span.h"
+#include "block_cache.h"
+#include "dispatch.h"
+#include "opcode.h"
+#include "variant.h"
+#include "recompiler.h"
 
 namespace nes {
 /**
@@ -30,42 +42,57 @@ namespace nes {
  *  is set or cleared when the status register's byte value is pushed on
  *  the stack.
  *  Bit 5 is unused and not physically present, but is always considered set.
+ *
+ *  The interrupt disable and decimal flags are stored packed in a single byte,
+ *  in the same bit positions as in the pushed status byte, so that converting
+ *  to and from the byte value only takes a few mask operations.
+ *
+ *  The carry, zero, overflow and negative flags are evaluated lazily. Most
+ *  operations overwrite these flags before anything reads them, so instead of
+ *  computing them, only the result and operands of the last operation that
+ *  affected them are stored. The flag itself is derived when it is read, by a
+ *  branch, a push of the status register or a debugger.
  */
-struct status {
-    bool carry;
-    bool zero;
-    bool interrupt_disable;
-    bool decimal;
-    bool overflow;
-    bool negative;
-
-    constexpr status(byte other = byte{0x24}) :
-        carry{other.bit(0)},
-        zero{other.bit(1)},
-        interrupt_disable{other.bit(2)},
-        decimal{other.bit(3)},
-        overflow{other.bit(6)},
-        negative{other.bit(7)}
-    {}
+class status {
+public:
+    enum mask : std::uint8_t {
+        carry_mask = 0x01,
+        zero_mask = 0x02,
+        interrupt_mask = 0x04,
+        decimal_mask = 0x08,
+        break_mask = 0x10,
+        unused_mask = 0x20,
+        overflow_mask = 0x40,
+        negative_mask = 0x80
+    };
+
+    constexpr status(byte other = byte{0x24})
+    {
+        *this = other;
+    }
 
     constexpr status(int other) : status(byte{other}) {}
 
+    /**
+     *  Loading from a byte, as PLP and RTI do, ignores the break flag.
+     *  The lazily evaluated flags are given sources that evaluate to the
+     *  loaded flag values.
+     */
     constexpr auto operator=(byte other) -> status&
     {
-        carry = other.bit(0);
-        zero = other.bit(1);
-        interrupt_disable = other.bit(2);
-        decimal = other.bit(3);
-        overflow = other.bit(6);
-        negative = other.bit(7);
+        _flags = byte{(other & (interrupt_mask | decimal_mask)) | unused_mask};
+        _carry_result = word{(other & carry_mask) << 8};
+        _zero_result = byte{~other & zero_mask};
+        _negative_result = byte{other & negative_mask};
+        _addend = _augend = byte{0x00};
+        _sum = byte{(other & overflow_mask) << 1};
         return *this;
     }
 
-    constexpr auto value() const
+    constexpr auto value() const -> byte
     {
         return byte{
-            carry << 0 | zero << 1 | interrupt_disable << 2 |
-            decimal << 3 | overflow << 6 | negative << 7
+            _flags | carry() << 0 | zero() << 1 | overflow() << 6 | negative() << 7
         };
     }
 
@@ -79,12 +106,84 @@ struct status {
      */
     constexpr auto instruction_value() const -> byte
     {
-        return value().set(5).set(4);
+        return byte{value() | break_mask};
     }
 
     constexpr auto interrupt_value() const -> byte
     {
-        return value().set(5);
+        return value();
+    }
+
+
+    /**
+     *  Packed flags, read and explicitly written.
+     */
+    constexpr auto interrupt_disable() const -> bool
+    {
+        return _flags & interrupt_mask;
+    }
+
+    constexpr void interrupt_disable(bool value)
+    {
+        assign(interrupt_mask, value);
+    }
+
+    constexpr auto decimal() const -> bool
+    {
+        return _flags & decimal_mask;
+    }
+
+    constexpr void decimal(bool value)
+    {
+        assign(decimal_mask, value);
+    }
+
+
+    /**
+     *  Lazily evaluated flags, read and explicitly written.
+     *  The carry is bit 8 of the last unsigned result, the zero and negative
+     *  flags are derived from the last result byte and overflow from the
+     *  operands and result of the last addition.
+     */
+    constexpr auto carry() const -> bool
+    {
+        return _carry_result.bit(8);
+    }
+
+    constexpr void carry(bool value)
+    {
+        _carry_result = word{value << 8};
+    }
+
+    constexpr auto zero() const -> bool
+    {
+        return _zero_result == 0;
+    }
+
+    constexpr void zero(bool value)
+    {
+        _zero_result = byte{!value};
+    }
+
+    constexpr auto negative() const -> bool
+    {
+        return _negative_result.sign();
+    }
+
+    constexpr void negative(bool value)
+    {
+        _negative_result = byte{value << 7};
+    }
+
+    constexpr auto overflow() const -> bool
+    {
+        return byte{(_addend ^ _sum) & (_augend ^ _sum)}.sign();
+    }
+
+    constexpr void overflow(bool value)
+    {
+        _addend = _augend = byte{0x00};
+        _sum = byte{value << 7};
     }
 
 
@@ -93,20 +192,19 @@ struct status {
      *  Almost always, the zero flag is set if the result of an operation is
      *  zero, and the negative flag in case its bit 7 is set.
      */
-    void logical(const unsigned int result)
+    constexpr void logical(const unsigned int result)
     {
-        zero = byte{result} == 0;
-        negative = byte{result}.sign();
+        _zero_result = _negative_result = byte{result};
     }
 
     /**
      *  In addition, most arithmetic operations update the carry flag as well
-     *  as the logical flags.
+     *  as the logical flags, the carry being the ninth bit of the result.
      */
-    void arithmetic(const unsigned int result)
+    constexpr void arithmetic(const unsigned int result)
     {
         logical(result);
-        carry = result > 0xff;
+        _carry_result = word{result};
     }
 
     /**
@@ -114,28 +212,52 @@ struct status {
      *  When this happens, the overflow flag must be set, indicating that the
      *  sign of the result is incorrect with respect to the operand signs.
      */
-    void overflows(const byte left, const byte right, const unsigned int result)
+    constexpr void overflows(const byte left, const byte right, const unsigned int result)
     {
-        overflow = (left.sign() == right.sign()) && (left.sign() != byte{result}.sign());
+        _addend = left;
+        _augend = right;
+        _sum = byte{result};
     }
+
+private:
+    /**
+     *  Sets or clears the masked bits without branching.
+     */
+    constexpr void assign(std::uint8_t mask, bool value)
+    {
+        _flags = byte{(_flags & ~mask) | (-value & mask)};
+    }
+
+    byte _flags;
+    word _carry_result;
+    byte _zero_result;
+    byte _negative_result;
+    byte _addend, _augend, _sum;
 };
 
+static_assert(status{0xc3}.value() == 0xe3);
+static_assert(status{0x3c}.value() == 0x2c);
+static_assert(status{0x00}.instruction_value() == 0x30);
+
 
 
 /**
  *  Implementation of the stack with the corresponding stack pointer register.
  *  The 6502 stack is of the empty, descending kind and the pointer wraps around
  *  when overflow occurs.
+ *  Stack accesses go through the bus like any other, so that they mark the
+ *  stack page dirty and are reported to watchpoints on it.
  */
+template<typename Memory>
 class stack {
 public:
-    constexpr stack(segment_view ram, byte pointer = byte{0xff}) noexcept :
+    constexpr stack(Memory& memory, byte pointer = byte{0xff}) noexcept :
         pointer{pointer},
-        _storage{ram.subspan(word{0x100}, word{0x200})} {}
+        _memory{memory} {}
 
     constexpr void push(byte value)
     {
-        _storage[pointer] = value;
+        _memory.write(address(), value);
         pointer.decrement();
     }
 
@@ -148,7 +270,7 @@ public:
     constexpr auto pull() -> byte
     {
         pointer.increment();
-        return _storage[pointer];
+        return _memory.read(address());
     }
 
     constexpr auto pull_word()
@@ -158,32 +280,113 @@ public:
         return word{high, low};
     }
 
-    constexpr auto peek() -> byte
+    byte pointer;
+
+private:
+    constexpr auto address() const noexcept -> word
     {
-        return _storage[pointer + 1];
+        return word{byte{0x01}, pointer};
     }
 
-    byte pointer;
+    Memory& _memory;
+};
+
+
+/**
+ *  The 2 KB of internal RAM, mirrored over $0000-$1fff.
+ *  The RAM is kept apart from the processor, so that the memory map does not
+ *  depend on the processor type.
+ */
+class internal_ram {
+public:
+    using storage = segment<0x800, 0x000, 0x2000>;
+
+    constexpr auto read(word address) const -> byte
+    {
+        return _ram.read(address);
+    }
+
+    constexpr void write(word address, byte data)
+    {
+        _ram.write(address, data);
+    }
+
+    static constexpr address_range range = storage::range;
+
+    static constexpr bool contains(word address) noexcept
+    {
+        return storage::contains(address);
+    }
+
+    /**
+     *  RAM pages are plain memory, accessed directly through the page table.
+     */
+    constexpr auto read_page(word address) const noexcept -> const byte*
+    {
+        return _ram.page(address);
+    }
+
+    constexpr auto write_page(word address) noexcept -> byte*
+    {
+        return _ram.page(address);
+    }
+
+    static constexpr bool idempotent(word) noexcept
+    {
+        return true;
+    }
+
+protected:
+    constexpr auto view() -> segment_view
+    {
+        return _ram.view();
+    }
 
 private:
-    segment_view _storage;
+    storage _ram;
 };
 
+/**
+ *  The registers visible to programs, as a debugger shows them, with the
+ *  status flags evaluated.
+ */
+struct processor_state {
+    byte accumulator, x, y, stack_pointer, status;
+    word program_counter;
+
+    friend constexpr bool operator==(const processor_state& left, const processor_state& right) noexcept
+    {
+        return left.accumulator == right.accumulator && left.x == right.x && left.y == right.y
+            && left.stack_pointer == right.stack_pointer && left.status == right.status
+            && left.program_counter == right.program_counter;
+    }
+
+    friend constexpr bool operator!=(const processor_state& left, const processor_state& right) noexcept
+    {
+        return !(left == right);
+    }
+};
 
-class cpu;
 class ppu;
 class registers;
 class cartridge;
 
 /**
  *  Implementation of the processor registers with instructions and addressing modes.
+ *  The processor variant and the dispatch engine used by the interpreter are
+ *  selected through the template parameters, see variant.h and dispatch.h.
  */
-class processor {
+template<typename Variant, typename Dispatch>
+class basic_processor {
 public:
-    using memory = memory<cpu, ppu, registers, cartridge>;
-
-    constexpr processor(segment_view ram) :
-        _stack{ram},
+    using memory = nes::memory<internal_ram, ppu, registers, cartridge>;
+    using reference = typename memory::reference;
+    using pointer = typename memory::pointer;
+
+    basic_processor(memory& memory, segment_view ram) :
+        _memory{memory},
+        _ram{ram},
+        _stack{memory},
         _status{0x24},
         _accumulator{0x00},
         _x{0x00},
@@ -191,6 +394,85 @@ public:
         _program_counter{0xfffd}
     {}
 
+    /**
+     *  Execution of instructions.
+     *  step() fetches, decodes and executes a single instruction, returning the
+     *  exact number of cycles it took, including page crossing and branch
+     *  penalties. It does not deliver interrupts.
+     *  run() keeps executing until at least the given number of cycles has
+     *  elapsed, returning the number of cycles actually executed. It does so
+     *  through the block cache, executing pre-decoded basic blocks wherever
+     *  possible. run_native() does the same, but additionally translates
+     *  frequently executed blocks to native code and runs those directly,
+     *  chaining from one translated block to the next; it behaves like run()
+     *  on hosts without recompiler support. interpret() executes instruction
+     *  by instruction through the dispatch engine, bypassing the block cache.
+     *  The engine is not used by run(): blocks already call the handler that
+     *  each instruction was decoded to, one after another, and the single
+     *  instructions run() steps through in between stop after one opcode,
+     *  which leaves nothing to thread.
+     *
+     *  All three execute in batches that end at the next scheduled event, so
+     *  that no interrupt checks are needed while a batch runs. Blocks that
+     *  would cross the end of a batch are interpreted instead, so that events
+     *  are delivered at the first instruction boundary after they are due.
+     *  A device may schedule an earlier event while a batch runs, as a write
+     *  to OAMDMA does, which then ends the batch early.
+     */
+    void reset();
+    auto step() -> unsigned;
+    auto run(std::int64_t cycles) -> std::int64_t;
+    auto run_native(std::int64_t cycles) -> std::int64_t;
+    auto interpret(std::int64_t cycles) -> std::int64_t;
+
+    /**
+     *  Total number of cycles executed since power-up.
+     */
+    constexpr auto cycles() const noexcept -> std::int64_t
+    {
+        return _cycles;
+    }
+
+    /**
+     *  The registers, for debuggers and tests.
+     */
+    constexpr auto state() const -> processor_state
+    {
+        return {_accumulator, _x, _y, _stack.pointer, _status.value(), _program_counter};
+    }
+
+    /**
+     *  Interrupts are raised by scheduling events, timestamped in cycles.
+     *  IRQ lines asserted by an event stay asserted until acknowledged by
+     *  the device that raised them.
+     */
+    constexpr auto events() noexcept -> scheduler&
+    {
+        return _events;
+    }
+
+    constexpr void acknowledge(event source) noexcept
+    {
+        _irq_lines &= ~irq_line(source);
+    }
+
+    /**
+     *  Breakpoints are execute watchpoints on the bus. Code in their page is
+     *  no longer run from the block cache, but stepped, so that the watch
+     *  handler sees every instruction fetched from it.
+     */
+    void breakpoint(word address)
+    {
+        _memory.watch(address, watchpoint::execute);
+        _cache.invalidate(address);
+    }
+
+    void clear_breakpoint(word address)
+    {
+        _memory.unwatch(address, watchpoint::execute);
+        _cache.invalidate(address);
+    }
+
     /**
      *  56 supported instructions.
      *  Four operand types are possible:
@@ -206,9 +488,9 @@ public:
     void lda(byte);
     void ldx(byte);
     void ldy(byte);
-    void sta(memory::reference);
-    void stx(memory::reference);
-    void sty(memory::reference);
+    void sta(reference);
+    void stx(reference);
+    void sty(reference);
     void tax();
     void tay();
     void tsx();
@@ -218,10 +500,10 @@ public:
 
     /* Math */
     void adc(byte);
-    void dec(memory::reference);
+    void dec(reference);
     void dex();
     void dey();
-    void inc(memory::reference);
+    void inc(reference);
     void inx();
     void iny();
     void sbc(byte);
@@ -229,30 +511,30 @@ public:
     /* Bitwise */
     void and_(byte);
     void asl();
-    void asl(memory::reference);
+    void asl(reference);
     void bit(byte);
     void eor(byte);
     void lsr();
-    void lsr(memory::reference);
+    void lsr(reference);
     void ora(byte);
     void rol();
-    void rol(memory::reference);
+    void rol(reference);
     void ror();
-    void ror(memory::reference);
+    void ror(reference);
 
     /* Branch */
-    void bcc(memory::pointer);
-    void bcs(memory::pointer);
-    void beq(memory::pointer);
-    void bmi(memory::pointer);
-    void bne(memory::pointer);
-    void bpl(memory::pointer);
-    void bvc(memory::pointer);
-    void bvs(memory::pointer);
+    void bcc(pointer);
+    void bcs(pointer);
+    void beq(pointer);
+    void bmi(pointer);
+    void bne(pointer);
+    void bpl(pointer);
+    void bvc(pointer);
+    void bvs(pointer);
         
     /* Jump */
-    void jmp(memory::pointer);
-    void jsr(memory::pointer);
+    void jmp(pointer);
+    void jsr(pointer);
     void rti();
     void rts();
 
@@ -276,7 +558,8 @@ public:
 
     /* System */
     void nop() {};
-    void brk(memory::pointer vector);
+    void brk();
+    void jam();
 
 private:
     /**
@@ -285,36 +568,160 @@ private:
     void transfer(byte& from, byte& to);
     auto decrement(byte operand) -> byte;
     auto increment(byte operand) -> byte;
-    void branch(memory::pointer location);
+    void branch(pointer location);
     auto shift_left(byte operand) -> byte;
     auto shift_right(byte operand) -> byte;
     auto rotate_left(byte operand) -> byte;
     auto rotate_right(byte operand) -> byte;
     void compare(byte left, byte right);
+    void decimal_adc(byte operand);
+    void decimal_sbc(byte operand);
+
+    /**
+     *  Dispatch machinery, generated at compile time from the opcode table.
+     *  Every opcode gets its own instantiation of execute(), in which the
+     *  addressing mode and instruction are both fixed, so that dispatch
+     *  consists of direct calls only.
+     *  execute() fetches the operand bytes itself, while perform() is given
+     *  them, as pre-decoded by the block cache.
+     */
+    using decoded_handler = void (basic_processor::*)(word);
+
+    template<operation instruction, addressing mode>
+    static constexpr auto select();
+
+    template<addressing mode, bool page_penalty = false>
+    auto effective_address(word operand) -> word;
+
+    template<std::uint8_t code>
+    void execute();
+
+    template<std::uint8_t code>
+    void perform(word operand);
+
+    template<std::size_t... index>
+    static constexpr auto make_decoded_table(std::index_sequence<index...>) -> std::array<decoded_handler, 256>;
+
+    static const std::array<decoded_handler, 256> decoded_table;
+
+    void dispatch(std::uint8_t code);
+
+    auto read_zero_page(word address) -> byte;
+    auto fetch() -> byte;
+    auto fetch_word() -> word;
+
+    template<std::uint8_t length>
+    auto fetch_operand() -> word;
+
+    /**
+     *  Batched execution. run_batches() delivers due events and pending
+     *  interrupts between batches, and has the given engine execute each batch
+     *  up to its limit. While an IRQ is pending but masked, batches are single
+     *  instructions, so that the IRQ is taken as soon as it is unmasked.
+     */
+    using engine = void (basic_processor::*)(std::int64_t limit);
+
+    auto run_batches(std::int64_t cycles, engine batch) -> std::int64_t;
+    auto batch_limit(std::int64_t end) const -> std::int64_t;
+    void latch();
+    void transfer();
+    void service();
+    void interrupt(word vector);
+
+    void run_blocks(std::int64_t limit);
+    void run_native_blocks(std::int64_t limit);
+    void run_instructions(std::int64_t limit);
 
-    stack _stack;
+    /**
+     *  Block cache management.
+     */
+    using cache = block_cache<decoded_handler>;
+
+    auto decode(word address) -> typename cache::block*;
+    void execute(const typename cache::block& block);
+
+    /**
+     *  Idle loop detection. A block that branches back to its own start, and
+     *  whose every iteration reads the same values and computes the same
+     *  state, spins until an event changes what it reads: once it has run,
+     *  the iterations left before the end of the batch are skipped.
+     */
+    auto idle(word address, const typename cache::block& block) const -> bool;
+    void run_block(typename cache::block& block, std::int64_t limit);
+
+    /**
+     *  Native code management. Blocks are translated once they have executed
+     *  hot_threshold times. Translated code shares processor state through a
+     *  native_context, and calls back into the processor for bus accesses
+     *  outside internal RAM and for instructions it does not translate.
+     */
+    static constexpr std::uint32_t hot_threshold = 8;
+
+    auto watching() const -> bool;
+    auto translate(word address, typename cache::block& block) -> recompiler::native_block;
+    void load(const native_context& context);
+    void store(native_context& context);
+
+    static auto native_read(native_context* context, std::uint32_t address) -> std::uint32_t;
+    static auto native_write(native_context* context, std::uint32_t address, std::uint32_t data) -> std::uint32_t;
+    static void native_callout(native_context* context, std::uint32_t code, std::uint32_t operand);
+
+    template<bool page_penalty>
+    auto indexed(word base, byte offset) -> word;
+
+    /**
+     *  CLI, SEI and PLP change the interrupt disable flag only after the
+     *  processor has polled for IRQs, so whether an IRQ is taken right after
+     *  one of them depends on the flag as it was before.
+     */
+    void delay_poll();
+    auto irq_disabled() const -> bool;
+
+    memory& _memory;
+    segment_view _ram;
+    stack<memory> _stack;
     status _status;
     byte _accumulator;
     byte _x, _y;
     word _program_counter;
+    std::int64_t _cycles = 0;
+    scheduler _events;
+    bool _nmi = false;
+    std::uint8_t _irq_lines = 0;
+    std::int64_t _poll_delayed = -1;
+    bool _polled_disable = false;
+    cache _cache;
+    recompiler _recompiler{Variant::decimal_mode};
 };
 
 /**
- *  
+ *  The CPU consists of the processor and the internal RAM. The CPU itself is
+ *  the memory device for its RAM.
+ *  The NES uses the Ricoh 2A03, but the processor is generic enough that
+ *  other variants can be run against the same memory map.
  */
-class cpu {
+template<typename Variant, typename Dispatch>
+class basic_cpu : public internal_ram {
 public:
-    using ram = segment<0x800, 0x000, 0x2000>;
-    using memory = memory<cpu, ppu, registers, cartridge>;
+    using processor_type = basic_processor<Variant, Dispatch>;
+    using memory = typename processor_type::memory;
 
-    constexpr cpu(memory& memory) :
-        _processor{_ram.view()},
+    basic_cpu(memory& memory) :
+        internal_ram{},
+        _processor{memory, view()},
         _memory{memory}
     {}
 
+    constexpr auto processor() -> processor_type&
+    {
+        return _processor;
+    }
+
 private:
-    processor _processor;
-    ram _ram;
+    processor_type _processor;
     memory& _memory;
 };
-}
\ No newline at end of file
+
+using processor = basic_processor<ricoh_2a03, default_dispatch>;
+using cpu = basic_cpu<ricoh_2a03, default_dispatch>;
+}
@@ -0,0 +1,91 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Disassembly of single instructions, driven by the opcode table.
+ */
+
+#pragma once
+
+#include <sstream>
+#include <string>
+
+#include "../byte.h"
+#include "opcode.h"
+
+namespace nes {
+/**
+ *  Renders the instruction at the given address in conventional 6502
+ *  assembly syntax. Relative branches are shown with their destination
+ *  address rather than their offset.
+ */
+template<typename Memory>
+auto disassemble(const Memory& memory, word address) -> std::string
+{
+    const auto& decoded = opcodes[memory.read(address)];
+    const auto low = memory.read(word{address + 1});
+    const auto high = memory.read(word{address + 2});
+
+    auto result = std::ostringstream{};
+    result << decoded.mnemonic();
+
+    switch (decoded.mode) {
+    case addressing::implied:
+        break;
+    case addressing::accumulator:
+        result << " A";
+        break;
+    case addressing::immediate:
+        result << " #$" << low;
+        break;
+    case addressing::zero_page:
+        result << " $" << low;
+        break;
+    case addressing::zero_page_x:
+        result << " $" << low << ",X";
+        break;
+    case addressing::zero_page_y:
+        result << " $" << low << ",Y";
+        break;
+    case addressing::absolute:
+        result << " $" << word{high, low};
+        break;
+    case addressing::absolute_x:
+        result << " $" << word{high, low} << ",X";
+        break;
+    case addressing::absolute_y:
+        result << " $" << word{high, low} << ",Y";
+        break;
+    case addressing::indirect:
+        result << " ($" << word{high, low} << ")";
+        break;
+    case addressing::indexed_indirect:
+        result << " ($" << low << ",X)";
+        break;
+    case addressing::indirect_indexed:
+        result << " ($" << low << "),Y";
+        break;
+    case addressing::relative:
+        result << " $" << word{address + decoded.length() + low.as_signed()};
+        break;
+    }
+
+    return result.str();
+}
+}
@@ -0,0 +1,53 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Instruction dispatch engines for the interpreter.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+/**
+ *  Computed goto is a GCC extension, also supported by Clang.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define NES_COMPUTED_GOTO 1
+#else
+#define NES_COMPUTED_GOTO 0
+#endif
+
+namespace nes {
+/**
+ *  The engine is selected at compile time through the processor's template
+ *  parameter. switch_dispatch is portable: every instruction returns to a
+ *  single switch over the next opcode. threaded_dispatch ends every handler
+ *  in its own indirect jump to the next one; where computed goto is not
+ *  available, it falls back to switch dispatch. Only interpret() runs
+ *  through the engine; see basic_processor::run().
+ */
+struct switch_dispatch {};
+
+struct threaded_dispatch {
+    static constexpr bool supported = NES_COMPUTED_GOTO;
+};
+
+using default_dispatch = std::conditional_t<threaded_dispatch::supported, threaded_dispatch, switch_dispatch>;
+}
@@ -19,34 +19,59 @@
 
 #include "cpu.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "../apu/registers.h"
+#include "../cartridge/cartridge.h"
+#include "../ppu/ppu.h"
+
 namespace nes {
+constexpr bool crosses_page(word from, word to) {
+  return from.high() != to.high();
+}
+
 /**************************************************************************************************
  *  Storage
  */
-void processor::lda(byte operand) { _accumulator = operand; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::lda(byte operand) { transfer(operand, _accumulator); }
 
-void processor::ldx(byte operand) { _x = operand; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::ldx(byte operand) { transfer(operand, _x); }
 
-void processor::ldy(byte operand) { _y = operand; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::ldy(byte operand) { transfer(operand, _y); }
 
-void processor::sta(reference operand) { operand = _accumulator; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sta(reference operand) { operand = _accumulator; }
 
-void processor::stx(reference operand) { operand = _x; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::stx(reference operand) { operand = _x; }
 
-void processor::sty(reference operand) { operand = _y; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sty(reference operand) { operand = _y; }
 
-void processor::transfer(byte &from, byte &to) {
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::transfer(byte &from, byte &to) {
   to = from;
   _status.logical(to);
 }
 
-void processor::tax() { transfer(_accumulator, _x); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::tax() { transfer(_accumulator, _x); }
 
-void processor::tay() { transfer(_accumulator, _y); }
-void processor::tsx() { transfer(_stack.pointer, _x); }
-void processor::txa() { transfer(_x, _accumulator); }
-void processor::txs() { transfer(_x, _stack.pointer); }
-void processor::tya() { transfer(_y, _accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::tay() { transfer(_accumulator, _y); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::tsx() { transfer(_stack.pointer, _x); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::txa() { transfer(_x, _accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::txs() { _stack.pointer = _x; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::tya() { transfer(_y, _accumulator); }
 
 /**************************************************************************************************
  *  Math
@@ -55,12 +80,20 @@ void processor::tya() { transfer(_y, _accumulator); }
 /**
  *  Add with carry.
  *  A,Z,C,N = A + M + C
+ *  Variants with a decimal mode add in BCD when the decimal flag is set; for
+ *  others, the check is compiled out.
  */
-void processor::adc(byte operand) {
-  auto result = _accumulator + operand + _status.carry;
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::adc(byte operand) {
+  if constexpr (Variant::decimal_mode) {
+    if (_status.decimal())
+      return decimal_adc(operand);
+  }
+
+  const auto result = _accumulator + operand + _status.carry();
   _status.arithmetic(result);
   _status.overflows(_accumulator, operand, result);
-  _accumulator = result;
+  _accumulator = byte{result};
 }
 
 /**
@@ -68,30 +101,91 @@ void processor::adc(byte operand) {
  *  A,Z,C,N = A - M + C
  *  Implemented in terms of ADC
  */
-void processor::sbc(byte operand) { adc(~operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sbc(byte operand) {
+  if constexpr (Variant::decimal_mode) {
+    if (_status.decimal())
+      return decimal_sbc(operand);
+  }
+
+  adc(byte{~operand});
+}
+
+/**
+ *  Decimal addition, as performed by the NMOS 6502. Each nibble is corrected
+ *  separately. The carry is that of the corrected sum, but the zero flag is
+ *  that of the binary sum, and the negative and overflow flags are taken
+ *  from the sum before the high nibble is corrected.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::decimal_adc(byte operand) {
+  const auto carry = int{_status.carry()};
+  auto low = (_accumulator & 0x0f) + (operand & 0x0f) + carry;
+  if (low >= 0x0a)
+    low = ((low + 0x06) & 0x0f) + 0x10;
+
+  const auto sum = (_accumulator & 0xf0) + (operand & 0xf0) + low;
+  const auto signed_sum = byte{_accumulator & 0xf0}.as_signed() +
+                          byte{operand & 0xf0}.as_signed() + low;
+  const auto corrected = sum >= 0xa0 ? sum + 0x60 : sum;
+
+  _status.zero(byte{_accumulator + operand + carry} == 0);
+  _status.negative(sum & 0x80);
+  _status.overflow(signed_sum < -128 || signed_sum > 127);
+  _status.carry(corrected >= 0x100);
+  _accumulator = byte{corrected};
+}
+
+/**
+ *  Decimal subtraction, as performed by the NMOS 6502. All flags are those
+ *  of the binary subtraction; only the result is corrected per nibble.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::decimal_sbc(byte operand) {
+  auto low = (_accumulator & 0x0f) - (operand & 0x0f) + _status.carry() - 1;
+  if (low < 0)
+    low = ((low - 0x06) & 0x0f) - 0x10;
+
+  auto difference = (_accumulator & 0xf0) - (operand & 0xf0) + low;
+  if (difference < 0)
+    difference -= 0x60;
+
+  const auto binary = _accumulator + byte{~operand} + _status.carry();
+  _status.arithmetic(binary);
+  _status.overflows(_accumulator, byte{~operand}, binary);
+  _accumulator = byte{difference};
+}
 
 /**
  *  Decrement and increment
  */
-auto processor::decrement(byte operand) -> byte {
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::decrement(byte operand) -> byte {
   --operand;
   _status.logical(operand);
   return operand;
 }
 
-void processor::dec(reference operand) { operand = decrement(operand); }
-void processor::dex() { _x = decrement(_x); }
-void processor::dey() { _y = decrement(_y); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::dec(reference operand) { operand = decrement(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::dex() { _x = decrement(_x); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::dey() { _y = decrement(_y); }
 
-auto processor::increment(byte operand) -> byte {
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::increment(byte operand) -> byte {
   ++operand;
   _status.logical(operand);
   return operand;
 }
 
-void processor::inc(reference operand) { operand = increment(operand); }
-void processor::inx() { _x = increment(_x); }
-void processor::iny() { _y = increment(_y); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::inc(reference operand) { operand = increment(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::inx() { _x = increment(_x); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::iny() { _y = increment(_y); }
 
 /**************************************************************************************************
  *  Bitwise
@@ -101,7 +195,8 @@ void processor::iny() { _y = increment(_y); }
  *  Logical AND of accumulator and operand.
  *  A,Z,N = A & M
  */
-void processor::and_(byte operand) {
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::and_(byte operand) {
   _accumulator &= operand;
   _status.logical(_accumulator);
 }
@@ -110,68 +205,83 @@ void processor::and_(byte operand) {
  *  Arithmetic shift left
  *  M,Z,C,N = M << 1
  */
-auto processor::shift_left(byte operand) -> byte {
-  _status.carry = operand.bit(7);
-  operand.shift_left();
-  _status.arithmetic(operand);
-  return operand;
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::shift_left(byte operand) -> byte {
+  const auto result = operand << 1;
+  _status.arithmetic(result);
+  return byte{result};
 }
 
-void processor::asl() { _accumulator = shift_left(_accumulator); }
-void processor::asl(reference operand) { operand = shift_left(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::asl() { _accumulator = shift_left(_accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::asl(reference operand) { operand = shift_left(operand); }
 
 /**
  *  Logical shift right
  *  M,Z,C,N = M >> 1
  */
-auto processor::shift_right(byte operand) -> byte {
-  _status.carry = operand.bit(0);
-  operand.shift_right();
-  _status.arithmetic(operand);
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::shift_right(byte operand) -> byte {
+  _status.carry(operand.shift_right());
+  _status.logical(operand);
   return operand;
 }
 
-void processor::lsr() { _accumulator = shift_right(_accumulator); }
-void processor::lsr(reference operand) { operand = shift_right(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::lsr() { _accumulator = shift_right(_accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::lsr(reference operand) { operand = shift_right(operand); }
 
 /**
  *  Rotate left
  *  M,C,Z,N = M << 1, C
  */
-auto processor::rotate_left(byte operand) -> byte {
-  operand.rotate_left(_status.carry);
-  _status.logical(operand);
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::rotate_left(byte operand) -> byte {
+  const auto result = operand << 1 | _status.carry();
+  _status.arithmetic(result);
+  return byte{result};
 }
 
-void processor::rol() { _accumulator = rotate_left(_accumulator); }
-void processor::rol(reference operand) { operand = rotate_left(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::rol() { _accumulator = rotate_left(_accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::rol(reference operand) { operand = rotate_left(operand); }
 
 /**
  *  Rotate right
  *  M,C,Z,N = M >> 1, C
  */
-auto processor::rotate_right(byte operand) -> byte {
-  operand.rotate_right(_status.carry);
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::rotate_right(byte operand) -> byte {
+  const auto carry = operand.shift_right(_status.carry());
+  _status.carry(carry);
   _status.logical(operand);
+  return operand;
 }
 
-void processor::ror() { _accumulator = rotate_right(_accumulator); }
-void processor::ror(reference operand) { operand = rotate_right(operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::ror() { _accumulator = rotate_right(_accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::ror(reference operand) { operand = rotate_right(operand); }
 
 /**
  *  Bit test
  */
-void processor::bit(byte operand) {
-  _status.zero = (_accumulator & operand == 0);
-  _status.overflow = operand.bit(6);
-  _status.negative = operand.bit(7);
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bit(byte operand) {
+  _status.zero((_accumulator & operand) == 0);
+  _status.overflow(operand.bit(6));
+  _status.negative(operand.bit(7));
 }
 
 /**
  *  Exclusive OR
  *  A,Z,N = A^M
  */
-void processor::eor(byte operand) {
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::eor(byte operand) {
   _accumulator ^= operand;
   _status.logical(_accumulator);
 }
@@ -180,7 +290,8 @@ void processor::eor(byte operand) {
  * Logical inclusive OR
  *  A,Z,N = A|M
  */
-void processor::ora(byte operand) {
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::ora(byte operand) {
   _accumulator |= operand;
   _status.logical(_accumulator);
 }
@@ -188,96 +299,1103 @@ void processor::ora(byte operand) {
 /**************************************************************************************************
  *  Branch
  */
-void processor::branch(pointer location) { _program_counter = location; }
 
-void processor::bcs(pointer location) {
-  if (_status.carry)
+/**
+ *  A taken branch costs an extra cycle, and another one if the destination
+ *  lies in a different page than the next instruction.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::branch(pointer location) {
+  _cycles += 1 + crosses_page(_program_counter, location);
+  _program_counter = location;
+}
+
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bcs(pointer location) {
+  if (_status.carry())
     branch(location);
 }
-void processor::bcc(pointer location) {
-  if (!_status.carry)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bcc(pointer location) {
+  if (!_status.carry())
     branch(location);
 }
-void processor::beq(pointer location) {
-  if (_status.zero)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::beq(pointer location) {
+  if (_status.zero())
     branch(location);
 }
-void processor::bne(pointer location) {
-  if (!_status.zero)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bne(pointer location) {
+  if (!_status.zero())
     branch(location);
 }
-void processor::bmi(pointer location) {
-  if (_status.negative)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bmi(pointer location) {
+  if (_status.negative())
     branch(location);
 }
-void processor::bpl(pointer location) {
-  if (!_status.negative)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bpl(pointer location) {
+  if (!_status.negative())
     branch(location);
 }
-void processor::bvs(pointer location) {
-  if (_status.overflow)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bvs(pointer location) {
+  if (_status.overflow())
     branch(location);
 }
-void processor::bvc(pointer location) {
-  if (!_status.overflow)
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::bvc(pointer location) {
+  if (!_status.overflow())
     branch(location);
 }
 
 /**************************************************************************************************
  *  Jump
  */
-void processor::jmp(pointer location) { branch(location); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::jmp(pointer location) { _program_counter = location; }
 
-void processor::jsr(pointer location) {
-  _stack.push(_program_counter - 1);
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::jsr(pointer location) {
+  _stack.push(word{_program_counter - 1});
   _program_counter = location;
 }
 
-void processor::rti() {
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::rti() {
   _status = _stack.pull();
   _program_counter = _stack.pull_word();
 }
 
-void processor::rts() { _program_counter = _stack.pull_word() + 1; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::rts() { _program_counter = word{_stack.pull_word() + 1}; }
 
 /**************************************************************************************************
  *  Registers
  */
-void processor::clc() { _status.carry = false; }
-void processor::sec() { _status.carry = true; }
-void processor::cld() { _status.decimal = false; }
-void processor::sed() { _status.decimal = true; }
-void processor::cli() { _status.interrupt_disable = false; }
-void processor::sei() { _status.interrupt_disable = true; }
-void processor::clv() { _status.overflow = false; }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::clc() { _status.carry(false); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sec() { _status.carry(true); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::cld() { _status.decimal(false); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sed() { _status.decimal(true); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::cli() {
+  delay_poll();
+  _status.interrupt_disable(false);
+}
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::sei() {
+  delay_poll();
+  _status.interrupt_disable(true);
+}
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::clv() { _status.overflow(false); }
 
-void processor::compare(byte left, byte right) {
-  const auto result = left - right;
-  _status.logical(result);
-  _status.carry = left > right;
+/**
+ *  Comparison subtracts through addition of the complement, so that the
+ *  carry out is set exactly when no borrow occurs.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::compare(byte left, byte right) {
+  _status.arithmetic(left + byte{~right} + 1);
 }
 
-void processor::cmp(byte operand) { compare(_accumulator, operand); }
-void processor::cpx(byte operand) { compare(_x, operand); }
-void processor::cpy(byte operand) { compare(_y, operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::cmp(byte operand) { compare(_accumulator, operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::cpx(byte operand) { compare(_x, operand); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::cpy(byte operand) { compare(_y, operand); }
 
 /**************************************************************************************************
  *  Stack
  */
-void processor::pha() { _stack.push(_accumulator); }
-void processor::php() { _stack.push(_status.instruction_value();
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::pha() { _stack.push(_accumulator); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::php() { _stack.push(_status.instruction_value()); }
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::pla() {
+  _accumulator = _stack.pull();
+  _status.logical(_accumulator);
+}
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::plp() {
+  delay_poll();
+  _status = _stack.pull();
 }
-void processor::pla() { _accumulator = _stack.pull(); }
-void processor::plp() { _status = _stack.pull(); }
 
 /**************************************************************************************************
  *  System
  */
-void processor::brk(
-    reference vector) // Vector is generally located at 0xfffe, the IRQ vector
-{
-  _stack.push(_program_counter);
+
+/**
+ *  Break shares the IRQ vector at $fffe. The byte following the opcode is
+ *  skipped, so the return address pushed is that of the opcode plus two.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::brk() {
+  _stack.push(word{_program_counter + 1});
   _stack.push(_status.instruction_value());
-  _program_counter = vector;
+  _status.interrupt_disable(true);
+  _program_counter = _memory.access(word{0xfffe});
+}
+
+/**
+ *  Unofficial opcodes other than the no-ops are not supported.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::jam() {
+  throw std::runtime_error{"Unsupported opcode at address: " +
+                           std::to_string(_program_counter - 1)};
+}
+
+/**************************************************************************************************
+ *  Addressing modes
+ */
+template <typename Variant, typename Dispatch>
+template <bool page_penalty>
+auto basic_processor<Variant, Dispatch>::indexed(word base, byte offset) -> word {
+  const auto address = word{base + offset};
+  if constexpr (page_penalty)
+    _cycles += crosses_page(base, address);
+  return address;
+}
+
+/**
+ *  Zero page addresses always lie in internal RAM, so reads from them are
+ *  decoded at compile time.
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::read_zero_page(word address) -> byte {
+  return _memory.template read_within<0x0000, 0x0100>(address);
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::fetch() -> byte {
+  const auto result = _memory.read(_program_counter);
+  _program_counter.increment();
+  return result;
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::fetch_word() -> word {
+  const auto result = _memory.read_word(_program_counter);
+  _program_counter.increment(2);
+  return result;
+}
+
+/**
+ *  Fetches the operand bytes following the opcode.
+ */
+template <typename Variant, typename Dispatch>
+template <std::uint8_t length> auto basic_processor<Variant, Dispatch>::fetch_operand() -> word {
+  if constexpr (length == 0)
+    return word{0x0000};
+  else if constexpr (length == 1)
+    return word{fetch()};
+  else
+    return fetch_word();
+}
+
+/**
+ *  Computes the effective address of the operand from the operand bytes
+ *  following the opcode.
+ *  Zero page indexing wraps within the zero page, as does the pointer read by
+ *  the indirect zero page modes. Indirect jumps do not carry into the high
+ *  byte when the pointer lies at the end of a page. Relative addresses are
+ *  taken relative to the next instruction.
+ *  If the instruction is subject to a page crossing penalty, indexing into
+ *  the next page costs an extra cycle.
+ */
+template <typename Variant, typename Dispatch>
+template <addressing mode, bool page_penalty>
+auto basic_processor<Variant, Dispatch>::effective_address(word operand) -> word {
+  if constexpr (mode == addressing::zero_page) {
+    return operand;
+  } else if constexpr (mode == addressing::zero_page_x) {
+    return word{byte{operand + _x}};
+  } else if constexpr (mode == addressing::zero_page_y) {
+    return word{byte{operand + _y}};
+  } else if constexpr (mode == addressing::absolute) {
+    return operand;
+  } else if constexpr (mode == addressing::absolute_x) {
+    return indexed<page_penalty>(operand, _x);
+  } else if constexpr (mode == addressing::absolute_y) {
+    return indexed<page_penalty>(operand, _y);
+  } else if constexpr (mode == addressing::indirect) {
+    return _memory.read_word_wrapped(operand);
+  } else if constexpr (mode == addressing::indexed_indirect) {
+    return _memory.read_word_wrapped(word{byte{operand + _x}});
+  } else if constexpr (mode == addressing::indirect_indexed) {
+    return indexed<page_penalty>(_memory.read_word_wrapped(operand), _y);
+  } else if constexpr (mode == addressing::relative) {
+    return word{_program_counter + operand.low().as_signed()};
+  } else {
+    static_assert(mode != mode, "Addressing mode has no effective address");
+  }
+}
+
+/**************************************************************************************************
+ *  Dispatch
+ */
+
+/**
+ *  The shifts and rotates are overloaded on accumulator and memory operands.
+ */
+template <typename Processor, addressing mode>
+using shift =
+    std::conditional_t<mode == addressing::accumulator,
+                       void (Processor::*)(),
+                       void (Processor::*)(typename Processor::reference)>;
+
+/**
+ *  Maps an operation onto the member function implementing it.
+ */
+template <typename Variant, typename Dispatch>
+template <operation instruction, addressing mode>
+constexpr auto basic_processor<Variant, Dispatch>::select() {
+  if constexpr (instruction == operation::adc)
+    return &basic_processor::adc;
+  else if constexpr (instruction == operation::and_)
+    return &basic_processor::and_;
+  else if constexpr (instruction == operation::asl)
+    return static_cast<shift<basic_processor, mode>>(&basic_processor::asl);
+  else if constexpr (instruction == operation::bcc)
+    return &basic_processor::bcc;
+  else if constexpr (instruction == operation::bcs)
+    return &basic_processor::bcs;
+  else if constexpr (instruction == operation::beq)
+    return &basic_processor::beq;
+  else if constexpr (instruction == operation::bit)
+    return &basic_processor::bit;
+  else if constexpr (instruction == operation::bmi)
+    return &basic_processor::bmi;
+  else if constexpr (instruction == operation::bne)
+    return &basic_processor::bne;
+  else if constexpr (instruction == operation::bpl)
+    return &basic_processor::bpl;
+  else if constexpr (instruction == operation::brk)
+    return &basic_processor::brk;
+  else if constexpr (instruction == operation::bvc)
+    return &basic_processor::bvc;
+  else if constexpr (instruction == operation::bvs)
+    return &basic_processor::bvs;
+  else if constexpr (instruction == operation::clc)
+    return &basic_processor::clc;
+  else if constexpr (instruction == operation::cld)
+    return &basic_processor::cld;
+  else if constexpr (instruction == operation::cli)
+    return &basic_processor::cli;
+  else if constexpr (instruction == operation::clv)
+    return &basic_processor::clv;
+  else if constexpr (instruction == operation::cmp)
+    return &basic_processor::cmp;
+  else if constexpr (instruction == operation::cpx)
+    return &basic_processor::cpx;
+  else if constexpr (instruction == operation::cpy)
+    return &basic_processor::cpy;
+  else if constexpr (instruction == operation::dec)
+    return &basic_processor::dec;
+  else if constexpr (instruction == operation::dex)
+    return &basic_processor::dex;
+  else if constexpr (instruction == operation::dey)
+    return &basic_processor::dey;
+  else if constexpr (instruction == operation::eor)
+    return &basic_processor::eor;
+  else if constexpr (instruction == operation::inc)
+    return &basic_processor::inc;
+  else if constexpr (instruction == operation::inx)
+    return &basic_processor::inx;
+  else if constexpr (instruction == operation::iny)
+    return &basic_processor::iny;
+  else if constexpr (instruction == operation::jmp)
+    return &basic_processor::jmp;
+  else if constexpr (instruction == operation::jsr)
+    return &basic_processor::jsr;
+  else if constexpr (instruction == operation::lda)
+    return &basic_processor::lda;
+  else if constexpr (instruction == operation::ldx)
+    return &basic_processor::ldx;
+  else if constexpr (instruction == operation::ldy)
+    return &basic_processor::ldy;
+  else if constexpr (instruction == operation::lsr)
+    return static_cast<shift<basic_processor, mode>>(&basic_processor::lsr);
+  else if constexpr (instruction == operation::nop)
+    return &basic_processor::nop;
+  else if constexpr (instruction == operation::ora)
+    return &basic_processor::ora;
+  else if constexpr (instruction == operation::pha)
+    return &basic_processor::pha;
+  else if constexpr (instruction == operation::php)
+    return &basic_processor::php;
+  else if constexpr (instruction == operation::pla)
+    return &basic_processor::pla;
+  else if constexpr (instruction == operation::plp)
+    return &basic_processor::plp;
+  else if constexpr (instruction == operation::rol)
+    return static_cast<shift<basic_processor, mode>>(&basic_processor::rol);
+  else if constexpr (instruction == operation::ror)
+    return static_cast<shift<basic_processor, mode>>(&basic_processor::ror);
+  else if constexpr (instruction == operation::rti)
+    return &basic_processor::rti;
+  else if constexpr (instruction == operation::rts)
+    return &basic_processor::rts;
+  else if constexpr (instruction == operation::sbc)
+    return &basic_processor::sbc;
+  else if constexpr (instruction == operation::sec)
+    return &basic_processor::sec;
+  else if constexpr (instruction == operation::sed)
+    return &basic_processor::sed;
+  else if constexpr (instruction == operation::sei)
+    return &basic_processor::sei;
+  else if constexpr (instruction == operation::sta)
+    return &basic_processor::sta;
+  else if constexpr (instruction == operation::stx)
+    return &basic_processor::stx;
+  else if constexpr (instruction == operation::sty)
+    return &basic_processor::sty;
+  else if constexpr (instruction == operation::tax)
+    return &basic_processor::tax;
+  else if constexpr (instruction == operation::tay)
+    return &basic_processor::tay;
+  else if constexpr (instruction == operation::tsx)
+    return &basic_processor::tsx;
+  else if constexpr (instruction == operation::txa)
+    return &basic_processor::txa;
+  else if constexpr (instruction == operation::txs)
+    return &basic_processor::txs;
+  else if constexpr (instruction == operation::tya)
+    return &basic_processor::tya;
+  else if constexpr (instruction == operation::jam)
+    return &basic_processor::jam;
+}
+
+template <typename> struct operand_type;
+template <typename Processor> struct operand_type<void (Processor::*)()> {
+  using type = void;
+};
+template <typename Processor, typename Operand>
+struct operand_type<void (Processor::*)(Operand)> {
+  using type = Operand;
+};
+
+/**
+ *  Executes a single instruction, with the opcode already fetched.
+ */
+template <typename Variant, typename Dispatch>
+template <std::uint8_t code> void basic_processor<Variant, Dispatch>::execute() {
+  perform<code>(fetch_operand<operand_length(opcodes[code].mode)>());
+}
+
+/**
+ *  Performs a single instruction, given its operand bytes, with the program
+ *  counter already pointing to the next instruction.
+ *  The operand is passed in the form the instruction expects: as value,
+ *  reference or pointer. Immediate operands are passed by value directly.
+ *  Instructions that take no operand ignore it, as the unofficial no-ops do.
+ *  Writes are reported to the block cache, which invalidates any code
+ *  decoded from the written page.
+ */
+template <typename Variant, typename Dispatch>
+template <std::uint8_t code> void basic_processor<Variant, Dispatch>::perform(word operand) {
+  constexpr auto mode = opcodes[code].mode;
+  constexpr auto page_penalty = opcodes[code].extra == penalty::page_cross;
+  constexpr auto function = select<opcodes[code].instruction, mode>();
+  using argument =
+      typename operand_type<std::remove_const_t<decltype(function)>>::type;
+
+  if constexpr (std::is_void_v<argument>) {
+    // The indexed no-ops still take the page crossing penalty.
+    if constexpr (page_penalty)
+      effective_address<mode, page_penalty>(operand);
+    (this->*function)();
+  } else if constexpr (mode == addressing::immediate) {
+    (this->*function)(operand.low());
+  } else {
+    const auto address = effective_address<mode, page_penalty>(operand);
+    if constexpr (std::is_same_v<argument, byte> && zero_page(mode)) {
+      (this->*function)(read_zero_page(address));
+    } else if constexpr (std::is_same_v<argument, byte>) {
+      (this->*function)(_memory.read(address));
+    } else if constexpr (std::is_same_v<argument, reference>) {
+      _cache.invalidate(address);
+      (this->*function)(reference{_memory, address});
+    } else {
+      (this->*function)(pointer{_memory, address});
+    }
+  }
+}
+
+template <typename Variant, typename Dispatch>
+template <std::size_t... index>
+constexpr auto
+basic_processor<Variant, Dispatch>::make_decoded_table(std::index_sequence<index...>)
+    -> std::array<decoded_handler, 256> {
+  return {&basic_processor::perform<index>...};
 }
+
+template <typename Variant, typename Dispatch>
+const std::array<typename basic_processor<Variant, Dispatch>::decoded_handler, 256>
+    basic_processor<Variant, Dispatch>::decoded_table =
+        make_decoded_table(std::make_index_sequence<256>{});
+
+/**
+ *  Expands M(high, low) for every opcode, given as its two hexadecimal
+ *  digits, so that both the opcode and a label name can be formed from them.
+ */
+#define NES_OPCODE_ROW(M, high)                                                \
+  M(high, 0) M(high, 1) M(high, 2) M(high, 3) M(high, 4) M(high, 5)            \
+  M(high, 6) M(high, 7) M(high, 8) M(high, 9) M(high, a) M(high, b)            \
+  M(high, c) M(high, d) M(high, e) M(high, f)
+#define NES_OPCODES(M)                                                         \
+  NES_OPCODE_ROW(M, 0) NES_OPCODE_ROW(M, 1) NES_OPCODE_ROW(M, 2)               \
+  NES_OPCODE_ROW(M, 3) NES_OPCODE_ROW(M, 4) NES_OPCODE_ROW(M, 5)               \
+  NES_OPCODE_ROW(M, 6) NES_OPCODE_ROW(M, 7) NES_OPCODE_ROW(M, 8)               \
+  NES_OPCODE_ROW(M, 9) NES_OPCODE_ROW(M, a) NES_OPCODE_ROW(M, b)               \
+  NES_OPCODE_ROW(M, c) NES_OPCODE_ROW(M, d) NES_OPCODE_ROW(M, e)               \
+  NES_OPCODE_ROW(M, f)
+
+/**
+ *  Portable dispatch: a switch over all opcodes, which compilers lower to a
+ *  single jump table shared by all instructions.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::dispatch(std::uint8_t code) {
+#define NES_SWITCH_CASE(high, low)                                             \
+  case 0x##high##low:                                                          \
+    execute<0x##high##low>();                                                  \
+    break;
+
+  switch (code) { NES_OPCODES(NES_SWITCH_CASE) }
+
+#undef NES_SWITCH_CASE
+}
+
+/**
+ *  The program counter is loaded from the reset vector at $fffc.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::reset() {
+  _memory.clock(_cycles);
+  _program_counter = _memory.access(word{0xfffc});
+  _status.interrupt_disable(true);
+  _stack.pointer = byte{0xfd};
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::step() -> unsigned {
+  const auto start = _cycles;
+  const auto address = _program_counter;
+  const auto opcode = fetch();
+  if (_memory.watching(address, watchpoint::execute))
+    _memory.notify(watchpoint::execute, address, opcode);
+  _cycles += opcodes[opcode].cycles;
+  dispatch(opcode);
+  return static_cast<unsigned>(_cycles - start);
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::run(std::int64_t cycles)
+    -> std::int64_t {
+  return run_batches(cycles, &basic_processor::run_blocks);
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::run_native(std::int64_t cycles)
+    -> std::int64_t {
+  return run_batches(cycles, &basic_processor::run_native_blocks);
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::interpret(std::int64_t cycles)
+    -> std::int64_t {
+  return run_batches(cycles, &basic_processor::run_instructions);
+}
+
+/**************************************************************************************************
+ *  Interrupts
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::run_batches(std::int64_t cycles,
+                                                     engine batch)
+    -> std::int64_t {
+  const auto start = _cycles;
+  const auto end = start + cycles;
+  while (_cycles < end) {
+    service();
+    (this->*batch)(batch_limit(end));
+  }
+  latch();
+  return _cycles - start;
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::batch_limit(std::int64_t end) const
+    -> std::int64_t {
+  if (_irq_lines != 0)
+    return _cycles + 1;
+  return std::min(end, _events.next());
+}
+
+/**
+ *  Latches all events that have come due into the NMI and IRQ lines, so that
+ *  they are not lost when a device schedules them again before they have
+ *  been taken, and catches the devices up so that they can do so.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::latch() {
+  _irq_lines &= ~_events.acknowledged();
+  while (_events.next() <= _cycles) {
+    const auto due = _events.pop();
+    if (due == event::vblank_nmi)
+      _nmi = true;
+    else if (due == event::oam_dma)
+      transfer();
+    else if (due != event::synchronize)
+      _irq_lines |= irq_line(due);
+    _memory.synchronize(_cycles);
+  }
+}
+
+/**
+ *  OAM DMA copies the requested page to OAM as a single block, stalling the
+ *  processor for 513 cycles, or 514 when it starts on an odd cycle.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::transfer() {
+  auto buffer = std::array<byte, 0x100>{};
+  _memory.read_block(_memory.template device<registers>().dma_page(), buffer);
+  _memory.template device<ppu>().write_oam(buffer);
+  _cycles += 513 + (_cycles & 1);
+}
+
+/**
+ *  Takes the NMI if one was raised, or the IRQ if any line is asserted and
+ *  IRQs are not disabled.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::service() {
+  latch();
+  if (_nmi) {
+    _nmi = false;
+    interrupt(word{0xfffa});
+  } else if (_irq_lines != 0 && !irq_disabled()) {
+    interrupt(word{0xfffe});
+  }
+}
+
+/**
+ *  Every instruction takes at least two cycles, so the poll directly after
+ *  CLI, SEI or PLP is the only one at the cycle they ended.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::delay_poll() {
+  _poll_delayed = _cycles;
+  _polled_disable = _status.interrupt_disable();
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::irq_disabled() const -> bool {
+  return _cycles == _poll_delayed ? _polled_disable : _status.interrupt_disable();
+}
+
+/**
+ *  Interrupts push the program counter and the status with the break flag
+ *  clear, and disable further IRQs, taking 7 cycles like BRK.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::interrupt(word vector) {
+  _stack.push(_program_counter);
+  _stack.push(_status.interrupt_value());
+  _status.interrupt_disable(true);
+  _program_counter = _memory.access(vector);
+  _cycles += 7;
+}
+
+/**************************************************************************************************
+ *  Execution engines
+ */
+
+/**
+ *  Direct-threaded dispatch: every handler ends in its own indirect jump to
+ *  the next handler, through a table of label addresses, so that the branch
+ *  predictor learns the successors of each opcode separately. The switch
+ *  engine simply steps through the instructions instead, as does the
+ *  threaded engine while breakpoints are set.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::run_instructions(std::int64_t limit) {
+#if NES_COMPUTED_GOTO
+  if constexpr (std::is_same_v<Dispatch, threaded_dispatch>) {
+    if (!_memory.watching(watchpoint::execute)) {
+#define NES_LABEL_ADDRESS(high, low) &&opcode_##high##low,
+#define NES_NEXT                                                               \
+  if (_cycles >= limit || _cycles >= _events.next())                           \
+    return;                                                                    \
+  code = fetch();                                                              \
+  _cycles += opcodes[code].cycles;                                             \
+  goto *labels[code];
+#define NES_THREADED_HANDLER(high, low)                                        \
+  opcode_##high##low : execute<0x##high##low>();                               \
+  NES_NEXT
+
+      static void *const labels[256] = {NES_OPCODES(NES_LABEL_ADDRESS)};
+      auto code = std::uint8_t{};
+      NES_NEXT
+      NES_OPCODES(NES_THREADED_HANDLER)
+
+#undef NES_THREADED_HANDLER
+#undef NES_NEXT
+#undef NES_LABEL_ADDRESS
+    }
+  }
+#endif
+
+  while (_cycles < std::min(limit, _events.next()))
+    step();
+}
+
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::run_blocks(std::int64_t limit) {
+  while (_cycles < (limit = std::min(limit, _events.next()))) {
+    auto block = _cache.find(_program_counter, _memory.bank(_program_counter));
+    if (block == nullptr)
+      block = decode(_program_counter);
+
+    if (block != nullptr && _cycles + block->worst <= limit)
+      run_block(*block, limit);
+    else
+      step();
+  }
+}
+
+/**************************************************************************************************
+ *  Block cache
+ */
+
+/**
+ *  Control flow instructions end a basic block.
+ */
+constexpr bool ends_block(const opcode &decoded) {
+  switch (decoded.instruction) {
+  case operation::brk:
+  case operation::jam:
+  case operation::jmp:
+  case operation::jsr:
+  case operation::rti:
+  case operation::rts:
+    return true;
+  default:
+    return decoded.mode == addressing::relative;
+  }
+}
+
+/**
+ *  Instructions operating on a memory reference write to memory, and so
+ *  may invalidate the block they are part of.
+ */
+constexpr bool writes_memory(const opcode &decoded) {
+  switch (decoded.instruction) {
+  case operation::sta:
+  case operation::stx:
+  case operation::sty:
+  case operation::inc:
+  case operation::dec:
+  case operation::asl:
+  case operation::lsr:
+  case operation::rol:
+  case operation::ror:
+    return decoded.mode != addressing::accumulator;
+  default:
+    return false;
+  }
+}
+
+/**
+ *  The most cycles an instruction can take beyond its base cycles: one for
+ *  indexing across a page, two for a branch taken across one.
+ */
+constexpr auto worst_penalty(const opcode &decoded) -> std::uint8_t {
+  switch (decoded.extra) {
+  case penalty::page_cross:
+    return 1;
+  case penalty::branch:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+/**
+ *  Decodes the basic block starting at the given address into the cache.
+ *  Decoding stops after a control flow instruction, or before an instruction
+ *  that does not fit in the remainder of the page. Returns nullptr if no
+ *  block can be formed there, in which case the instruction is interpreted.
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::decode(word address) -> typename cache::block * {
+  if (!cache::cacheable(address) || _memory.watching(address, watchpoint::execute))
+    return nullptr;
+
+  auto &block = _cache.insert(address, _memory.bank(address));
+  const auto block_start = address;
+  const auto page = address.high();
+  while (true) {
+    const auto code = _memory.peek(address);
+    const auto &decoded = opcodes[code];
+    const auto next = word{address + decoded.length()};
+    if (next.high() != page && next.low() != 0)
+      break;
+
+    auto operand = word{0x0000};
+    if (decoded.length() > 1)
+      operand = word{_memory.peek(word{address + 1})};
+    if (decoded.length() > 2)
+      operand = word{_memory.peek(word{address + 2}), operand.low()};
+
+    block.ops.push_back({decoded_table[code], operand, next, code,
+                         decoded.cycles, writes_memory(decoded)});
+    block.cycles += decoded.cycles;
+    block.worst += decoded.cycles + worst_penalty(decoded);
+    address = next;
+
+    if (ends_block(decoded) || next.high() != page)
+      break;
+  }
+
+  if (block.ops.empty())
+    return nullptr;
+  block.idle = idle(block_start, block);
+  return &block;
+}
+
+/**
+ *  Executes a pre-decoded block. Cycles are accounted for per micro-op, as
+ *  when stepping, so that devices caught up during the block see the time
+ *  of the access. Should a write invalidate the block or switch its bank
+ *  out while it executes, execution continues from freshly fetched code;
+ *  should it cause an event to come due, execution stops so that the event
+ *  is delivered.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::execute(const typename cache::block &block) {
+  const auto start = _program_counter;
+  for (const auto &op : block.ops) {
+    _program_counter = op.next;
+    _cycles += op.cycles;
+    (this->*op.handler)(op.operand);
+    if (op.writes && (_cache.version(start) != block.version || _events.next() <= _cycles ||
+                      _memory.bank(start) != block.bank))
+      return;
+  }
+}
+
+/**
+ *  Runs a block and, if it turned out to be an idle loop that branched back
+ *  to itself, accounts for the iterations that still fit before the limit
+ *  without running them. The first iteration may still change what the
+ *  second reads, as reading PPUSTATUS clears its vblank flag; from the
+ *  second on, every iteration repeats the one before.
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::run_block(typename cache::block &block, std::int64_t limit) {
+  const auto start = _program_counter;
+  execute(block);
+  if (!block.idle || _program_counter != start ||
+      _cycles + static_cast<std::int64_t>(block.worst) > limit)
+    return;
+
+  const auto before = _cycles;
+  execute(block);
+  if (_program_counter != start)
+    return;
+
+  const auto iteration = _cycles - before;
+  const auto slack = limit - _cycles - static_cast<std::int64_t>(block.worst);
+  if (slack >= 0)
+    _cycles += (slack / iteration + 1) * iteration;
+}
+
+/**************************************************************************************************
+ *  Idle loops
+ */
+
+/**
+ *  Registers and flags an instruction reads and writes, for the instructions
+ *  that may appear in an idle loop; all others have no effects listed.
+ */
+struct effects {
+  enum : std::uint8_t {
+    accumulator = 0x01,
+    x = 0x02,
+    y = 0x04,
+    carry = 0x08,
+    zero = 0x10,
+    overflow = 0x20,
+    negative = 0x40
+  };
+
+  bool allowed;
+  std::uint8_t reads;
+  std::uint8_t writes;
+};
+
+constexpr auto index_register(addressing mode) -> std::uint8_t {
+  switch (mode) {
+  case addressing::zero_page_x:
+  case addressing::absolute_x:
+    return effects::x;
+  case addressing::zero_page_y:
+  case addressing::absolute_y:
+    return effects::y;
+  default:
+    return 0;
+  }
+}
+
+constexpr auto effects_of(const opcode &decoded) -> effects {
+  constexpr auto zn = effects::zero | effects::negative;
+  if (decoded.mode == addressing::indirect ||
+      decoded.mode == addressing::indexed_indirect ||
+      decoded.mode == addressing::indirect_indexed)
+    return {false, 0, 0};
+
+  const auto index = index_register(decoded.mode);
+  switch (decoded.instruction) {
+  case operation::lda: return {true, index, effects::accumulator | zn};
+  case operation::ldx: return {true, index, effects::x | zn};
+  case operation::ldy: return {true, index, effects::y | zn};
+  case operation::and_:
+  case operation::ora:
+  case operation::eor:
+    return {true, std::uint8_t(effects::accumulator | index), effects::accumulator | zn};
+  case operation::cmp:
+    return {true, std::uint8_t(effects::accumulator | index), effects::carry | zn};
+  case operation::cpx: return {true, effects::x, effects::carry | zn};
+  case operation::cpy: return {true, effects::y, effects::carry | zn};
+  case operation::bit:
+    return {true, effects::accumulator, effects::overflow | zn};
+  case operation::tax: return {true, effects::accumulator, effects::x | zn};
+  case operation::tay: return {true, effects::accumulator, effects::y | zn};
+  case operation::txa: return {true, effects::x, effects::accumulator | zn};
+  case operation::tya: return {true, effects::y, effects::accumulator | zn};
+  case operation::clc:
+  case operation::sec:
+    return {true, 0, effects::carry};
+  case operation::clv: return {true, 0, effects::overflow};
+  case operation::nop: return {decoded.mode == addressing::implied, 0, 0};
+  case operation::jmp: return {decoded.mode == addressing::absolute, 0, 0};
+  case operation::bcc:
+  case operation::bcs:
+    return {true, effects::carry, 0};
+  case operation::beq:
+  case operation::bne:
+    return {true, effects::zero, 0};
+  case operation::bmi:
+  case operation::bpl:
+    return {true, effects::negative, 0};
+  case operation::bvc:
+  case operation::bvs:
+    return {true, effects::overflow, 0};
+  default:
+    return {false, 0, 0};
+  }
+}
+
+/**
+ *  A block is an idle loop if it ends in a branch or an absolute jump back to
+ *  its own start, and running it again from where it leaves off repeats it
+ *  exactly: it writes no memory, only reads addresses where reading again
+ *  has no effect, and every register or flag it changes is set before it is
+ *  used. Then every iteration reads the same values and takes the same
+ *  path, until an event changes memory.
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::idle(word address,
+                                              const typename cache::block &block) const
+    -> bool {
+  const auto &last = block.ops.back();
+  const auto &jump = opcodes[last.code];
+  const auto target =
+      jump.mode == addressing::relative
+          ? word{last.next + static_cast<std::int8_t>(last.operand.low())}
+          : last.operand;
+  if ((jump.mode != addressing::relative && jump.instruction != operation::jmp) ||
+      target != address)
+    return false;
+
+  auto written = std::uint8_t{0};
+  auto used = std::uint8_t{0};
+  for (const auto &op : block.ops) {
+    const auto &decoded = opcodes[op.code];
+    const auto effect = effects_of(decoded);
+    if (!effect.allowed)
+      return false;
+
+    const auto zero_page = decoded.mode == addressing::zero_page ||
+                           decoded.mode == addressing::zero_page_x ||
+                           decoded.mode == addressing::zero_page_y;
+    const auto reach = index_register(decoded.mode) != 0 ? 0x100 : 1;
+    const auto reads = decoded.instruction != operation::jmp;
+    if (reads && (zero_page || decoded.mode == addressing::absolute || reach > 1))
+      for (auto offset = 0; offset < reach; ++offset) {
+        const auto target = zero_page ? word{(op.operand + offset) & 0xff}
+                                      : word{op.operand + offset};
+        if (!_memory.idempotent(target))
+          return false;
+      }
+
+    used |= effect.reads & ~written;
+    written |= effect.writes;
+  }
+  return (used & written) == 0;
+}
+
+/**************************************************************************************************
+ *  Native code
+ */
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::run_native_blocks(std::int64_t limit) {
+  while (_cycles < (limit = std::min(limit, _events.next()))) {
+    auto block = _cache.find(_program_counter, _memory.bank(_program_counter));
+    if (block == nullptr)
+      block = decode(_program_counter);
+    if (block == nullptr || _cycles + block->worst > limit) {
+      step();
+      continue;
+    }
+
+    auto native = block->idle || watching() ? nullptr : translate(_program_counter, *block);
+    if (native == nullptr) {
+      run_block(*block, limit);
+      continue;
+    }
+
+    auto context = native_context{};
+    store(context);
+    do {
+      context.cycles += block->cycles;
+      native(&context);
+      const auto address = word{context.program_counter};
+      block = _cache.find(address, _memory.bank(address));
+      limit = std::min(limit, _events.next());
+      if (block == nullptr || block->idle || watching() || context.cycles + block->worst > limit)
+        break;
+      native = translate(address, *block);
+    } while (native != nullptr);
+    load(context);
+  }
+}
+
+/**
+ *  Native code accesses internal RAM without going through the bus, so it is
+ *  not run while any reads or writes are watched.
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::watching() const -> bool {
+  return _memory.watching(watchpoint::read) || _memory.watching(watchpoint::write);
+}
+
+/**
+ *  Returns the native code for a block, translating it once it has become
+ *  hot. Blocks that cannot be translated are remembered as such until the
+ *  code buffer is next flushed.
+ */
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::translate(word address, typename cache::block &block)
+    -> recompiler::native_block {
+  if (block.generation == _recompiler.generation())
+    return reinterpret_cast<recompiler::native_block>(block.native);
+  if (!recompiler::supported || ++block.executions < hot_threshold)
+    return nullptr;
+
+  auto instructions = std::vector<recompiler::instruction>{};
+  instructions.reserve(block.ops.size());
+  for (const auto &op : block.ops)
+    instructions.push_back({op.code, op.operand, op.next, op.cycles});
+
+  // ROM cannot be written, so blocks there need not check their version.
+  const auto version_index = address < 0x8000 ? int{cache::page(address)} : -1;
+  const auto native = _recompiler.compile(instructions, version_index, block.version);
+  block.native = reinterpret_cast<void *>(native);
+  block.generation = _recompiler.generation();
+  return native;
+}
+
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::load(const native_context &context) {
+  _accumulator = byte{context.accumulator};
+  _x = byte{context.x};
+  _y = byte{context.y};
+  _program_counter = word{context.program_counter};
+  _cycles = context.cycles;
+  _status.zero(context.zero == 0);
+  _status.negative(context.negative & 0x80);
+  _status.carry(context.carry);
+  _status.overflow((context.addend ^ context.sum) & (context.augend ^ context.sum) & 0x80);
+}
+
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::store(native_context &context) {
+  context.accumulator = _accumulator;
+  context.x = _x;
+  context.y = _y;
+  context.zero = !_status.zero();
+  context.negative = _status.negative() ? 0x80 : 0x00;
+  context.carry = _status.carry();
+  context.addend = 0x00;
+  context.augend = 0x00;
+  context.sum = _status.overflow() ? 0x80 : 0x00;
+  context.program_counter = _program_counter;
+  context.cycles = _cycles;
+  context.ram = reinterpret_cast<std::uint8_t *>(_ram.data());
+  context.versions = _cache.versions();
+  context.dirty = _memory.dirty().data();
+  context.host = this;
+  context.read = &native_read;
+  context.write = &native_write;
+  context.callout = &native_callout;
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::native_read(native_context *context, std::uint32_t address)
+    -> std::uint32_t {
+  auto &self = *static_cast<basic_processor *>(context->host);
+  self._cycles = context->cycles - context->remaining;
+  return self._memory.read(word{address});
+}
+
+template <typename Variant, typename Dispatch>
+auto basic_processor<Variant, Dispatch>::native_write(native_context *context, std::uint32_t address,
+                             std::uint32_t data) -> std::uint32_t {
+  auto &self = *static_cast<basic_processor *>(context->host);
+  self._cycles = context->cycles - context->remaining;
+  self._cache.invalidate(word{address});
+  self._memory.write(word{address}, byte{data});
+  // Writes to ROM reach mapper registers, which may switch out the bank the
+  // block runs from.
+  return self._events.next() <= self._cycles || address >= 0x8000;
+}
+
+template <typename Variant, typename Dispatch>
+void basic_processor<Variant, Dispatch>::native_callout(native_context *context, std::uint32_t code,
+                               std::uint32_t operand) {
+  auto &self = *static_cast<basic_processor *>(context->host);
+  self.load(*context);
+  self._cycles -= context->remaining;
+  (self.*decoded_table[code])(word{operand});
+  self._cycles += context->remaining;
+  self.store(*context);
+}
+
+template class basic_processor<ricoh_2a03, switch_dispatch>;
+template class basic_processor<ricoh_2a03, threaded_dispatch>;
+template class basic_processor<mos_6502, switch_dispatch>;
+template class basic_processor<mos_6502, threaded_dispatch>;
 } // namespace nes
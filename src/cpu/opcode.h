@@ -0,0 +1,415 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Decoding and timing information for the 256 possible opcodes of the 6502.
+ *  Shared by the interpreter and the disassembler.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace nes {
+/**
+ *  Addressing modes determine how the operand of an instruction is obtained.
+ *  Implied and accumulator addressing take no operand bytes; all other modes
+ *  resolve to an effective address in memory.
+ */
+enum class addressing : std::uint8_t {
+    implied,
+    accumulator,
+    immediate,
+    zero_page,
+    zero_page_x,
+    zero_page_y,
+    absolute,
+    absolute_x,
+    absolute_y,
+    indirect,
+    indexed_indirect,
+    indirect_indexed,
+    relative
+};
+
+
+/**
+ *  Whether the mode's effective address always lies in the zero page.
+ */
+constexpr auto zero_page(addressing mode) -> bool
+{
+    return mode == addressing::zero_page || mode == addressing::zero_page_x ||
+           mode == addressing::zero_page_y;
+}
+
+
+/**
+ *  The 56 official instructions, with nop doubling for the unofficial no-ops
+ *  and jam for all other unofficial opcodes, which are not supported.
+ */
+enum class operation : std::uint8_t {
+    adc, and_, asl, bcc, bcs, beq, bit, bmi, bne, bpl, brk, bvc, bvs, clc,
+    cld, cli, clv, cmp, cpx, cpy, dec, dex, dey, eor, inc, inx, iny, jmp,
+    jsr, lda, ldx, ldy, lsr, nop, ora, pha, php, pla, plp, rol, ror, rti,
+    rts, sbc, sec, sed, sei, sta, stx, sty, tax, tay, tsx, txa, txs, tya,
+    jam
+};
+
+
+/**
+ *  Mnemonics as used in disassembly, indexed by operation.
+ */
+constexpr auto mnemonics = std::array<std::string_view, 57>{
+    "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL",
+    "BRK", "BVC", "BVS", "CLC", "CLD", "CLI", "CLV", "CMP", "CPX", "CPY",
+    "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP", "JSR", "LDA",
+    "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL",
+    "ROR", "RTI", "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY",
+    "TAX", "TAY", "TSX", "TXA", "TXS", "TYA", "JAM"
+};
+
+
+/**
+ *  Number of operand bytes following the opcode for each addressing mode.
+ */
+constexpr auto operand_length(addressing mode) -> std::uint8_t
+{
+    switch (mode) {
+    case addressing::implied:
+    case addressing::accumulator:
+        return 0;
+    case addressing::absolute:
+    case addressing::absolute_x:
+    case addressing::absolute_y:
+    case addressing::indirect:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+
+/**
+ *  Some instructions take additional cycles depending on their operand:
+ *      - page_cross: indexed reads take one extra cycle if indexing crosses
+ *        into the next page
+ *      - branch: a taken branch takes one extra cycle, and another if the
+ *        destination lies in a different page
+ */
+enum class penalty : std::uint8_t {
+    none,
+    page_cross,
+    branch
+};
+
+
+/**
+ *  An opcode decodes into an operation and an addressing mode, together with
+ *  the number of cycles it takes to execute, not counting penalties.
+ */
+struct opcode {
+    operation instruction;
+    addressing mode;
+    std::uint8_t cycles;
+    penalty extra;
+
+    constexpr auto mnemonic() const -> std::string_view
+    {
+        return mnemonics[static_cast<std::size_t>(instruction)];
+    }
+
+    constexpr auto length() const -> std::uint8_t
+    {
+        return 1 + operand_length(mode);
+    }
+};
+
+
+/**
+ *  Decoding table, indexed by opcode.
+ */
+constexpr auto opcodes = std::array<opcode, 256>{{
+    /* 0x00 */ {operation::brk,  addressing::implied,          7, penalty::none},
+    /* 0x01 */ {operation::ora,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0x02 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x03 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x04 */ {operation::nop,  addressing::zero_page,        3, penalty::none},
+    /* 0x05 */ {operation::ora,  addressing::zero_page,        3, penalty::none},
+    /* 0x06 */ {operation::asl,  addressing::zero_page,        5, penalty::none},
+    /* 0x07 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x08 */ {operation::php,  addressing::implied,          3, penalty::none},
+    /* 0x09 */ {operation::ora,  addressing::immediate,        2, penalty::none},
+    /* 0x0a */ {operation::asl,  addressing::accumulator,      2, penalty::none},
+    /* 0x0b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x0c */ {operation::nop,  addressing::absolute,         4, penalty::none},
+    /* 0x0d */ {operation::ora,  addressing::absolute,         4, penalty::none},
+    /* 0x0e */ {operation::asl,  addressing::absolute,         6, penalty::none},
+    /* 0x0f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x10 */ {operation::bpl,  addressing::relative,         2, penalty::branch},
+    /* 0x11 */ {operation::ora,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0x12 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x13 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x14 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x15 */ {operation::ora,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x16 */ {operation::asl,  addressing::zero_page_x,      6, penalty::none},
+    /* 0x17 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x18 */ {operation::clc,  addressing::implied,          2, penalty::none},
+    /* 0x19 */ {operation::ora,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0x1a */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0x1b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x1c */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x1d */ {operation::ora,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x1e */ {operation::asl,  addressing::absolute_x,       7, penalty::none},
+    /* 0x1f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x20 */ {operation::jsr,  addressing::absolute,         6, penalty::none},
+    /* 0x21 */ {operation::and_, addressing::indexed_indirect, 6, penalty::none},
+    /* 0x22 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x23 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x24 */ {operation::bit,  addressing::zero_page,        3, penalty::none},
+    /* 0x25 */ {operation::and_, addressing::zero_page,        3, penalty::none},
+    /* 0x26 */ {operation::rol,  addressing::zero_page,        5, penalty::none},
+    /* 0x27 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x28 */ {operation::plp,  addressing::implied,          4, penalty::none},
+    /* 0x29 */ {operation::and_, addressing::immediate,        2, penalty::none},
+    /* 0x2a */ {operation::rol,  addressing::accumulator,      2, penalty::none},
+    /* 0x2b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x2c */ {operation::bit,  addressing::absolute,         4, penalty::none},
+    /* 0x2d */ {operation::and_, addressing::absolute,         4, penalty::none},
+    /* 0x2e */ {operation::rol,  addressing::absolute,         6, penalty::none},
+    /* 0x2f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x30 */ {operation::bmi,  addressing::relative,         2, penalty::branch},
+    /* 0x31 */ {operation::and_, addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0x32 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x33 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x34 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x35 */ {operation::and_, addressing::zero_page_x,      4, penalty::none},
+    /* 0x36 */ {operation::rol,  addressing::zero_page_x,      6, penalty::none},
+    /* 0x37 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x38 */ {operation::sec,  addressing::implied,          2, penalty::none},
+    /* 0x39 */ {operation::and_, addressing::absolute_y,       4, penalty::page_cross},
+    /* 0x3a */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0x3b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x3c */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x3d */ {operation::and_, addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x3e */ {operation::rol,  addressing::absolute_x,       7, penalty::none},
+    /* 0x3f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x40 */ {operation::rti,  addressing::implied,          6, penalty::none},
+    /* 0x41 */ {operation::eor,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0x42 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x43 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x44 */ {operation::nop,  addressing::zero_page,        3, penalty::none},
+    /* 0x45 */ {operation::eor,  addressing::zero_page,        3, penalty::none},
+    /* 0x46 */ {operation::lsr,  addressing::zero_page,        5, penalty::none},
+    /* 0x47 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x48 */ {operation::pha,  addressing::implied,          3, penalty::none},
+    /* 0x49 */ {operation::eor,  addressing::immediate,        2, penalty::none},
+    /* 0x4a */ {operation::lsr,  addressing::accumulator,      2, penalty::none},
+    /* 0x4b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x4c */ {operation::jmp,  addressing::absolute,         3, penalty::none},
+    /* 0x4d */ {operation::eor,  addressing::absolute,         4, penalty::none},
+    /* 0x4e */ {operation::lsr,  addressing::absolute,         6, penalty::none},
+    /* 0x4f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x50 */ {operation::bvc,  addressing::relative,         2, penalty::branch},
+    /* 0x51 */ {operation::eor,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0x52 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x53 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x54 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x55 */ {operation::eor,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x56 */ {operation::lsr,  addressing::zero_page_x,      6, penalty::none},
+    /* 0x57 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x58 */ {operation::cli,  addressing::implied,          2, penalty::none},
+    /* 0x59 */ {operation::eor,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0x5a */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0x5b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x5c */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x5d */ {operation::eor,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x5e */ {operation::lsr,  addressing::absolute_x,       7, penalty::none},
+    /* 0x5f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x60 */ {operation::rts,  addressing::implied,          6, penalty::none},
+    /* 0x61 */ {operation::adc,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0x62 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x63 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x64 */ {operation::nop,  addressing::zero_page,        3, penalty::none},
+    /* 0x65 */ {operation::adc,  addressing::zero_page,        3, penalty::none},
+    /* 0x66 */ {operation::ror,  addressing::zero_page,        5, penalty::none},
+    /* 0x67 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x68 */ {operation::pla,  addressing::implied,          4, penalty::none},
+    /* 0x69 */ {operation::adc,  addressing::immediate,        2, penalty::none},
+    /* 0x6a */ {operation::ror,  addressing::accumulator,      2, penalty::none},
+    /* 0x6b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x6c */ {operation::jmp,  addressing::indirect,         5, penalty::none},
+    /* 0x6d */ {operation::adc,  addressing::absolute,         4, penalty::none},
+    /* 0x6e */ {operation::ror,  addressing::absolute,         6, penalty::none},
+    /* 0x6f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x70 */ {operation::bvs,  addressing::relative,         2, penalty::branch},
+    /* 0x71 */ {operation::adc,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0x72 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x73 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x74 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x75 */ {operation::adc,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x76 */ {operation::ror,  addressing::zero_page_x,      6, penalty::none},
+    /* 0x77 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x78 */ {operation::sei,  addressing::implied,          2, penalty::none},
+    /* 0x79 */ {operation::adc,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0x7a */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0x7b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x7c */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x7d */ {operation::adc,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0x7e */ {operation::ror,  addressing::absolute_x,       7, penalty::none},
+    /* 0x7f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x80 */ {operation::nop,  addressing::immediate,        2, penalty::none},
+    /* 0x81 */ {operation::sta,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0x82 */ {operation::nop,  addressing::immediate,        2, penalty::none},
+    /* 0x83 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x84 */ {operation::sty,  addressing::zero_page,        3, penalty::none},
+    /* 0x85 */ {operation::sta,  addressing::zero_page,        3, penalty::none},
+    /* 0x86 */ {operation::stx,  addressing::zero_page,        3, penalty::none},
+    /* 0x87 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x88 */ {operation::dey,  addressing::implied,          2, penalty::none},
+    /* 0x89 */ {operation::nop,  addressing::immediate,        2, penalty::none},
+    /* 0x8a */ {operation::txa,  addressing::implied,          2, penalty::none},
+    /* 0x8b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x8c */ {operation::sty,  addressing::absolute,         4, penalty::none},
+    /* 0x8d */ {operation::sta,  addressing::absolute,         4, penalty::none},
+    /* 0x8e */ {operation::stx,  addressing::absolute,         4, penalty::none},
+    /* 0x8f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x90 */ {operation::bcc,  addressing::relative,         2, penalty::branch},
+    /* 0x91 */ {operation::sta,  addressing::indirect_indexed, 6, penalty::none},
+    /* 0x92 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x93 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x94 */ {operation::sty,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x95 */ {operation::sta,  addressing::zero_page_x,      4, penalty::none},
+    /* 0x96 */ {operation::stx,  addressing::zero_page_y,      4, penalty::none},
+    /* 0x97 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x98 */ {operation::tya,  addressing::implied,          2, penalty::none},
+    /* 0x99 */ {operation::sta,  addressing::absolute_y,       5, penalty::none},
+    /* 0x9a */ {operation::txs,  addressing::implied,          2, penalty::none},
+    /* 0x9b */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x9c */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x9d */ {operation::sta,  addressing::absolute_x,       5, penalty::none},
+    /* 0x9e */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0x9f */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xa0 */ {operation::ldy,  addressing::immediate,        2, penalty::none},
+    /* 0xa1 */ {operation::lda,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0xa2 */ {operation::ldx,  addressing::immediate,        2, penalty::none},
+    /* 0xa3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xa4 */ {operation::ldy,  addressing::zero_page,        3, penalty::none},
+    /* 0xa5 */ {operation::lda,  addressing::zero_page,        3, penalty::none},
+    /* 0xa6 */ {operation::ldx,  addressing::zero_page,        3, penalty::none},
+    /* 0xa7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xa8 */ {operation::tay,  addressing::implied,          2, penalty::none},
+    /* 0xa9 */ {operation::lda,  addressing::immediate,        2, penalty::none},
+    /* 0xaa */ {operation::tax,  addressing::implied,          2, penalty::none},
+    /* 0xab */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xac */ {operation::ldy,  addressing::absolute,         4, penalty::none},
+    /* 0xad */ {operation::lda,  addressing::absolute,         4, penalty::none},
+    /* 0xae */ {operation::ldx,  addressing::absolute,         4, penalty::none},
+    /* 0xaf */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xb0 */ {operation::bcs,  addressing::relative,         2, penalty::branch},
+    /* 0xb1 */ {operation::lda,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0xb2 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xb3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xb4 */ {operation::ldy,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xb5 */ {operation::lda,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xb6 */ {operation::ldx,  addressing::zero_page_y,      4, penalty::none},
+    /* 0xb7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xb8 */ {operation::clv,  addressing::implied,          2, penalty::none},
+    /* 0xb9 */ {operation::lda,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0xba */ {operation::tsx,  addressing::implied,          2, penalty::none},
+    /* 0xbb */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xbc */ {operation::ldy,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xbd */ {operation::lda,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xbe */ {operation::ldx,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0xbf */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xc0 */ {operation::cpy,  addressing::immediate,        2, penalty::none},
+    /* 0xc1 */ {operation::cmp,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0xc2 */ {operation::nop,  addressing::immediate,        2, penalty::none},
+    /* 0xc3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xc4 */ {operation::cpy,  addressing::zero_page,        3, penalty::none},
+    /* 0xc5 */ {operation::cmp,  addressing::zero_page,        3, penalty::none},
+    /* 0xc6 */ {operation::dec,  addressing::zero_page,        5, penalty::none},
+    /* 0xc7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xc8 */ {operation::iny,  addressing::implied,          2, penalty::none},
+    /* 0xc9 */ {operation::cmp,  addressing::immediate,        2, penalty::none},
+    /* 0xca */ {operation::dex,  addressing::implied,          2, penalty::none},
+    /* 0xcb */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xcc */ {operation::cpy,  addressing::absolute,         4, penalty::none},
+    /* 0xcd */ {operation::cmp,  addressing::absolute,         4, penalty::none},
+    /* 0xce */ {operation::dec,  addressing::absolute,         6, penalty::none},
+    /* 0xcf */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xd0 */ {operation::bne,  addressing::relative,         2, penalty::branch},
+    /* 0xd1 */ {operation::cmp,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0xd2 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xd3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xd4 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xd5 */ {operation::cmp,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xd6 */ {operation::dec,  addressing::zero_page_x,      6, penalty::none},
+    /* 0xd7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xd8 */ {operation::cld,  addressing::implied,          2, penalty::none},
+    /* 0xd9 */ {operation::cmp,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0xda */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0xdb */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xdc */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xdd */ {operation::cmp,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xde */ {operation::dec,  addressing::absolute_x,       7, penalty::none},
+    /* 0xdf */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xe0 */ {operation::cpx,  addressing::immediate,        2, penalty::none},
+    /* 0xe1 */ {operation::sbc,  addressing::indexed_indirect, 6, penalty::none},
+    /* 0xe2 */ {operation::nop,  addressing::immediate,        2, penalty::none},
+    /* 0xe3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xe4 */ {operation::cpx,  addressing::zero_page,        3, penalty::none},
+    /* 0xe5 */ {operation::sbc,  addressing::zero_page,        3, penalty::none},
+    /* 0xe6 */ {operation::inc,  addressing::zero_page,        5, penalty::none},
+    /* 0xe7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xe8 */ {operation::inx,  addressing::implied,          2, penalty::none},
+    /* 0xe9 */ {operation::sbc,  addressing::immediate,        2, penalty::none},
+    /* 0xea */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0xeb */ {operation::sbc,  addressing::immediate,        2, penalty::none},
+    /* 0xec */ {operation::cpx,  addressing::absolute,         4, penalty::none},
+    /* 0xed */ {operation::sbc,  addressing::absolute,         4, penalty::none},
+    /* 0xee */ {operation::inc,  addressing::absolute,         6, penalty::none},
+    /* 0xef */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xf0 */ {operation::beq,  addressing::relative,         2, penalty::branch},
+    /* 0xf1 */ {operation::sbc,  addressing::indirect_indexed, 5, penalty::page_cross},
+    /* 0xf2 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xf3 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xf4 */ {operation::nop,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xf5 */ {operation::sbc,  addressing::zero_page_x,      4, penalty::none},
+    /* 0xf6 */ {operation::inc,  addressing::zero_page_x,      6, penalty::none},
+    /* 0xf7 */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xf8 */ {operation::sed,  addressing::implied,          2, penalty::none},
+    /* 0xf9 */ {operation::sbc,  addressing::absolute_y,       4, penalty::page_cross},
+    /* 0xfa */ {operation::nop,  addressing::implied,          2, penalty::none},
+    /* 0xfb */ {operation::jam,  addressing::implied,          2, penalty::none},
+    /* 0xfc */ {operation::nop,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xfd */ {operation::sbc,  addressing::absolute_x,       4, penalty::page_cross},
+    /* 0xfe */ {operation::inc,  addressing::absolute_x,       7, penalty::none},
+    /* 0xff */ {operation::jam,  addressing::implied,          2, penalty::none}
+}};
+
+
+static_assert(opcodes[0x00].instruction == operation::brk);
+static_assert(opcodes[0x6c].mode == addressing::indirect);
+static_assert(opcodes[0xfe].cycles == 7);
+static_assert(opcodes[0xbd].extra == penalty::page_cross);
+static_assert(opcodes[0x20].length() == 3);
+static_assert(opcodes[0x29].mnemonic() == "AND");
+}
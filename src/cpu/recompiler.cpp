@@ -0,0 +1,955 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "recompiler.h"
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#include "opcode.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nes {
+#if defined(__x86_64__) && defined(__unix__)
+namespace {
+/**************************************************************************************************
+ *  Assembler
+ */
+enum reg : std::uint8_t {
+  rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+  r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+enum condition : std::uint8_t {
+  below = 0x2,
+  above_equal = 0x3,
+  equal = 0x4,
+  not_equal = 0x5
+};
+
+enum class alu : std::uint8_t { add = 0, or_ = 1, and_ = 4, sub = 5, xor_ = 6, cmp = 7 };
+
+/**
+ *  Register or memory operand. Memory operands are always encoded with a
+ *  32-bit displacement, which is valid for every base register used here.
+ */
+struct operand {
+  bool memory;
+  reg base;
+  reg index;
+  std::uint8_t scale;
+  bool indexed;
+  std::int32_t displacement;
+};
+
+constexpr auto direct(reg r) -> operand { return {false, r, rax, 0, false, 0}; }
+
+constexpr auto at(reg base, std::int32_t displacement) -> operand {
+  return {true, base, rax, 0, false, displacement};
+}
+
+constexpr auto at(reg base, reg index, std::uint8_t scale,
+                  std::int32_t displacement = 0) -> operand {
+  return {true, base, index, scale, true, displacement};
+}
+
+/**
+ *  Minimal x86-64 assembler, covering only the instructions the recompiler
+ *  emits. All jumps use 32-bit displacements, patched once labels are bound.
+ */
+class assembler {
+public:
+  struct label {
+    std::ptrdiff_t position = -1;
+    std::vector<std::size_t> fixups;
+  };
+
+  auto code() const -> const std::vector<std::uint8_t> & { return _code; }
+
+  void emit8(std::uint32_t value) { _code.push_back(static_cast<std::uint8_t>(value)); }
+
+  void emit16(std::uint32_t value) {
+    emit8(value);
+    emit8(value >> 8);
+  }
+
+  void emit32(std::uint32_t value) {
+    emit16(value);
+    emit16(value >> 16);
+  }
+
+  void encode(std::initializer_list<std::uint8_t> opcode, std::uint8_t field,
+              const operand &rm, bool wide = false) {
+    const auto rex = 0x40 | wide << 3 | (field >> 3 & 1) << 2 |
+                     (rm.indexed ? rm.index >> 3 & 1 : 0) << 1 |
+                     (rm.base >> 3 & 1);
+    if (rex != 0x40)
+      emit8(rex);
+    for (const auto byte : opcode)
+      emit8(byte);
+
+    if (!rm.memory) {
+      emit8(0xc0 | (field & 7) << 3 | (rm.base & 7));
+    } else if (!rm.indexed) {
+      emit8(0x80 | (field & 7) << 3 | (rm.base & 7));
+      emit32(static_cast<std::uint32_t>(rm.displacement));
+    } else {
+      emit8(0x80 | (field & 7) << 3 | 0x4);
+      emit8(rm.scale << 6 | (rm.index & 7) << 3 | (rm.base & 7));
+      emit32(static_cast<std::uint32_t>(rm.displacement));
+    }
+  }
+
+  void mov(reg destination, const operand &source) { encode({0x8b}, destination, source); }
+  void mov(const operand &destination, reg source) { encode({0x89}, source, destination); }
+  void mov64(reg destination, const operand &source) { encode({0x8b}, destination, source, true); }
+  void mov64(const operand &destination, reg source) { encode({0x89}, source, destination, true); }
+
+  void mov(const operand &destination, std::uint32_t value) {
+    encode({0xc7}, 0, destination);
+    emit32(value);
+  }
+
+  void movzx8(reg destination, const operand &source) {
+    encode({0x0f, 0xb6}, destination, source);
+  }
+
+  void store8(const operand &destination, reg source) { encode({0x88}, source, destination); }
+
+  void store8(const operand &destination, std::uint8_t value) {
+    encode({0xc6}, 0, destination);
+    emit8(value);
+  }
+
+  void store16(const operand &destination, std::uint16_t value) {
+    emit8(0x66);
+    encode({0xc7}, 0, destination);
+    emit16(value);
+  }
+
+  void arithmetic(alu op, const operand &destination, reg source, bool wide = false) {
+    encode({static_cast<std::uint8_t>(static_cast<std::uint8_t>(op) << 3 | 1)},
+           source, destination, wide);
+  }
+
+  void arithmetic(alu op, const operand &destination, std::uint32_t value,
+                  bool wide = false) {
+    encode({0x81}, static_cast<std::uint8_t>(op), destination, wide);
+    emit32(value);
+  }
+
+  void shl(reg r, std::uint8_t count) {
+    encode({0xc1}, 4, direct(r));
+    emit8(count);
+  }
+
+  void shr(reg r, std::uint8_t count) {
+    encode({0xc1}, 5, direct(r));
+    emit8(count);
+  }
+
+  void test(const operand &destination, reg source) { encode({0x85}, source, destination); }
+
+  void test(const operand &destination, std::uint32_t value) {
+    encode({0xf7}, 0, destination);
+    emit32(value);
+  }
+
+  void increment(const operand &destination) { encode({0xff}, 0, destination); }
+  void call(const operand &target) { encode({0xff}, 2, target); }
+
+  void push(reg r) {
+    if (r >= r8)
+      emit8(0x41);
+    emit8(0x50 | (r & 7));
+  }
+
+  void pop(reg r) {
+    if (r >= r8)
+      emit8(0x41);
+    emit8(0x58 | (r & 7));
+  }
+
+  void ret() { emit8(0xc3); }
+
+  void jump(label &target) {
+    emit8(0xe9);
+    reference(target);
+  }
+
+  void jump(condition cc, label &target) {
+    emit8(0x0f);
+    emit8(0x80 | cc);
+    reference(target);
+  }
+
+  void bind(label &target) {
+    target.position = static_cast<std::ptrdiff_t>(_code.size());
+    for (const auto fixup : target.fixups)
+      patch(fixup, target.position);
+  }
+
+private:
+  void reference(label &target) {
+    const auto fixup = _code.size();
+    emit32(0);
+    if (target.position >= 0)
+      patch(fixup, target.position);
+    else
+      target.fixups.push_back(fixup);
+  }
+
+  void patch(std::size_t fixup, std::ptrdiff_t position) {
+    const auto offset = static_cast<std::uint32_t>(
+        position - static_cast<std::ptrdiff_t>(fixup + 4));
+    std::memcpy(_code.data() + fixup, &offset, sizeof(offset));
+  }
+
+  std::vector<std::uint8_t> _code;
+};
+
+/**************************************************************************************************
+ *  Translation
+ */
+
+/**
+ *  Register allocation. All 6502 state kept in registers lives in callee-saved
+ *  registers, so that calls into the bus need not spill it.
+ */
+constexpr auto context = rbp;
+constexpr auto accumulator = rbx;
+constexpr auto x_register = r12;
+constexpr auto y_register = r13;
+constexpr auto zero_source = r14;
+constexpr auto negative_source = r15;
+
+#define NES_FIELD(name) at(context, offsetof(native_context, name))
+
+class translator {
+public:
+  translator(const std::vector<recompiler::instruction> &block,
+             int version_index, std::uint32_t version, bool decimal_mode)
+      : _block{block}, _version_index{version_index}, _version{version},
+        _decimal_mode{decimal_mode} {}
+
+  /**
+   *  Translates the complete block, returning false if it contains an
+   *  instruction that cannot be executed from native code.
+   */
+  auto translate() -> bool {
+    for (const auto &instruction : _block)
+      if (opcodes[instruction.code].instruction == operation::jam)
+        return false;
+
+    prologue();
+    auto remaining = 0u;
+    for (const auto &instruction : _block)
+      remaining += instruction.cycles;
+
+    for (const auto &instruction : _block) {
+      remaining -= instruction.cycles;
+      _remaining = remaining;
+      _current = &instruction;
+      if (!translate(instruction))
+        callout(instruction);
+    }
+
+    const auto &last = _block.back();
+    if (!ends_block(last))
+      _assembler.store16(NES_FIELD(program_counter), last.next);
+    _assembler.bind(_exit);
+    epilogue();
+
+    for (auto &exit : _early_exits) {
+      _assembler.bind(exit.target);
+      _assembler.arithmetic(alu::sub, NES_FIELD(cycles), exit.remaining, true);
+      _assembler.store16(NES_FIELD(program_counter), exit.next);
+      _assembler.jump(_exit);
+    }
+    return true;
+  }
+
+  auto code() const -> const std::vector<std::uint8_t> & { return _assembler.code(); }
+
+private:
+  struct early_exit {
+    assembler::label target;
+    std::uint32_t remaining;
+    std::uint16_t next;
+  };
+
+  static auto ends_block(const recompiler::instruction &instruction) -> bool {
+    const auto &decoded = opcodes[instruction.code];
+    switch (decoded.instruction) {
+    case operation::brk:
+    case operation::jmp:
+    case operation::jsr:
+    case operation::rti:
+    case operation::rts:
+      return true;
+    default:
+      return decoded.mode == addressing::relative;
+    }
+  }
+
+  /**
+   *  Register state is loaded from the context on entry and after calling
+   *  back into the interpreter, and stored on exit and before such calls.
+   */
+  void load_registers() {
+    _assembler.movzx8(accumulator, NES_FIELD(accumulator));
+    _assembler.movzx8(x_register, NES_FIELD(x));
+    _assembler.movzx8(y_register, NES_FIELD(y));
+    _assembler.movzx8(zero_source, NES_FIELD(zero));
+    _assembler.movzx8(negative_source, NES_FIELD(negative));
+  }
+
+  void store_registers() {
+    _assembler.store8(NES_FIELD(accumulator), accumulator);
+    _assembler.store8(NES_FIELD(x), x_register);
+    _assembler.store8(NES_FIELD(y), y_register);
+    _assembler.store8(NES_FIELD(zero), zero_source);
+    _assembler.store8(NES_FIELD(negative), negative_source);
+  }
+
+  /**
+   *  Six pushes and the return address leave the stack 8 bytes short of the
+   *  16-byte alignment calls require.
+   */
+  void prologue() {
+    for (const auto r : {rbx, rbp, r12, r13, r14, r15})
+      _assembler.push(r);
+    _assembler.arithmetic(alu::sub, direct(rsp), 8, true);
+    _assembler.mov64(direct(context), rdi);
+    load_registers();
+  }
+
+  void epilogue() {
+    store_registers();
+    _assembler.arithmetic(alu::add, direct(rsp), 8, true);
+    for (const auto r : {r15, r14, r13, r12, rbp, rbx})
+      _assembler.pop(r);
+    _assembler.ret();
+  }
+
+  void set_logical(reg result) {
+    _assembler.mov(direct(zero_source), result);
+    _assembler.mov(direct(negative_source), result);
+  }
+
+  void add_cycles(reg count) {
+    _assembler.arithmetic(alu::add, NES_FIELD(cycles), count, true);
+  }
+
+  /**
+   *  Memory accesses. Internal RAM is accessed inline, everything else goes
+   *  through the bus callbacks. Addresses computed at run time are in eax,
+   *  read results are returned in eax and write data is taken from edx.
+   */
+  void read_constant(word address) {
+    if (address < 0x2000) {
+      _assembler.mov64(rcx, NES_FIELD(ram));
+      _assembler.movzx8(rax, at(rcx, address & 0x7ff));
+    } else {
+      _assembler.mov(NES_FIELD(remaining), _remaining);
+      _assembler.mov64(direct(rdi), context);
+      _assembler.mov(direct(rsi), address);
+      _assembler.call(NES_FIELD(read));
+    }
+  }
+
+  void read_dynamic() {
+    auto slow = assembler::label{};
+    auto done = assembler::label{};
+    _assembler.arithmetic(alu::cmp, direct(rax), 0x2000);
+    _assembler.jump(above_equal, slow);
+    _assembler.arithmetic(alu::and_, direct(rax), 0x7ff);
+    _assembler.mov64(rcx, NES_FIELD(ram));
+    _assembler.movzx8(rax, at(rcx, rax, 0));
+    _assembler.jump(done);
+    _assembler.bind(slow);
+    _assembler.mov(NES_FIELD(remaining), _remaining);
+    _assembler.mov64(direct(rdi), context);
+    _assembler.mov(direct(rsi), rax);
+    _assembler.call(NES_FIELD(read));
+    _assembler.bind(done);
+  }
+
+  void write_ram() {
+    _assembler.arithmetic(alu::and_, direct(rax), 0x7ff);
+    _assembler.mov64(rcx, NES_FIELD(ram));
+    _assembler.store8(at(rcx, rax, 0), rdx);
+    _assembler.shr(rax, 8);
+    _assembler.mov64(rcx, NES_FIELD(dirty));
+    _assembler.store8(at(rcx, rax, 0), 1);
+    _assembler.mov64(rcx, NES_FIELD(versions));
+    _assembler.increment(at(rcx, rax, 2));
+  }
+
+  void write_bus() {
+    _assembler.mov(NES_FIELD(remaining), _remaining);
+    _assembler.mov64(direct(rdi), context);
+    _assembler.mov(direct(rsi), rax);
+    _assembler.call(NES_FIELD(write));
+    _early_exits.push_back({{}, _remaining, _current->next});
+    _assembler.arithmetic(alu::cmp, direct(rax), 0);
+    _assembler.jump(not_equal, _early_exits.back().target);
+  }
+
+  void write_constant(word address) {
+    _assembler.mov(direct(rax), address);
+    if (address < 0x2000)
+      write_ram();
+    else
+      write_bus();
+    check_version();
+  }
+
+  void write_dynamic() {
+    auto slow = assembler::label{};
+    auto done = assembler::label{};
+    _assembler.arithmetic(alu::cmp, direct(rax), 0x2000);
+    _assembler.jump(above_equal, slow);
+    write_ram();
+    _assembler.jump(done);
+    _assembler.bind(slow);
+    write_bus();
+    _assembler.bind(done);
+    check_version();
+  }
+
+  /**
+   *  Code in writable memory exits as soon as its own page has been written.
+   */
+  void check_version() {
+    if (_version_index < 0)
+      return;
+    _early_exits.push_back({{}, _remaining, _current->next});
+    _assembler.mov64(rcx, NES_FIELD(versions));
+    _assembler.arithmetic(alu::cmp, at(rcx, _version_index * 4), _version);
+    _assembler.jump(not_equal, _early_exits.back().target);
+  }
+
+  /**
+   *  Computes the effective address into eax, returning false if the address
+   *  is a compile-time constant instead, in which case no code is emitted.
+   *  Indexed reads subject to a page crossing penalty account for it here.
+   */
+  auto address(addressing mode, word operand, bool page_penalty) -> bool {
+    switch (mode) {
+    case addressing::zero_page:
+    case addressing::absolute:
+      return false;
+    case addressing::zero_page_x:
+    case addressing::zero_page_y:
+      _assembler.mov(rax, direct(mode == addressing::zero_page_x ? x_register : y_register));
+      _assembler.arithmetic(alu::add, direct(rax), operand.low());
+      _assembler.arithmetic(alu::and_, direct(rax), 0xff);
+      return true;
+    case addressing::absolute_x:
+    case addressing::absolute_y:
+      _assembler.mov(rax, direct(mode == addressing::absolute_x ? x_register : y_register));
+      _assembler.arithmetic(alu::add, direct(rax), operand);
+      if (page_penalty) {
+        _assembler.mov(rdx, direct(rax));
+        _assembler.shr(rdx, 8);
+        _assembler.arithmetic(alu::sub, direct(rdx), operand.high());
+        add_cycles(rdx);
+      }
+      _assembler.arithmetic(alu::and_, direct(rax), 0xffff);
+      return true;
+    case addressing::indexed_indirect:
+      _assembler.mov(rax, direct(x_register));
+      _assembler.arithmetic(alu::add, direct(rax), operand.low());
+      _assembler.arithmetic(alu::and_, direct(rax), 0xff);
+      _assembler.mov64(rcx, NES_FIELD(ram));
+      _assembler.movzx8(rdx, at(rcx, rax, 0));
+      _assembler.arithmetic(alu::add, direct(rax), 1);
+      _assembler.arithmetic(alu::and_, direct(rax), 0xff);
+      _assembler.movzx8(rax, at(rcx, rax, 0));
+      _assembler.shl(rax, 8);
+      _assembler.arithmetic(alu::or_, direct(rax), rdx);
+      return true;
+    case addressing::indirect_indexed:
+      _assembler.mov64(rcx, NES_FIELD(ram));
+      _assembler.movzx8(rax, at(rcx, operand.low()));
+      _assembler.movzx8(rdx, at(rcx, byte{operand.low() + 1}));
+      _assembler.shl(rdx, 8);
+      _assembler.arithmetic(alu::or_, direct(rax), rdx);
+      if (page_penalty) {
+        _assembler.mov(rdx, direct(rax));
+        _assembler.arithmetic(alu::and_, direct(rdx), 0xff);
+        _assembler.arithmetic(alu::add, direct(rdx), y_register);
+        _assembler.shr(rdx, 8);
+        add_cycles(rdx);
+      }
+      _assembler.arithmetic(alu::add, direct(rax), y_register);
+      _assembler.arithmetic(alu::and_, direct(rax), 0xffff);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  static auto constant_address(addressing mode, word operand) -> word {
+    return mode == addressing::zero_page ? word{operand.low()} : operand;
+  }
+
+  /**
+   *  Loads the operand value into eax.
+   */
+  void load(const recompiler::instruction &instruction) {
+    const auto &decoded = opcodes[instruction.code];
+    if (decoded.mode == addressing::immediate)
+      _assembler.mov(direct(rax), instruction.operand.low());
+    else if (address(decoded.mode, instruction.operand,
+                     decoded.extra == penalty::page_cross))
+      read_dynamic();
+    else
+      read_constant(constant_address(decoded.mode, instruction.operand));
+  }
+
+  /**
+   *  Stores the given register to the operand address.
+   */
+  void store(const recompiler::instruction &instruction, reg source) {
+    const auto &decoded = opcodes[instruction.code];
+    if (address(decoded.mode, instruction.operand, false)) {
+      _assembler.mov(rdx, direct(source));
+      write_dynamic();
+    } else {
+      _assembler.mov(rdx, direct(source));
+      write_constant(constant_address(decoded.mode, instruction.operand));
+    }
+  }
+
+  /**
+   *  Read-modify-write instructions operate on the value in eax; the address
+   *  is kept in the context across the read.
+   */
+  template <typename Modify>
+  void modify(const recompiler::instruction &instruction, Modify modify) {
+    const auto &decoded = opcodes[instruction.code];
+    if (address(decoded.mode, instruction.operand, false)) {
+      _assembler.mov(NES_FIELD(scratch), rax);
+      read_dynamic();
+      modify(rax);
+      _assembler.mov(rdx, direct(rax));
+      _assembler.mov(rax, NES_FIELD(scratch));
+      write_dynamic();
+    } else {
+      const auto address = constant_address(decoded.mode, instruction.operand);
+      read_constant(address);
+      modify(rax);
+      _assembler.mov(rdx, direct(rax));
+      write_constant(address);
+    }
+  }
+
+  /**
+   *  Addition of eax and the carry to the accumulator, with the operands
+   *  stored as sources of the overflow flag.
+   */
+  void add_with_carry() {
+    _assembler.movzx8(rcx, NES_FIELD(carry));
+    _assembler.mov(rdx, direct(accumulator));
+    _assembler.arithmetic(alu::add, direct(rdx), rax);
+    _assembler.arithmetic(alu::add, direct(rdx), rcx);
+    _assembler.store8(NES_FIELD(addend), accumulator);
+    _assembler.store8(NES_FIELD(augend), rax);
+    _assembler.store8(NES_FIELD(sum), rdx);
+    _assembler.mov(rcx, direct(rdx));
+    _assembler.shr(rcx, 8);
+    _assembler.store8(NES_FIELD(carry), rcx);
+    _assembler.movzx8(accumulator, direct(rdx));
+    set_logical(accumulator);
+  }
+
+  void compare(reg left) {
+    _assembler.arithmetic(alu::xor_, direct(rax), 0xff);
+    _assembler.mov(rdx, direct(left));
+    _assembler.arithmetic(alu::add, direct(rdx), rax);
+    _assembler.arithmetic(alu::add, direct(rdx), 1);
+    _assembler.mov(rcx, direct(rdx));
+    _assembler.shr(rcx, 8);
+    _assembler.store8(NES_FIELD(carry), rcx);
+    _assembler.arithmetic(alu::and_, direct(rdx), 0xff);
+    set_logical(rdx);
+  }
+
+  void step(reg r, bool increment) {
+    _assembler.arithmetic(increment ? alu::add : alu::sub, direct(r), 1);
+    _assembler.arithmetic(alu::and_, direct(r), 0xff);
+    set_logical(r);
+  }
+
+  void transfer(reg from, reg to) {
+    _assembler.mov(to, direct(from));
+    set_logical(to);
+  }
+
+  void shift(operation instruction, reg r) {
+    switch (instruction) {
+    case operation::asl:
+      _assembler.mov(rcx, direct(r));
+      _assembler.shr(rcx, 7);
+      _assembler.store8(NES_FIELD(carry), rcx);
+      _assembler.shl(r, 1);
+      _assembler.arithmetic(alu::and_, direct(r), 0xff);
+      break;
+    case operation::lsr:
+      _assembler.mov(rcx, direct(r));
+      _assembler.arithmetic(alu::and_, direct(rcx), 1);
+      _assembler.store8(NES_FIELD(carry), rcx);
+      _assembler.shr(r, 1);
+      break;
+    case operation::rol:
+      _assembler.movzx8(rdx, NES_FIELD(carry));
+      _assembler.mov(rcx, direct(r));
+      _assembler.shr(rcx, 7);
+      _assembler.store8(NES_FIELD(carry), rcx);
+      _assembler.shl(r, 1);
+      _assembler.arithmetic(alu::or_, direct(r), rdx);
+      _assembler.arithmetic(alu::and_, direct(r), 0xff);
+      break;
+    default:
+      _assembler.movzx8(rdx, NES_FIELD(carry));
+      _assembler.shl(rdx, 7);
+      _assembler.mov(rcx, direct(r));
+      _assembler.arithmetic(alu::and_, direct(rcx), 1);
+      _assembler.store8(NES_FIELD(carry), rcx);
+      _assembler.shr(r, 1);
+      _assembler.arithmetic(alu::or_, direct(r), rdx);
+      break;
+    }
+    set_logical(r);
+  }
+
+  /**
+   *  Branches end the block: both outcomes store the program counter and
+   *  exit, the taken branch accounting for its penalty cycles.
+   */
+  void branch(const recompiler::instruction &instruction) {
+    const auto target = word{instruction.next + instruction.operand.low().as_signed()};
+    auto taken = assembler::label{};
+
+    switch (opcodes[instruction.code].instruction) {
+    case operation::beq:
+    case operation::bne:
+      _assembler.test(direct(zero_source), zero_source);
+      _assembler.jump(opcodes[instruction.code].instruction == operation::beq ? equal : not_equal, taken);
+      break;
+    case operation::bmi:
+    case operation::bpl:
+      _assembler.test(direct(negative_source), 0x80);
+      _assembler.jump(opcodes[instruction.code].instruction == operation::bmi ? not_equal : equal, taken);
+      break;
+    case operation::bcs:
+    case operation::bcc:
+      _assembler.movzx8(rcx, NES_FIELD(carry));
+      _assembler.test(direct(rcx), rcx);
+      _assembler.jump(opcodes[instruction.code].instruction == operation::bcs ? not_equal : equal, taken);
+      break;
+    default:
+      _assembler.movzx8(rcx, NES_FIELD(sum));
+      _assembler.movzx8(rax, NES_FIELD(addend));
+      _assembler.arithmetic(alu::xor_, direct(rax), rcx);
+      _assembler.movzx8(rdx, NES_FIELD(augend));
+      _assembler.arithmetic(alu::xor_, direct(rdx), rcx);
+      _assembler.arithmetic(alu::and_, direct(rax), rdx);
+      _assembler.test(direct(rax), 0x80);
+      _assembler.jump(opcodes[instruction.code].instruction == operation::bvs ? not_equal : equal, taken);
+      break;
+    }
+
+    _assembler.store16(NES_FIELD(program_counter), instruction.next);
+    _assembler.jump(_exit);
+    _assembler.bind(taken);
+    const auto penalty = 1 + (target.high() != instruction.next.high());
+    _assembler.arithmetic(alu::add, NES_FIELD(cycles), penalty, true);
+    _assembler.store16(NES_FIELD(program_counter), target);
+    _assembler.jump(_exit);
+  }
+
+  /**
+   *  Instructions without a native translation are performed by the
+   *  interpreter, with the register state synchronised through the context.
+   */
+  void callout(const recompiler::instruction &instruction) {
+    store_registers();
+    _assembler.store16(NES_FIELD(program_counter), instruction.next);
+    _assembler.mov(NES_FIELD(remaining), _remaining);
+    _assembler.mov64(direct(rdi), context);
+    _assembler.mov(direct(rsi), instruction.code);
+    _assembler.mov(direct(rdx), instruction.operand);
+    _assembler.call(NES_FIELD(callout));
+    load_registers();
+    check_version();
+    if (ends_block(instruction))
+      _assembler.jump(_exit);
+  }
+
+  auto translate(const recompiler::instruction &instruction) -> bool {
+    const auto &decoded = opcodes[instruction.code];
+    const auto memory = decoded.mode != addressing::accumulator;
+
+    switch (decoded.instruction) {
+    case operation::lda:
+    case operation::ldx:
+    case operation::ldy: {
+      const auto target = decoded.instruction == operation::lda ? accumulator
+                          : decoded.instruction == operation::ldx ? x_register
+                                                                  : y_register;
+      load(instruction);
+      transfer(rax, target);
+      return true;
+    }
+    case operation::sta:
+      store(instruction, accumulator);
+      return true;
+    case operation::stx:
+      store(instruction, x_register);
+      return true;
+    case operation::sty:
+      store(instruction, y_register);
+      return true;
+    case operation::tax:
+      transfer(accumulator, x_register);
+      return true;
+    case operation::tay:
+      transfer(accumulator, y_register);
+      return true;
+    case operation::txa:
+      transfer(x_register, accumulator);
+      return true;
+    case operation::tya:
+      transfer(y_register, accumulator);
+      return true;
+    case operation::inx:
+      step(x_register, true);
+      return true;
+    case operation::iny:
+      step(y_register, true);
+      return true;
+    case operation::dex:
+      step(x_register, false);
+      return true;
+    case operation::dey:
+      step(y_register, false);
+      return true;
+    case operation::inc:
+    case operation::dec: {
+      const auto increment = decoded.instruction == operation::inc;
+      modify(instruction, [&](reg r) { step(r, increment); });
+      return true;
+    }
+    case operation::and_:
+    case operation::ora:
+    case operation::eor:
+      load(instruction);
+      _assembler.arithmetic(decoded.instruction == operation::and_ ? alu::and_
+                            : decoded.instruction == operation::ora ? alu::or_
+                                                                    : alu::xor_,
+                            direct(accumulator), rax);
+      set_logical(accumulator);
+      return true;
+    case operation::adc:
+      if (_decimal_mode)
+        return false;
+      load(instruction);
+      add_with_carry();
+      return true;
+    case operation::sbc:
+      if (_decimal_mode)
+        return false;
+      load(instruction);
+      _assembler.arithmetic(alu::xor_, direct(rax), 0xff);
+      add_with_carry();
+      return true;
+    case operation::cmp:
+      load(instruction);
+      compare(accumulator);
+      return true;
+    case operation::cpx:
+      load(instruction);
+      compare(x_register);
+      return true;
+    case operation::cpy:
+      load(instruction);
+      compare(y_register);
+      return true;
+    case operation::bit:
+      load(instruction);
+      _assembler.mov(rdx, direct(accumulator));
+      _assembler.arithmetic(alu::and_, direct(rdx), rax);
+      _assembler.mov(direct(zero_source), rdx);
+      _assembler.mov(direct(negative_source), rax);
+      _assembler.arithmetic(alu::and_, direct(rax), 0x40);
+      _assembler.shl(rax, 1);
+      _assembler.store8(NES_FIELD(sum), rax);
+      _assembler.store8(NES_FIELD(addend), std::uint8_t{0});
+      _assembler.store8(NES_FIELD(augend), std::uint8_t{0});
+      return true;
+    case operation::asl:
+    case operation::lsr:
+    case operation::rol:
+    case operation::ror:
+      if (memory)
+        modify(instruction, [&](reg r) { shift(decoded.instruction, r); });
+      else
+        shift(decoded.instruction, accumulator);
+      return true;
+    case operation::clc:
+    case operation::sec:
+      _assembler.store8(NES_FIELD(carry), std::uint8_t{decoded.instruction == operation::sec});
+      return true;
+    case operation::clv:
+      _assembler.store8(NES_FIELD(addend), std::uint8_t{0});
+      _assembler.store8(NES_FIELD(augend), std::uint8_t{0});
+      _assembler.store8(NES_FIELD(sum), std::uint8_t{0});
+      return true;
+    case operation::bcc:
+    case operation::bcs:
+    case operation::beq:
+    case operation::bmi:
+    case operation::bne:
+    case operation::bpl:
+    case operation::bvc:
+    case operation::bvs:
+      branch(instruction);
+      return true;
+    case operation::jmp:
+      if (decoded.mode != addressing::absolute)
+        return false;
+      _assembler.store16(NES_FIELD(program_counter), instruction.operand);
+      _assembler.jump(_exit);
+      return true;
+    case operation::nop:
+      return decoded.mode == addressing::implied;
+    default:
+      return false;
+    }
+  }
+
+  const std::vector<recompiler::instruction> &_block;
+  int _version_index;
+  std::uint32_t _version;
+  bool _decimal_mode;
+  std::uint32_t _remaining = 0;
+  const recompiler::instruction *_current = nullptr;
+
+  assembler _assembler;
+  assembler::label _exit;
+  std::vector<early_exit> _early_exits;
+};
+
+#undef NES_FIELD
+} // namespace
+
+/**************************************************************************************************
+ *  Code buffer
+ */
+recompiler::~recompiler() {
+  if (_buffer != nullptr)
+    munmap(_buffer, capacity);
+}
+
+/**
+ *  The code buffer is mapped lazily, so that processors that never translate
+ *  anything do not reserve it. Code is written while the pages involved are
+ *  writable, and they are made executable again afterwards. Should either
+ *  change of protection fail, the block is not translated.
+ */
+auto recompiler::allocate(std::size_t size) -> std::uint8_t * {
+  if (_buffer == nullptr) {
+    const auto mapping = mmap(nullptr, capacity, PROT_READ | PROT_EXEC,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+      return nullptr;
+    _buffer = static_cast<std::uint8_t *>(mapping);
+  }
+
+  if (size > capacity)
+    return nullptr;
+  if (_used + size > capacity) {
+    _used = 0;
+    ++_generation;
+  }
+
+  const auto result = _buffer + _used;
+  _used += (size + 15) & ~std::size_t{15};
+  return result;
+}
+
+/**
+ *  Pages that failed to change protection may have changed it in part, so
+ *  code translated earlier into them is no longer safe to run either. All of
+ *  it is dropped, and the block that was being compiled is interpreted.
+ */
+auto recompiler::discard() -> native_block {
+  _used = 0;
+  ++_generation;
+  return nullptr;
+}
+
+auto recompiler::compile(const std::vector<instruction> &block,
+                         int version_index, std::uint32_t version)
+    -> native_block {
+  if (block.empty())
+    return nullptr;
+
+  auto translation = translator{block, version_index, version, _decimal_mode};
+  if (!translation.translate())
+    return nullptr;
+
+  const auto &code = translation.code();
+  const auto destination = allocate(code.size());
+  if (destination == nullptr)
+    return nullptr;
+
+  const auto page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = reinterpret_cast<std::uintptr_t>(destination) & ~(page_size - 1);
+  const auto end = reinterpret_cast<std::uintptr_t>(destination) + code.size();
+  const auto pages = reinterpret_cast<void *>(begin);
+  if (mprotect(pages, end - begin, PROT_READ | PROT_WRITE) != 0)
+    return discard();
+  std::memcpy(destination, code.data(), code.size());
+  if (mprotect(pages, end - begin, PROT_READ | PROT_EXEC) != 0)
+    return discard();
+
+  return reinterpret_cast<native_block>(destination);
+}
+#else
+recompiler::~recompiler() = default;
+
+auto recompiler::allocate(std::size_t) -> std::uint8_t * { return nullptr; }
+
+auto recompiler::discard() -> native_block { return nullptr; }
+
+auto recompiler::compile(const std::vector<instruction> &, int, std::uint32_t)
+    -> native_block {
+  return nullptr;
+}
+#endif
+} // namespace nes
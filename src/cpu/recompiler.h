@@ -0,0 +1,133 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Dynamic recompiler translating basic blocks of 6502 code into x86-64 code.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../byte.h"
+
+namespace nes {
+/**
+ *  State shared between the processor and recompiled code. While a native
+ *  block runs, the accumulator, index registers and zero and negative flag
+ *  sources live in host registers; they are only written back here when the
+ *  block exits or calls back into the processor.
+ *  The layout is fixed, as native code addresses the fields by offset.
+ *  A block's cycles are added to the count on entry; before each callback,
+ *  native code stores the cycles of the instructions after the current one
+ *  in remaining, so that the callback can tell the time of the access.
+ *  Writes return nonzero when an event has come due, such as an OAM DMA
+ *  requested by the write, upon which native code exits after the write.
+ */
+struct native_context {
+    std::uint8_t accumulator;
+    std::uint8_t x, y;
+    std::uint8_t zero, negative;
+    std::uint8_t carry;
+    std::uint8_t addend, augend, sum;
+    std::uint16_t program_counter;
+    std::uint32_t scratch;
+    std::uint32_t remaining;
+    std::int64_t cycles;
+
+    std::uint8_t* ram;
+    std::uint32_t* versions;
+    std::uint8_t* dirty;
+    void* host;
+    auto (*read)(native_context*, std::uint32_t address) -> std::uint32_t;
+    auto (*write)(native_context*, std::uint32_t address, std::uint32_t data) -> std::uint32_t;
+    void (*callout)(native_context*, std::uint32_t code, std::uint32_t operand);
+};
+
+
+/**
+ *  Translates pre-decoded basic blocks into native code.
+ *  Loads, stores, arithmetic, logic, flag operations and branches are
+ *  translated directly, with internal RAM accessed inline. Accesses to any
+ *  other page call back into the memory bus through the context, and all
+ *  remaining instructions call back into the interpreter.
+ *  Translated code is kept in a fixed-size code buffer that is flushed when
+ *  full; flushing bumps the generation, which invalidates all earlier blocks.
+ *  On hosts other than x86-64 no code is generated and compile() always
+ *  returns nullptr.
+ */
+class recompiler {
+public:
+    using native_block = void (*)(native_context*);
+
+    /**
+     *  One pre-decoded instruction of a block.
+     */
+    struct instruction {
+        std::uint8_t code;
+        word operand;
+        word next;
+        std::uint8_t cycles;
+    };
+
+#if defined(__x86_64__) && defined(__unix__)
+    static constexpr bool supported = true;
+#else
+    static constexpr bool supported = false;
+#endif
+
+    /**
+     *  For variants with a decimal mode, ADC and SBC are left to the
+     *  interpreter, which checks the decimal flag.
+     */
+    explicit recompiler(bool decimal_mode = false) noexcept :
+        _decimal_mode{decimal_mode}
+    {}
+
+    recompiler(const recompiler&) = delete;
+    auto operator=(const recompiler&) -> recompiler& = delete;
+    ~recompiler();
+
+    /**
+     *  Translates a block. Blocks in RAM check their page version after every
+     *  write and exit early if it changed, as they may have overwritten
+     *  themselves; version_index is negative for blocks that cannot be
+     *  written to. Returns nullptr if the block cannot be translated.
+     */
+    auto compile(const std::vector<instruction>& block, int version_index, std::uint32_t version) -> native_block;
+
+    constexpr auto generation() const noexcept -> std::uint32_t
+    {
+        return _generation;
+    }
+
+private:
+    static constexpr std::size_t capacity = 0x400000;
+
+    auto allocate(std::size_t size) -> std::uint8_t*;
+    auto discard() -> native_block;
+
+    bool _decimal_mode;
+    std::uint8_t* _buffer = nullptr;
+    std::size_t _used = 0;
+    std::uint32_t _generation = 1;
+};
+}
@@ -0,0 +1,47 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Variants of the 6502 processor family.
+ */
+
+#pragma once
+
+namespace nes {
+/**
+ *  Variant policies select behaviour that differs between 6502 variants at
+ *  compile time, so that a variant pays nothing for features it lacks.
+ *
+ *  The Ricoh 2A03 used in the NES has its decimal mode disabled: the decimal
+ *  flag can still be set, cleared and pushed, but ADC and SBC always operate
+ *  in binary.
+ */
+struct ricoh_2a03 {
+    static constexpr bool decimal_mode = false;
+};
+
+/**
+ *  The original NMOS 6502 performs BCD arithmetic in ADC and SBC when the
+ *  decimal flag is set, with the NMOS flag behaviour: see decimal_adc() and
+ *  decimal_sbc() in instruction.cpp.
+ */
+struct mos_6502 {
+    static constexpr bool decimal_mode = true;
+};
+}
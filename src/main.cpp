@@ -42,6 +42,7 @@ int main() {
     segment2 seg2;
 
     auto mem = memory_type{seg1, seg2};
+    mem.remap();
 
     std::cout << mem.read(word{0xff}) << '\n';
     mem.write(word{0xff}, byte{0xfe});
@@ -0,0 +1,77 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace nes {
+/**
+ *  Tracks which 256-byte pages of a memory have been written since the last
+ *  snapshot, so that savestates and rewind only copy the pages that changed.
+ *  Every page has a byte of its own rather than a bit, so that marking one
+ *  is a single store, without reading the map first; native code marks
+ *  pages directly through data().
+ */
+template<std::size_t pages>
+class dirty_map {
+public:
+    constexpr void mark(std::size_t page) noexcept
+    {
+        _pages[page] = 1;
+    }
+
+    constexpr bool dirty(std::size_t page) const noexcept
+    {
+        return _pages[page] != 0;
+    }
+
+    /**
+     *  Returns the pages written since the last snapshot, and starts a new one.
+     */
+    constexpr auto snapshot() noexcept -> dirty_map
+    {
+        const auto result = *this;
+        _pages = {};
+        return result;
+    }
+
+    constexpr auto data() noexcept -> std::uint8_t*
+    {
+        return _pages.data();
+    }
+
+    static constexpr auto size() noexcept -> std::size_t
+    {
+        return pages;
+    }
+
+private:
+    std::array<std::uint8_t, pages> _pages = {};
+};
+
+static_assert([] {
+    auto map = dirty_map<8>{};
+    map.mark(3);
+    const auto taken = map.snapshot();
+    return taken.dirty(3) && !taken.dirty(2) && !map.dirty(3);
+}());
+}
@@ -19,33 +19,70 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #include "../byte.h"
+#include "dirty.h"
 #include "segment.h"
+#include "span.h"
 
 namespace nes {
+/**
+ *  Kinds of access that can be watched, as bits of the per-page flags.
+ */
+enum class watchpoint : std::uint8_t {
+    read = 0x1,
+    write = 0x2,
+    execute = 0x4,
+};
+
+constexpr auto flag(watchpoint type) noexcept -> std::uint8_t
+{
+    return static_cast<std::uint8_t>(type);
+}
+
+
 /*
  *  Generalised memory management class.
- *  Checks all member devices upon memory access.
+ *  Accesses are decoded through a page table of 256 pages of 256 bytes each.
+ *  Pages backed by plain memory, such as RAM and ROM, point directly at the
+ *  host memory behind them, so that accessing them is a single indexed load
+ *  or store. All other pages hold the handler slot of the device that owns
+ *  them. Pages shared by several devices, or by none, fall back to checking
+ *  all member devices upon access.
+ *
+ *  Devices expose their plain memory by providing read_page() and
+ *  write_page(), returning the host memory behind the 256-byte page at the
+ *  given address, or nullptr if that page must go through the device.
+ *
+ *  The page table is only built by remap(), which must be called once all
+ *  devices exist, as the bus may be built before some of them are; until
+ *  then, every access checks all devices.
+ *
+ *  Watchpoints are tracked as flags per page. Watching a page swaps its entry
+ *  for the watch slot, which checks the watched addresses before forwarding
+ *  the access, so that pages without watchpoints keep the fast path.
  */
 template<typename... Devices>
 class memory {
 public:
     constexpr memory(Devices&... devices) :
-        _devices{std::forward_as_tuple(devices...)} {}
-
-    constexpr auto read(word address) const -> byte {
-        return read_helper<0>(address);
+        _devices{std::forward_as_tuple(devices...)}
+    {
+        static_assert(disjoint(), "Device address ranges overlap");
     }
 
-    constexpr void write(word address, byte data) {
-        write_helper<0>(address, data);
-    }
-
-    constexpr auto access(word access) const -> reference {
-        return reference{*this, address};
-    }
+    class pointer;
 
     /**
      *  Due to memory mapping and bank switching, normal references cannot be used.
@@ -62,10 +99,7 @@ public:
         }
 
         constexpr operator word() const {
-            return word{
-                _host.read(_address),
-                _host.read(word{_address + 1})
-            };
+            return _host.read_word(_address);
         }
 
         constexpr auto operator=(byte data) -> reference& {
@@ -79,8 +113,8 @@ public:
             return *this;
         }
 
-        constexpr auto pointer() const -> pointer {
-            return pointer{_host, _address};
+        constexpr auto pointer() const -> memory::pointer {
+            return memory::pointer{_host, _address};
         }
 
     private:
@@ -121,18 +155,482 @@ public:
         memory& _host;
         word _address;
     };
-    
+
+
+    constexpr auto read(word address) const -> byte {
+        const auto& entry = _pages[address >> 8];
+        if (entry.read != nullptr) return entry.read[address & 0xff];
+        return (this->*readers[entry.device])(address);
+    }
+
+    /**
+     *  Reads from the device mapped at the given address without notifying
+     *  watchpoints, for fetching code ahead of its execution. Only meant for
+     *  memory that reads without side effects.
+     */
+    constexpr auto peek(word address) const -> byte {
+        const auto& entry = _mapped[address >> 8];
+        if (entry.read != nullptr) return entry.read[address & 0xff];
+        return (this->*readers[entry.device])(address);
+    }
+
+    /**
+     *  Reads a little-endian word. If both bytes lie in the same page of plain
+     *  memory, they are read from host memory at once, which compilers merge
+     *  into a single unaligned load. read_word_wrapped() takes the high byte
+     *  from the start of the same page if the low byte ends it, as the 6502
+     *  does for JMP ($xxff) and for pointers in the zero page.
+     */
+    constexpr auto read_word(word address) const -> word {
+        const auto& entry = _pages[address >> 8];
+        const auto offset = address & 0xff;
+        if (entry.read != nullptr && offset != 0xff) {
+            return word{entry.read[offset + 1], entry.read[offset]};
+        }
+        return word{read(word{address + 1}), read(address)};
+    }
+
+    constexpr auto read_word_wrapped(word address) const -> word {
+        const auto& entry = _pages[address >> 8];
+        const auto offset = address & 0xff;
+        if (entry.read != nullptr && offset != 0xff) {
+            return word{entry.read[offset + 1], entry.read[offset]};
+        }
+        return word{read(word{address.high(), byte{offset + 1}}), read(address)};
+    }
+
+    constexpr void write(word address, byte data) {
+        const auto& entry = _pages[address >> 8];
+        if (entry.write != nullptr) {
+            entry.write[address & 0xff] = data;
+            _dirty.mark(entry.dirty);
+        } else {
+            (this->*writers[entry.device])(address, data);
+        }
+    }
+
+    /**
+     *  Reads from an address known to lie within [first, last) are decoded
+     *  at compile time, if a single device's static range covers all of it.
+     *  Such reads, as from the zero page, call the device directly. Writes
+     *  are always decoded through the page table, which marks the dirty map.
+     */
+    template<std::uint32_t first, std::uint32_t last>
+    constexpr auto read_within(word address) const -> byte {
+        constexpr auto owner = decode(first, last);
+        if constexpr (owner < device_count) {
+            if (_watched_pages[address >> 8] != 0) return read(address);
+            return read_device<owner>(address);
+        } else {
+            return read(address);
+        }
+    }
+
+    /**
+     *  Bulk transfers, as for DMA and savestates. Pages of plain memory are
+     *  copied at once, all others byte by byte through their device. Writes
+     *  bypass the processor, so it must invalidate any code decoded from the
+     *  written range itself.
+     */
+    void read_block(word address, span<byte> destination) const {
+        for (auto offset = std::ptrdiff_t{0}; offset < destination.size();) {
+            const auto current = word{address + offset};
+            const auto count = std::min<std::ptrdiff_t>(destination.size() - offset, 0x100 - (current & 0xff));
+            const auto& entry = _pages[current >> 8];
+            if (entry.read != nullptr) {
+                std::copy_n(entry.read + (current & 0xff), count, destination.data() + offset);
+            } else {
+                for (auto i = std::ptrdiff_t{0}; i < count; ++i)
+                    destination[offset + i] = read(word{current + i});
+            }
+            offset += count;
+        }
+    }
+
+    void write_block(word address, span<const byte> source) {
+        for (auto offset = std::ptrdiff_t{0}; offset < source.size();) {
+            const auto current = word{address + offset};
+            const auto count = std::min<std::ptrdiff_t>(source.size() - offset, 0x100 - (current & 0xff));
+            const auto& entry = _pages[current >> 8];
+            if (entry.write != nullptr) {
+                std::copy_n(source.data() + offset, count, entry.write + (current & 0xff));
+                _dirty.mark(entry.dirty);
+            } else {
+                for (auto i = std::ptrdiff_t{0}; i < count; ++i)
+                    write(word{current + i}, source[offset + i]);
+            }
+            offset += count;
+        }
+    }
+
+    /**
+     *  Direct access to a member device, for transfers that bypass the bus.
+     */
+    template<typename Device>
+    constexpr auto device() -> Device& {
+        return std::get<std::reference_wrapper<Device>>(_devices).get();
+    }
+
+    constexpr auto access(word address) -> reference {
+        return reference{*this, address};
+    }
+
+    /**
+     *  Devices that keep their own time, such as the PPU, are not run in
+     *  lockstep with the processor. Instead they are caught up to the clock,
+     *  the processor's cycle count, just before each access to them, and to
+     *  a given timestamp when the processor delivers an event.
+     */
+    constexpr void clock(const std::int64_t& timestamp) noexcept {
+        _clock = &timestamp;
+    }
+
+    constexpr void synchronize(std::int64_t timestamp) const {
+        synchronize_helper<0>(timestamp);
+    }
+
+    /**
+     *  Identifies the bank mapped at the given address, for devices that
+     *  support bank switching. Devices without banks always report bank 0.
+     */
+    constexpr auto bank(word address) const -> std::uint32_t {
+        return (this->*banks[_pages[address >> 8].device])(address);
+    }
+
+    /**
+     *  Reports whether reads from the given address settle: once it has been
+     *  read, reading it again returns the same value and changes nothing,
+     *  until the next scheduled event. Devices that do not say so are assumed
+     *  not to.
+     */
+    constexpr auto idempotent(word address) const -> bool {
+        return idempotent_helper<0>(address);
+    }
+
+    /**
+     *  Rebuilds the page table. Must be called whenever a device changes
+     *  the host memory behind its pages, such as on a bank switch.
+     */
+    void remap() {
+        for (auto index = 0u; index < page_count; ++index) {
+            _mapped[index] = map_helper<0>(word{index << 8});
+            _mapped[index].dirty = index;
+            for (auto mirror = 0u; mirror < index; ++mirror) {
+                if (_mapped[index].write != nullptr && _mapped[mirror].write == _mapped[index].write) {
+                    _mapped[index].dirty = mirror;
+                    break;
+                }
+            }
+            protect(index);
+        }
+        update_watched();
+    }
+
+    /**
+     *  Writes to plain memory pages mark them in the dirty map, by the first
+     *  page that maps the same memory, so that all mirrors of a page share
+     *  one entry. That includes writes that reach plain memory through its
+     *  device's handler, as on pages that no single device owns. Devices
+     *  with memory of their own, such as the PPU's OAM, track it themselves.
+     *  Native code marks the map directly.
+     */
+    constexpr auto dirty() noexcept -> dirty_map<0x100>& {
+        return _dirty;
+    }
+
+    /**
+     *  Watchpoints report accesses to the given address to the watch handler,
+     *  before writes and after reads take place. Execute watchpoints are
+     *  reported by the processor, as only it knows what it fetches opcodes
+     *  from.
+     */
+    using watch_handler = std::function<void(watchpoint, word, byte)>;
+
+    void watch(word address, watchpoint type) {
+        _watchpoints[address] |= flag(type);
+        _watched_pages[address >> 8] |= flag(type);
+        protect(address >> 8);
+        update_watched();
+    }
+
+    void unwatch(word address, watchpoint type) {
+        const auto found = _watchpoints.find(address);
+        if (found == _watchpoints.end()) return;
+        found->second &= ~flag(type);
+        if (found->second == 0) _watchpoints.erase(found);
+
+        const auto index = static_cast<std::size_t>(address >> 8);
+        _watched_pages[index] = 0;
+        for (const auto& [watched, flags] : _watchpoints) {
+            if (watched >> 8 == index) _watched_pages[index] |= flags;
+        }
+        protect(index);
+        update_watched();
+    }
+
+    void on_watch(watch_handler handler) {
+        _on_watch = std::move(handler);
+    }
+
+    /**
+     *  Whether any address in the page of the given address is watched.
+     */
+    constexpr bool watching(word address, watchpoint type) const noexcept {
+        return _watched_pages[address >> 8] & flag(type);
+    }
+
+    /**
+     *  Whether any address at all is watched.
+     */
+    constexpr bool watching(watchpoint type) const noexcept {
+        return _watched & flag(type);
+    }
+
+    void notify(watchpoint type, word address, byte data) const {
+        const auto found = _watchpoints.find(address);
+        if (found != _watchpoints.end() && (found->second & flag(type)) && _on_watch) {
+            _on_watch(type, address, data);
+        }
+    }
+
 private:
     using Tuple = std::tuple<std::reference_wrapper<Devices>...>;
     static constexpr auto device_count = std::tuple_size_v<Tuple>;
+    static constexpr std::size_t page_count = 0x100;
+
+    /**
+     *  Handler slots are numbered after the devices; the slot after the last
+     *  device checks all devices, for pages that no single device owns, and
+     *  the one after that checks watchpoints.
+     */
+    static constexpr std::uint8_t shared_slot = device_count;
+    static constexpr std::uint8_t watch_slot = device_count + 1;
+
+    struct page {
+        const byte* read = nullptr;
+        byte* write = nullptr;
+        std::uint8_t device = shared_slot;
+        std::uint8_t dirty = 0;
+    };
+
+    using read_handler = auto (memory::*)(word) const -> byte;
+    using write_handler = void (memory::*)(word, byte);
+    using bank_handler = auto (memory::*)(word) const -> std::uint32_t;
+    using read_table = std::array<read_handler, device_count + 2>;
+    using write_table = std::array<write_handler, device_count + 2>;
+    using bank_table = std::array<bank_handler, device_count + 2>;
+
+    template<std::size_t... index>
+    static constexpr auto make_readers(std::index_sequence<index...>) {
+        return read_table{&memory::read_device<index>..., &memory::read_helper<0>, &memory::read_watched};
+    }
+
+    template<std::size_t... index>
+    static constexpr auto make_writers(std::index_sequence<index...>) {
+        return write_table{&memory::write_device<index>..., &memory::write_helper<0>, &memory::write_watched};
+    }
+
+    template<std::size_t... index>
+    static constexpr auto make_banks(std::index_sequence<index...>) {
+        return bank_table{&memory::bank_device<index>..., &memory::bank_helper<0>, &memory::bank_watched};
+    }
+
+    static const read_table readers;
+    static const write_table writers;
+    static const bank_table banks;
+
+    template<auto depth>
+    constexpr auto read_device(word address) const -> byte {
+        catch_up<depth>();
+        return std::get<depth>(_devices).get().read(address);
+    }
+
+    template<auto depth>
+    constexpr void write_device(word address, byte data) {
+        using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+        catch_up<depth>();
+        auto& target = std::get<depth>(_devices).get();
+        target.write(address, data);
+        if constexpr (has_write_page<device>::value) {
+            if (target.write_page(word{address & 0xff00}) != nullptr) _dirty.mark(_mapped[address >> 8].dirty);
+        }
+        refresh<depth>();
+    }
+
+    template<typename Device, typename = void>
+    struct has_remapping : std::false_type {};
+
+    template<typename Device>
+    struct has_remapping<Device, std::void_t<decltype(std::declval<Device&>().remapped())>> : std::true_type {};
+
+    /**
+     *  Devices that switch banks on writes report the addresses whose memory
+     *  moved, of which only the pages they own are updated; everything else
+     *  about those pages stays as it was mapped.
+     */
+    template<auto depth>
+    void refresh() {
+        using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+        if constexpr (has_remapping<device>::value) {
+            auto& target = std::get<depth>(_devices).get();
+            const auto moved = target.remapped();
+            for (auto index = moved.begin >> 8; index < (moved.end + 0xff) >> 8; ++index) {
+                if (_mapped[index].device != depth) continue;
+                const auto base = word{index << 8};
+                if constexpr (has_read_page<device>::value) _mapped[index].read = std::as_const(target).read_page(base);
+                if constexpr (has_write_page<device>::value) _mapped[index].write = target.write_page(base);
+                protect(index);
+            }
+        }
+    }
+
+    template<auto depth>
+    constexpr auto bank_device(word address) const -> std::uint32_t {
+        using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+        if constexpr (has_banks<device>::value) {
+            return std::get<depth>(_devices).get().bank(address);
+        } else {
+            return 0;
+        }
+    }
+
+    /**
+     *  Pages with read or write watchpoints go through the watch slot, which
+     *  forwards accesses to the page as mapped.
+     */
+    void protect(std::size_t index) {
+        auto entry = _mapped[index];
+        const auto flags = _watched_pages[index];
+        if (flags & (flag(watchpoint::read) | flag(watchpoint::write))) {
+            if (flags & flag(watchpoint::read)) entry.read = nullptr;
+            if (flags & flag(watchpoint::write)) entry.write = nullptr;
+            entry.device = watch_slot;
+        }
+        _pages[index] = entry;
+    }
+
+    void update_watched() {
+        _watched = 0;
+        for (const auto flags : _watched_pages) _watched |= flags;
+    }
+
+    auto read_watched(word address) const -> byte {
+        const auto& entry = _mapped[address >> 8];
+        const auto data = entry.read != nullptr ? entry.read[address & 0xff] : (this->*readers[entry.device])(address);
+        if (watching(address, watchpoint::read)) notify(watchpoint::read, address, data);
+        return data;
+    }
+
+    void write_watched(word address, byte data) {
+        if (watching(address, watchpoint::write)) notify(watchpoint::write, address, data);
+        const auto& entry = _mapped[address >> 8];
+        if (entry.write != nullptr) {
+            entry.write[address & 0xff] = data;
+            _dirty.mark(entry.dirty);
+        } else {
+            (this->*writers[entry.device])(address, data);
+        }
+    }
+
+    auto bank_watched(word address) const -> std::uint32_t {
+        return (this->*banks[_mapped[address >> 8].device])(address);
+    }
+
+    template<typename Device, typename = void>
+    struct has_range : std::false_type {};
+
+    template<typename Device>
+    struct has_range<Device, std::void_t<decltype(Device::range)>> : std::true_type {};
+
+    /**
+     *  Static address ranges of the devices, in order. Devices that do not
+     *  declare a range are decoded at run time only.
+     */
+    template<typename Device>
+    static constexpr auto range_of() -> std::optional<address_range> {
+        if constexpr (has_range<Device>::value) return Device::range;
+        else return std::nullopt;
+    }
+
+    static constexpr std::array<std::optional<address_range>, device_count> ranges = {range_of<Devices>()...};
+
+    static constexpr bool disjoint() {
+        for (auto i = 0u; i < device_count; ++i) {
+            for (auto j = i + 1; j < device_count; ++j) {
+                if (ranges[i] && ranges[j] && ranges[i]->overlaps(*ranges[j])) return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     *  Index of the device whose static range covers all of [first, last),
+     *  or device_count if that cannot be told at compile time. A device
+     *  without a static range before it might claim the addresses first.
+     */
+    static constexpr auto decode(std::uint32_t first, std::uint32_t last) -> std::size_t {
+        for (auto i = 0u; i < device_count; ++i) {
+            if (!ranges[i]) return device_count;
+            if (ranges[i]->covers(first, last)) return i;
+            if (ranges[i]->overlaps(address_range{first, last})) return device_count;
+        }
+        return device_count;
+    }
+
+    template<typename Device, typename = void>
+    struct has_read_page : std::false_type {};
+
+    template<typename Device>
+    struct has_read_page<Device, std::void_t<decltype(std::declval<const Device&>().read_page(word{}))>> : std::true_type {};
+
+    template<typename Device, typename = void>
+    struct has_write_page : std::false_type {};
+
+    template<typename Device>
+    struct has_write_page<Device, std::void_t<decltype(std::declval<Device&>().write_page(word{}))>> : std::true_type {};
+
+    /**
+     *  Index of the first device that contains the given address, which is
+     *  the device that the linear scan would pick.
+     */
+    template<auto depth>
+    constexpr auto owner_helper(word address) const -> std::size_t {
+        if constexpr (depth == device_count) {
+            return device_count;
+        } else {
+            if (std::get<depth>(_devices).get().contains(address)) return depth;
+            else return owner_helper<depth + 1>(address);
+        }
+    }
+
+    template<auto depth>
+    constexpr auto map_helper(word base) const -> page {
+        if constexpr (depth == device_count) {
+            return page{};
+        } else {
+            if (owner_helper<0>(base) != depth) return map_helper<depth + 1>(base);
+
+            for (auto offset = 1u; offset < 0x100; ++offset) {
+                if (owner_helper<0>(word{base + offset}) != depth) return page{};
+            }
+
+            using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+            auto& target = std::get<depth>(_devices).get();
+            auto result = page{nullptr, nullptr, depth};
+            if constexpr (has_read_page<device>::value) result.read = std::as_const(target).read_page(base);
+            if constexpr (has_write_page<device>::value) result.write = target.write_page(base);
+            return result;
+        }
+    }
 
     template<auto depth>
     constexpr auto read_helper(word address) const -> byte {
         if constexpr (depth == device_count) {
-            throw std::runtime_error{"Unhandled memory read at address: " + address};
+            throw std::runtime_error{"Unhandled memory read at address: " + std::to_string(address)};
             return byte{0x00};
         } else {
             if (std::get<depth>(_devices).get().contains(address)) {
+                catch_up<depth>();
                 return std::get<depth>(_devices).get().read(address);
             } else {
                 return read_helper<depth + 1>(address);
@@ -143,18 +641,113 @@ private:
     template<auto depth>
     constexpr void write_helper(word address, byte data) {
         if constexpr (depth == device_count) {
-            throw std::runtime_error{"Unhandled memory write at addres: " + address};
+            throw std::runtime_error{"Unhandled memory write at address: " + std::to_string(address)};
             return;
         }
         else {
             if (std::get<depth>(_devices).get().contains(address)) {
-                return std::get<depth>(_devices).get().write(address, data);
+                write_device<depth>(address, data);
             } else {
                 return write_helper<depth + 1>(address, data);
             }
         }
     }
 
+    template<typename Device, typename = void>
+    struct has_clock : std::false_type {};
+
+    template<typename Device>
+    struct has_clock<Device, std::void_t<decltype(std::declval<Device&>().catch_up(std::int64_t{}))>> : std::true_type {};
+
+    template<auto depth>
+    constexpr void catch_up() const {
+        using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+        if constexpr (has_clock<device>::value) {
+            if (_clock != nullptr) {
+                std::get<depth>(_devices).get().catch_up(*_clock);
+            }
+        }
+    }
+
+    template<auto depth>
+    constexpr void synchronize_helper(std::int64_t timestamp) const {
+        if constexpr (depth < device_count) {
+            using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+            if constexpr (has_clock<device>::value) {
+                std::get<depth>(_devices).get().catch_up(timestamp);
+            }
+            synchronize_helper<depth + 1>(timestamp);
+        }
+    }
+
+    template<typename Device, typename = void>
+    struct has_banks : std::false_type {};
+
+    template<typename Device>
+    struct has_banks<Device, std::void_t<decltype(std::declval<const Device&>().bank(word{}))>> : std::true_type {};
+
+    template<auto depth>
+    constexpr auto bank_helper(word address) const -> std::uint32_t {
+        if constexpr (depth == device_count) {
+            return 0;
+        } else {
+            using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+            if (std::get<depth>(_devices).get().contains(address)) {
+                if constexpr (has_banks<device>::value) {
+                    return std::get<depth>(_devices).get().bank(address);
+                } else {
+                    return 0;
+                }
+            } else {
+                return bank_helper<depth + 1>(address);
+            }
+        }
+    }
+
+    template<typename Device, typename = void>
+    struct has_idempotence : std::false_type {};
+
+    template<typename Device>
+    struct has_idempotence<Device, std::void_t<decltype(std::declval<const Device&>().idempotent(word{}))>> : std::true_type {};
+
+    template<auto depth>
+    constexpr auto idempotent_helper(word address) const -> bool {
+        if constexpr (depth == device_count) {
+            return false;
+        } else {
+            using device = std::tuple_element_t<depth, std::tuple<Devices...>>;
+            if (std::get<depth>(_devices).get().contains(address)) {
+                if constexpr (has_idempotence<device>::value) {
+                    return std::get<depth>(_devices).get().idempotent(address);
+                } else {
+                    return false;
+                }
+            } else {
+                return idempotent_helper<depth + 1>(address);
+            }
+        }
+    }
+
     Tuple _devices;
+    std::array<page, page_count> _pages = {};
+    std::array<page, page_count> _mapped = {};
+    std::array<std::uint8_t, page_count> _watched_pages = {};
+    std::uint8_t _watched = 0;
+    std::unordered_map<std::uint16_t, std::uint8_t> _watchpoints;
+    dirty_map<0x100> _dirty;
+    watch_handler _on_watch;
+    const std::int64_t* _clock = nullptr;
 };
+
+template<typename... Devices>
+const typename memory<Devices...>::read_table memory<Devices...>::readers =
+    memory<Devices...>::make_readers(std::index_sequence_for<Devices...>{});
+
+template<typename... Devices>
+const typename memory<Devices...>::write_table memory<Devices...>::writers =
+    memory<Devices...>::make_writers(std::index_sequence_for<Devices...>{});
+
+template<typename... Devices>
+const typename memory<Devices...>::bank_table memory<Devices...>::banks =
+    memory<Devices...>::make_banks(std::index_sequence_for<Devices...>{});
 }
\ No newline at end of file
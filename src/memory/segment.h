@@ -19,12 +19,42 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 
 #include "../byte.h"
 #include "span.h"
 
 namespace nes {
+/**
+ *  Half-open range of global addresses, [begin, end), occupied by a device.
+ *  Devices that declare their range statically allow the memory bus to
+ *  decode accesses to them at compile time.
+ */
+struct address_range {
+    std::uint32_t begin, end;
+
+    constexpr bool contains(word address) const noexcept
+    {
+        return address >= begin && address < end;
+    }
+
+    constexpr bool covers(std::uint32_t first, std::uint32_t last) const noexcept
+    {
+        return first >= begin && last <= end;
+    }
+
+    constexpr bool overlaps(const address_range& other) const noexcept
+    {
+        return begin < other.end && other.begin < end;
+    }
+};
+
+static_assert(address_range{0x0000, 0x2000}.covers(0x0000, 0x0100));
+static_assert(!address_range{0x2000, 0x4000}.overlaps(address_range{0x4000, 0x4020}));
+
+
 /**
  *  Address wrapping implementation of a memory span.
  *  Used as view into a memory segment.
@@ -32,7 +62,7 @@ namespace nes {
 class segment_view {
 public:
 	explicit constexpr segment_view(span<byte> segment, word begin, word size) :
-        _segment{segment}, _begin{begin}, _size{size} {}
+        _segment{segment}, _begin{begin}, _size{size}, _mask{make_mask(segment.size(), size)} {}
 
     /**
      *  Accessors using global address
@@ -49,6 +79,33 @@ public:
         _segment[index] = data;
     }
 
+    /**
+     *  Bulk accessors using global address. Blocks that do not wrap around
+     *  the end of the segment are copied at once.
+     */
+    void read_block(word address, span<byte> destination) const
+    {
+        const auto index = compute_index(address);
+        if (index + destination.size() <= _segment.size()) {
+            std::copy_n(_segment.data() + index, destination.size(), destination.data());
+        } else {
+            for (auto offset = std::ptrdiff_t{0}; offset < destination.size(); ++offset)
+                destination[offset] = read(word{address + offset});
+        }
+    }
+
+    void write_block(word address, span<const byte> source)
+    {
+        const auto index = compute_index(address);
+        if (index + source.size() <= _segment.size()) {
+            std::copy_n(source.data(), source.size(), _segment.data() + index);
+        } else {
+            for (auto offset = std::ptrdiff_t{0}; offset < source.size(); ++offset)
+                write(word{address + offset}, source[offset]);
+        }
+    }
+
+
     /**
      *  Accessors using local address
      */
@@ -63,6 +120,26 @@ public:
     }
 
 
+    /**
+     *  Direct access to the underlying storage.
+     */
+    constexpr auto data() const noexcept -> byte*
+    {
+        return _segment.data();
+    }
+
+
+    /**
+     *  Host memory behind the 256-byte page containing the given address.
+     *  Only meaningful for views that begin on a page boundary and span
+     *  whole pages.
+     */
+    constexpr auto page(word address) const noexcept -> byte*
+    {
+        return _segment.data() + compute_index(word{address & 0xff00});
+    }
+
+
     /**
      *  Returns a subspan of the segment view.
      */
@@ -82,13 +159,29 @@ public:
     }
 
 private:
+    /**
+     *  Mirroring is implemented by masking the offset into the segment where
+     *  possible. Views that do not mirror use a mask that keeps every bit;
+     *  only mirrored views of a size other than a power of two take the
+     *  modulo, for which the mask is zero.
+     */
+    static constexpr auto make_mask(std::ptrdiff_t size, std::ptrdiff_t window) noexcept -> std::ptrdiff_t
+    {
+        if (window <= size) return -1;
+        if ((size & (size - 1)) == 0) return size - 1;
+        return 0;
+    }
+
     constexpr auto compute_index(word address) const noexcept -> std::ptrdiff_t
     {
-        return (address - _begin) % _segment.size();
+        const auto offset = static_cast<std::ptrdiff_t>(address - _begin);
+        if (_mask != 0) return offset & _mask;
+        return offset % _segment.size();
     }
 
     span<byte> _segment;
     word _begin, _size;
+    std::ptrdiff_t _mask;
 };
 
 
@@ -105,7 +198,7 @@ public:
      */
     constexpr auto view() -> segment_view
     {
-        return segment_view{span<byte>{_storage}, word{begin}, word{end}};
+        return segment_view{span<byte>{_storage}, word{begin}, word{end - begin}};
     }
 
 
@@ -129,21 +222,61 @@ public:
      *  Returns whether or not the memory segment's address space contains
      *  the address given.
      */
+    static constexpr address_range range{begin, end};
+
     static constexpr bool contains(word address) noexcept
     {
-        return address >= begin && address < end;
+        return range.contains(address);
+    }
+
+
+    /**
+     *  Host memory behind the 256-byte page containing the given address,
+     *  or nullptr if the segment does not consist of whole pages.
+     */
+    constexpr auto page(word address) noexcept -> byte*
+    {
+        if constexpr (paged) return _storage.data() + compute_index(word{address & 0xff00});
+        else return nullptr;
+    }
+
+    constexpr auto page(word address) const noexcept -> const byte*
+    {
+        if constexpr (paged) return _storage.data() + compute_index(word{address & 0xff00});
+        else return nullptr;
     }
 
 
 private:
+    static constexpr bool paged = begin % 0x100 == 0 && size % 0x100 == 0;
+
     /**
      *  Converts the global address into the index for array access.
+     *  Segments that do not mirror need no reduction, and those mirrored
+     *  with a power of two size are reduced by masking.
      */
     static constexpr auto compute_index(word address) noexcept -> std::ptrdiff_t
     {
-        return (address - begin) % size;
+        const auto offset = static_cast<std::ptrdiff_t>(address - begin);
+        if constexpr (end - begin <= size) return offset;
+        else if constexpr ((size & (size - 1)) == 0) return offset & (size - 1);
+        else return offset % size;
     }
 
     std::array<byte, size> _storage;
 };
-}
\ No newline at end of file
+
+static_assert([] {
+    auto storage = std::array<byte, 0x800>{};
+    auto view = segment_view{span<byte>{storage}, word{0x0000}, word{0x2000}};
+    view.write(word{0x1801}, byte{0x12});
+    return storage[0x001] == byte{0x12} && view.read(word{0x0801}) == byte{0x12};
+}());
+
+static_assert([] {
+    auto memory = segment<0x1800, 0x6000, 0x7800>{};
+    auto view = memory.view();
+    view.write(word{0x77ff}, byte{0x34});
+    return view.contains(word{0x77ff}) && !view.contains(word{0x7800}) && view[0x17ff] == byte{0x34};
+}());
+}
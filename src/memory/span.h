@@ -23,7 +23,7 @@
 #include <iterator>
 #include <type_traits>
 
-#include "byte.h"
+#include "../byte.h"
 
 namespace nes {
 namespace detail {
@@ -19,13 +19,259 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "../byte.h"
+#include "../cartridge/cartridge.h"
+#include "../memory/dirty.h"
+#include "../memory/segment.h"
+#include "../memory/span.h"
+#include "../scheduler.h"
+
 namespace nes {
+/**
+ *  The PPU is not stepped alongside the processor. It keeps the timestamp it
+ *  has been emulated up to, and is caught up by the memory bus whenever the
+ *  processor accesses its registers, or when an event is delivered. The
+ *  points at which its state changes visibly to the program are scheduled
+ *  as events, so that the processor stops there to catch it up.
+ *  The cartridge is told when the dot at which the PPU address line A12
+ *  rises changes, which is all that scanline counters need of rendering.
+ */
 class ppu {
 public:
-    auto read(word address) const -> byte { return byte{0}; }
-    void write(word address, byte data) {}
+    /**
+     *  Connects the PPU to the scheduler through which it raises the vblank
+     *  NMI and announces the changes of its status flags.
+     */
+    constexpr void connect(scheduler& events) noexcept
+    {
+        _events = &events;
+        reschedule();
+    }
+
+    /**
+     *  Connects the PPU to the cartridge on its address bus.
+     */
+    constexpr void connect(cartridge& board) noexcept
+    {
+        _cartridge = &board;
+        retime();
+    }
+
+    /**
+     *  Emulates the PPU up to the given timestamp, in CPU cycles.
+     */
+    constexpr void catch_up(std::int64_t timestamp) noexcept
+    {
+        const auto dot = timestamp * dots_per_cycle;
+        if (dot <= _dot) return;
+
+        const auto set = last(vblank_start, dot);
+        const auto cleared = last(vblank_end, dot);
+        if (cleared > _dot) _status &= ~(vblank_flag | sprite_zero_flag | overflow_flag);
+        if (set > _dot && set > cleared) _status |= vblank_flag;
+        _dot = dot;
+        reschedule();
+    }
+
+    constexpr auto read(word address) -> byte
+    {
+        switch (address & 0x7) {
+        case 0x2: {
+            const auto result = byte{(_status & 0xe0) | (_latch & 0x1f)};
+            _status &= ~vblank_flag;
+            _write_toggle = false;
+            _latch = result;
+            return result;
+        }
+        case 0x4:
+            _latch = _oam[_oam_address];
+            return byte{_latch};
+        default:
+            return byte{_latch};
+        }
+    }
+
+    constexpr void write(word address, byte data)
+    {
+        _latch = data;
+        switch (address & 0x7) {
+        case 0x0: {
+            const auto enabled = nmi_enabled();
+            _control = data;
+            if (!enabled && nmi_enabled() && (_status & vblank_flag) && _events != nullptr) {
+                _events->schedule(event::vblank_nmi, cycle(_dot));
+            }
+            reschedule();
+            retime();
+            break;
+        }
+        case 0x1:
+            _mask = data;
+            retime();
+            break;
+        case 0x3:
+            _oam_address = data;
+            break;
+        case 0x4:
+            _oam[_oam_address] = data;
+            _oam_address = byte{_oam_address + 1};
+            _dirty.mark(0);
+            break;
+        case 0x5:
+        case 0x6:
+            _write_toggle = !_write_toggle;
+            break;
+        default:
+            break;
+        }
+    }
+
+    /**
+     *  OAM DMA writes a whole page to OAM, starting at OAMADDR and wrapping
+     *  around, as 256 writes to OAMDATA would.
+     */
+    void write_oam(span<const byte> data)
+    {
+        const auto start = static_cast<std::size_t>(_oam_address);
+        const auto first = std::min<std::size_t>(data.size(), _oam.size() - start);
+        std::copy_n(data.data(), first, _oam.data() + start);
+        std::copy_n(data.data() + first, data.size() - first, _oam.data());
+        _dirty.mark(0);
+    }
+
+    /**
+     *  OAM is the PPU's only memory so far, and a single page.
+     */
+    constexpr auto dirty() noexcept -> dirty_map<1>&
+    {
+        return _dirty;
+    }
+
+    /**
+     *  The eight PPU registers are mirrored over $2000-$3fff.
+     */
+    static constexpr address_range range{0x2000, 0x4000};
+
+    static constexpr bool contains(word address) noexcept
+    {
+        return range.contains(address);
+    }
+
+    /**
+     *  Reading PPUSTATUS clears the vblank flag and the address latch, so
+     *  reading it again returns the same value until the flags next change.
+     *  That is only known to be at an event once the PPU is connected.
+     */
+    constexpr bool idempotent(word address) const noexcept
+    {
+        return _events != nullptr && (address & 0x7) == 0x2;
+    }
 
 private:
+    static constexpr std::int64_t dots_per_cycle = 3;
+    static constexpr std::int64_t dots_per_scanline = 341;
+    static constexpr std::int64_t dots_per_frame = 262 * dots_per_scanline;
+    static constexpr std::int64_t vblank_start = 241 * dots_per_scanline + 1;
+    static constexpr std::int64_t vblank_end = 261 * dots_per_scanline + 1;
+
+    static constexpr std::uint8_t vblank_flag = 0x80;
+    static constexpr std::uint8_t sprite_zero_flag = 0x40;
+    static constexpr std::uint8_t overflow_flag = 0x20;
+
+    /**
+     *  The most recent dot, at or before the given one, at the given position
+     *  within the frame. Negative if the first frame has not got there yet.
+     */
+    static constexpr auto last(std::int64_t position, std::int64_t dot) noexcept -> std::int64_t
+    {
+        const auto candidate = dot - dot % dots_per_frame + position;
+        return candidate <= dot ? candidate : candidate - dots_per_frame;
+    }
+
+    static constexpr auto next(std::int64_t position, std::int64_t dot) noexcept -> std::int64_t
+    {
+        return last(position, dot) + dots_per_frame;
+    }
+
+    /**
+     *  The first CPU cycle by which the given dot has been reached.
+     */
+    static constexpr auto cycle(std::int64_t dot) noexcept -> std::int64_t
+    {
+        return (dot + dots_per_cycle - 1) / dots_per_cycle;
+    }
+
+    constexpr bool nmi_enabled() const noexcept
+    {
+        return _control & 0x80;
+    }
+
+    /**
+     *  The dot within each rendered scanline at which A12 rises, or -1 if it
+     *  does not. It rises where fetches move to the upper pattern table from
+     *  the lower one: at the sprite fetches if only sprites use the upper
+     *  table, 8x16 sprites counted as such, or at the prefetch of the next
+     *  line's background if only the background does.
+     */
+    constexpr auto a12_rise() const noexcept -> std::int64_t
+    {
+        if ((_mask & 0x18) == 0) return -1;
 
+        const bool background = _control & 0x10;
+        const bool sprites = _control & 0x28;
+        if (sprites && !background) return 260;
+        if (background && !sprites) return 324;
+        return -1;
+    }
+
+    constexpr void retime() noexcept
+    {
+        if (_cartridge != nullptr) _cartridge->retime(_dot, a12_rise());
+    }
+
+    /**
+     *  Schedules the next change of the status flags, and the next vblank NMI
+     *  if enabled and none is pending yet.
+     */
+    constexpr void reschedule() noexcept
+    {
+        if (_events == nullptr) return;
+
+        const auto change = std::min(next(vblank_start, _dot), next(vblank_end, _dot));
+        _events->schedule(event::synchronize, cycle(change));
+        if (!nmi_enabled()) {
+            _events->cancel(event::vblank_nmi);
+        } else if (_events->when(event::vblank_nmi) == scheduler::never) {
+            _events->schedule(event::vblank_nmi, cycle(next(vblank_start, _dot)));
+        }
+    }
+
+    scheduler* _events = nullptr;
+    cartridge* _cartridge = nullptr;
+    std::int64_t _dot = 0;
+
+    std::uint8_t _control = 0x00;
+    std::uint8_t _mask = 0x00;
+    std::uint8_t _status = 0x00;
+    std::uint8_t _oam_address = 0x00;
+    std::array<std::uint8_t, 0x100> _oam = {};
+    dirty_map<1> _dirty;
+    std::uint8_t _latch = 0x00;
+    bool _write_toggle = false;
 };
+
+static_assert([] {
+    auto events = scheduler{};
+    auto device = ppu{};
+    device.connect(events);
+    device.catch_up(27393);
+    const auto before = device.read(word{0x2002});
+    device.catch_up(27394);
+    const auto after = device.read(word{0x2002});
+    return before == byte{0x00} && after == byte{0x80} && events.when(event::synchronize) == 29668;
+}());
 }
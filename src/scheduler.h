@@ -0,0 +1,153 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Scheduling of timestamped events, such as interrupts.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace nes {
+/**
+ *  Events that devices can schedule for the processor to deliver.
+ *  The NMI is edge-triggered: its event makes the processor take the NMI once.
+ *  The IRQ sources are level-triggered: their events assert the IRQ line of
+ *  that source, which stays asserted until the device acknowledges it.
+ *  Synchronisation events raise nothing; they mark the time at which a device
+ *  changes state visibly to the program, such as the PPU setting its vblank
+ *  flag, so that the device is caught up then.
+ *  The OAM DMA event makes the processor copy a page to the PPU's object
+ *  memory, stalling it while it does.
+ *  Whenever an event is delivered, all devices are caught up.
+ */
+enum class event : std::uint8_t {
+    vblank_nmi,
+    frame_irq,
+    mapper_irq,
+    synchronize,
+    oam_dma,
+};
+
+constexpr std::size_t event_count = 5;
+
+/**
+ *  Returns the IRQ line mask for an IRQ source.
+ */
+constexpr auto irq_line(event source) noexcept -> std::uint8_t
+{
+    return static_cast<std::uint8_t>(1u << static_cast<std::uint8_t>(source));
+}
+
+
+/**
+ *  Keeps the timestamp, in CPU cycles, at which each event is due next. Every
+ *  event is pending at most once; scheduling it again moves it. As there are
+ *  only a few kinds of event, they are kept in a fixed array, and the time of
+ *  the earliest is cached so that run loops can read it without searching.
+ */
+class scheduler {
+public:
+    static constexpr std::int64_t never = std::numeric_limits<std::int64_t>::max();
+
+    constexpr void schedule(event type, std::int64_t timestamp) noexcept
+    {
+        _timestamps[index(type)] = timestamp;
+        update();
+    }
+
+    constexpr void cancel(event type) noexcept
+    {
+        schedule(type, never);
+    }
+
+    constexpr auto when(event type) const noexcept -> std::int64_t
+    {
+        return _timestamps[index(type)];
+    }
+
+    /**
+     *  Timestamp of the earliest pending event, or never if there is none.
+     */
+    constexpr auto next() const noexcept -> std::int64_t
+    {
+        return _next;
+    }
+
+    /**
+     *  Removes and returns the earliest pending event.
+     */
+    constexpr auto pop() noexcept -> event
+    {
+        auto earliest = std::size_t{0};
+        for (auto i = std::size_t{1}; i < event_count; ++i)
+            if (_timestamps[i] < _timestamps[earliest]) earliest = i;
+
+        _timestamps[earliest] = never;
+        update();
+        return static_cast<event>(earliest);
+    }
+
+    /**
+     *  Devices acknowledge their IRQ through the scheduler as well; the
+     *  processor releases the lines when it next delivers events.
+     */
+    constexpr void acknowledge(event source) noexcept
+    {
+        _acknowledged |= irq_line(source);
+    }
+
+    /**
+     *  Returns the IRQ lines acknowledged since the last call.
+     */
+    constexpr auto acknowledged() noexcept -> std::uint8_t
+    {
+        const auto lines = _acknowledged;
+        _acknowledged = 0;
+        return lines;
+    }
+
+private:
+    static constexpr auto index(event type) noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(type);
+    }
+
+    constexpr void update() noexcept
+    {
+        _next = never;
+        for (const auto timestamp : _timestamps)
+            if (timestamp < _next) _next = timestamp;
+    }
+
+    std::array<std::int64_t, event_count> _timestamps = {never, never, never, never, never};
+    std::int64_t _next = never;
+    std::uint8_t _acknowledged = 0;
+};
+
+static_assert([] {
+    auto events = scheduler{};
+    events.schedule(event::frame_irq, 20);
+    events.schedule(event::vblank_nmi, 10);
+    return events.next() == 10 && events.pop() == event::vblank_nmi && events.next() == 20;
+}());
+}
@@ -0,0 +1,133 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Pre-decoded blocks must behave as the instructions they were decoded
+ *  from, also when the code or the bank behind them changes.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  UxROM board with two switchable banks, each of which switches to the
+ *  other from $8000 and then loads X with a value of its own, and a fixed
+ *  bank at $c000 that logs X to $0300 onwards for 32 rounds.
+ */
+auto switching_rom() -> rom_file
+{
+    auto prg = std::vector<std::uint8_t>(0xc000, 0xea);
+    for (auto bank = 0; bank < 2; ++bank) {
+        const auto base = bank * 0x4000;
+        const std::uint8_t code[] = {
+            0xa9, static_cast<std::uint8_t>(1 - bank),      // LDA #other
+            0x8d, 0x00, 0xc0,                               // STA $c000
+            0xa2, static_cast<std::uint8_t>(0x11 * (bank + 1)), // LDX #value
+            0x4c, 0x00, 0xc0,                               // JMP $c000
+        };
+        std::copy(std::begin(code), std::end(code), prg.begin() + base);
+    }
+    const std::uint8_t fixed[] = {
+        0x8a,               // $c000: TXA
+        0x99, 0x00, 0x03,   // $c001: STA $0300,Y
+        0xc8,               // $c004: INY
+        0xc0, 0x20,         // $c005: CPY #$20
+        0xf0, 0x03,         // $c007: BEQ $c00c
+        0x4c, 0x00, 0x80,   // $c009: JMP $8000
+        0x4c, 0x0c, 0xc0,   // $c00c: JMP $c00c
+    };
+    std::copy(std::begin(fixed), std::end(fixed), prg.begin() + 0x8000);
+    prg[0xbffc] = 0x00;
+    prg[0xbffd] = 0x80;
+    return read_rom(make_image(2, prg));
+}
+
+/**
+ *  The bank at $8000 switches to the other before loading X, so X must come
+ *  from the other bank each round.
+ */
+template<typename Dispatch, typename Run>
+void check_switching(Run run)
+{
+    auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(switching_rom());
+    run(system->processor());
+    for (auto round = 0; round < 0x20; ++round) {
+        const auto named = scope{"round %d", round};
+        CHECK_EQUAL(system->read(static_cast<std::uint16_t>(0x0300 + round)), round % 2 == 0 ? 0x22 : 0x11);
+    }
+}
+}
+
+
+TEST(bank_switch_within_block)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        {
+            const auto named = scope{"interpreted"};
+            check_switching<Dispatch>([](auto& processor) { processor.interpret(10000); });
+        }
+        {
+            const auto named = scope{"cached"};
+            check_switching<Dispatch>([](auto& processor) { processor.run(10000); });
+        }
+        {
+            const auto named = scope{"native"};
+            check_switching<Dispatch>([](auto& processor) { processor.run_native(10000); });
+        }
+    });
+}
+
+/**
+ *  Code fetched ahead by the decoder is not a read made by the program, so
+ *  read watchpoints on it must stay quiet; reads of data are still reported.
+ */
+TEST(decoding_is_not_watched)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image({
+            0xad, 0x00, 0x03,   // LDA $0300
+            0xe8,               // INX
+            0x4c, 0x00, 0x80,   // JMP $8000
+        }));
+
+        auto reads = std::map<std::uint16_t, int>{};
+        system->memory.on_watch([&](watchpoint, word address, byte) { ++reads[address]; });
+        system->memory.watch(word{0x0300}, watchpoint::read);
+        system->memory.watch(word{0x8001}, watchpoint::read);
+        system->memory.watch(word{0x8003}, watchpoint::read);
+
+        system->processor().run(900);
+        CHECK(reads[0x0300] > 0);
+        CHECK_EQUAL(reads[0x8001], 0);
+        CHECK_EQUAL(reads[0x8003], 0);
+    });
+}
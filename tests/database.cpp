@@ -0,0 +1,242 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Headers corrected by a ROM database read from disk, as ROMs are loaded
+ *  and as they are indexed.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "cartridge/database.h"
+#include "cartridge/library.h"
+#include "files.h"
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  UxROM image with 64 KB of PRG ROM, whose every 16 KB bank is filled with
+ *  its own number, but whose header claims NROM with horizontal mirroring.
+ */
+auto misnamed_image() -> std::vector<byte>
+{
+    auto prg = std::vector<std::uint8_t>(0x10000);
+    for (auto index = 0u; index < prg.size(); ++index) prg[index] = static_cast<std::uint8_t>(index / 0x4000);
+    return make_image(0, prg);
+}
+
+auto misnamed_file(const std::string& name) -> temporary_file
+{
+    const auto image = misnamed_image();
+    return temporary_file{name, {image.begin(), image.end()}};
+}
+
+auto hexadecimal(const rom_digest& hashes) -> std::pair<std::string, std::string>
+{
+    char crc[9];
+    std::snprintf(crc, sizeof(crc), "%08X", hashes.crc32);
+    auto sha1 = std::string{};
+    for (const auto digit : hashes.sha1) {
+        char pair[3];
+        std::snprintf(pair, sizeof(pair), "%02X", digit);
+        sha1 += pair;
+    }
+    return {crc, sha1};
+}
+
+/**
+ *  Database in the layout of the NES 2.0 header database, listing the image
+ *  above as UxROM with vertical mirroring, battery-backed PRG RAM and CHR
+ *  RAM, for PAL consoles. Of the other games, one has no CRC.
+ */
+auto database_text(bool with_sha1 = true) -> std::string
+{
+    const auto hashes = hexadecimal(digest(read_rom(misnamed_image())));
+    const auto sha1 = std::string(40, 'A');
+    const auto sha1_attribute = with_sha1 ? " sha1=\"" + hashes.second + "\"" : std::string{};
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<nes20db date=\"2024-01-01\">\n"
+        "<!-- Other\\Game.nes -->\n"
+        "<game>\n"
+        "  <prgrom size=\"16384\" crc32=\"01234567\" sha1=\"" + sha1 + "\" sum16=\"0000\"/>\n"
+        "  <rom size=\"16384\" crc32=\"01234567\" sha1=\"" + sha1 + "\" sum16=\"0000\"/>\n"
+        "  <console type=\"0\" region=\"0\"/>\n"
+        "  <pcb mapper=\"1\" submapper=\"0\" mirroring=\"H\" battery=\"0\"/>\n"
+        "</game>\n"
+        "<!-- Misnamed.nes -->\n"
+        "<game>\n"
+        "  <prgrom size=\"65536\" crc32=\"00000000\"/>\n"
+        "  <rom size=\"65536\" crc32=\"" + hashes.first + "\"" + sha1_attribute + " sum16=\"0000\"/>\n"
+        "  <prgnvram size=\"8192\"/>\n"
+        "  <chrram size=\"8192\"/>\n"
+        "  <console type=\"0\" region=\"1\"/>\n"
+        "  <pcb mapper=\"2\" submapper=\"2\" mirroring=\"V\" battery=\"1\"/>\n"
+        "</game>\n"
+        "<!-- Unhashed.nes -->\n"
+        "<game>\n"
+        "  <pcb mapper=\"4\" submapper=\"0\" mirroring=\"4\" battery=\"0\"/>\n"
+        "</game>\n"
+        "</nes20db>\n";
+}
+
+auto database_file(bool with_sha1 = true) -> temporary_file
+{
+    const auto text = database_text(with_sha1);
+    return temporary_file{"database.xml", {text.begin(), text.end()}};
+}
+
+void check_corrected(const rom_file& rom)
+{
+    CHECK_EQUAL(rom.mapper, 2);
+    CHECK_EQUAL(rom.submapper, 2);
+    CHECK(rom.vertical_mirroring);
+    CHECK(!rom.four_screen_vram);
+    CHECK(rom.persistent_memory);
+    CHECK_EQUAL(rom.prg_ram_size, 0);
+    CHECK_EQUAL(rom.prg_nvram_size, 0x2000);
+    CHECK_EQUAL(rom.chr_ram_size, 0x2000);
+    CHECK_EQUAL(rom.chr_nvram_size, 0);
+    CHECK(rom.timing == region::pal);
+}
+}
+
+
+/**
+ *  Games are matched on the <rom> element rather than <prgrom>, and games
+ *  without a CRC are left out.
+ */
+TEST(database_from_xml)
+{
+    const auto file = database_file();
+    const auto database = read_database(file.path());
+    CHECK_EQUAL(database.size(), 2);
+
+    auto rom = read_rom(misnamed_image());
+    CHECK_EQUAL(rom.mapper, 0);
+    CHECK(identify(rom, database) != nullptr);
+    check_corrected(rom);
+
+    auto other = read_rom(make_image(0, std::vector<std::uint8_t>(0x4000, 0xea)));
+    CHECK(identify(other, database) == nullptr);
+    CHECK_EQUAL(other.mapper, 0);
+    CHECK(!other.vertical_mirroring);
+}
+
+/**
+ *  Entries without a SHA-1 match on the CRC alone.
+ */
+TEST(database_without_sha1)
+{
+    const auto file = database_file(false);
+    auto rom = read_rom(misnamed_image());
+    CHECK(identify(rom, read_database(file.path())) != nullptr);
+    check_corrected(rom);
+}
+
+TEST(invalid_database)
+{
+    const auto text = std::string{"<game><rom crc32=\"xyz\"/></game>"};
+    const auto file = temporary_file{"invalid.xml", {text.begin(), text.end()}};
+    CHECK_THROWS(std::runtime_error, read_database(file.path()));
+
+    const auto sha1 = std::string{"<game><rom crc32=\"01234567\" sha1=\"0123\"/></game>"};
+    const auto short_sha1 = temporary_file{"short.xml", {sha1.begin(), sha1.end()}};
+    CHECK_THROWS(std::runtime_error, read_database(short_sha1.path()));
+
+    const auto empty = temporary_file{"empty.xml", {}};
+    CHECK_EQUAL(read_database(empty.path()).size(), 0);
+    CHECK_THROWS(std::invalid_argument, read_database(fs::temp_directory_path() / "nes-tester-missing.xml"));
+}
+
+/**
+ *  A cartridge loaded with the database runs the board the database names,
+ *  here switching banks as UxROM does, with its mirroring.
+ */
+TEST(cartridge_from_database)
+{
+    const auto database = read_database(database_file().path());
+    const auto image = misnamed_file("misnamed.nes");
+    check_corrected(read_rom(image.path(), database));
+
+    auto cart = cartridge{image.path(), database};
+    CHECK(cart.arrangement() == mirroring::vertical);
+    CHECK_EQUAL(cart.read(word{0x8000}), 0);
+    CHECK_EQUAL(cart.read(word{0xc000}), 3);
+    cart.write(word{0x8000}, byte{0x02});
+    CHECK_EQUAL(cart.read(word{0x8000}), 2);
+
+    auto trusted = cartridge{image.path()};
+    CHECK(trusted.arrangement() == mirroring::horizontal);
+}
+
+/**
+ *  The library records the corrected header, also through its index.
+ */
+TEST(library_from_database)
+{
+    const auto directory = fs::temp_directory_path() / "nes-tester-library";
+    fs::create_directories(directory);
+    {
+        const auto database = read_database(database_file().path());
+        const auto image = misnamed_file("library/misnamed.nes");
+        const auto index = temporary_file{"library.index", {}};
+
+        const auto check_entry = [](const library_entry& entry) {
+            CHECK_EQUAL(entry.mapper, 2);
+            CHECK_EQUAL(entry.submapper, 2);
+            CHECK(entry.vertical_mirroring);
+            CHECK(!entry.four_screen_vram);
+            CHECK(entry.persistent_memory);
+            CHECK(entry.timing == region::pal);
+            CHECK_EQUAL(entry.prg_size, 0x10000);
+            CHECK_EQUAL(entry.chr_size, 0);
+            CHECK_EQUAL(entry.prg_ram_size, 0);
+            CHECK_EQUAL(entry.prg_nvram_size, 0x2000);
+            CHECK_EQUAL(entry.chr_ram_size, 0x2000);
+            CHECK_EQUAL(entry.chr_nvram_size, 0);
+        };
+
+        const auto library = rom_library::scan(directory, database, 2);
+        CHECK_EQUAL(library.entries().size(), 1);
+        CHECK(library.find("misnamed") != nullptr);
+        if (const auto entry = library.find("misnamed")) check_entry(*entry);
+
+        library.save(index.path());
+        const auto loaded = rom_library::load(index.path());
+        CHECK_EQUAL(loaded.entries().size(), 1);
+        CHECK(loaded.find(digest(read_rom(misnamed_image())).crc32) != nullptr);
+        if (const auto entry = loaded.find("misnamed")) check_entry(*entry);
+
+        const auto trusted = rom_library::scan(directory, rom_database{{}}, 1);
+        CHECK_EQUAL(trusted.entries().size(), 1);
+        CHECK_EQUAL(trusted.entries()[0].mapper, 0);
+    }
+    auto error = std::error_code{};
+    fs::remove_all(directory, error);
+}
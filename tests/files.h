@@ -0,0 +1,66 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Files written for the tests that read from disk.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace nes::test {
+namespace fs = std::filesystem;
+
+/**
+ *  A file in the temporary directory holding the given contents, which is
+ *  removed again when the object is destroyed.
+ */
+class temporary_file {
+public:
+    temporary_file(const std::string& name, const std::vector<std::uint8_t>& contents) :
+        _path{fs::temp_directory_path() / ("nes-tester-" + name)}
+    {
+        auto stream = std::ofstream{_path, std::ios::binary | std::ios::trunc};
+        stream.write(reinterpret_cast<const char*>(contents.data()), static_cast<std::streamsize>(contents.size()));
+    }
+
+    temporary_file(const temporary_file&) = delete;
+    temporary_file& operator=(const temporary_file&) = delete;
+
+    ~temporary_file()
+    {
+        auto error = std::error_code{};
+        fs::remove(_path, error);
+    }
+
+    auto path() const -> const fs::path&
+    {
+        return _path;
+    }
+
+private:
+    fs::path _path;
+};
+}
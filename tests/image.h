@@ -0,0 +1,65 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  ROM images built in memory, for the tests and benchmarks.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "cartridge/rom.h"
+
+namespace nes::test {
+/**
+ *  iNES image of the given board, with the given PRG and CHR ROM, whose
+ *  sizes must be multiples of 16 KB and 8 KB.
+ */
+inline auto make_image(std::uint8_t mapper, const std::vector<std::uint8_t>& prg, const std::vector<std::uint8_t>& chr = {},
+                       std::uint8_t flags6 = 0x00) -> std::vector<byte>
+{
+    auto image = std::vector<byte>{byte{0x4e}, byte{0x45}, byte{0x53}, byte{0x1a},
+        byte{prg.size() / 0x4000}, byte{chr.size() / 0x2000}, byte{(mapper & 0x0f) << 4 | flags6}, byte{mapper & 0xf0}};
+    image.resize(16, byte{0x00});
+    for (const auto data : prg) image.push_back(byte{data});
+    for (const auto data : chr) image.push_back(byte{data});
+    return image;
+}
+
+/**
+ *  NROM board with 32 KB of PRG ROM and 8 KB of CHR ROM, holding the given
+ *  code at the given address, which the reset vector points to. The rest of
+ *  the ROM is filled with NOPs, and BRK and IRQs go to $9000.
+ */
+inline auto nrom_image(const std::vector<std::uint8_t>& code, std::uint16_t origin = 0x8000) -> rom_file
+{
+    auto prg = std::vector<std::uint8_t>(0x8000, 0xea);
+    std::copy(code.begin(), code.end(), prg.begin() + (origin - 0x8000));
+    prg[0x7ffa] = 0x00;
+    prg[0x7ffb] = 0x90;
+    prg[0x7ffc] = static_cast<std::uint8_t>(origin);
+    prg[0x7ffd] = static_cast<std::uint8_t>(origin >> 8);
+    prg[0x7ffe] = 0x00;
+    prg[0x7fff] = 0x90;
+    return read_rom(make_image(0, prg, std::vector<std::uint8_t>(0x2000)));
+}
+}
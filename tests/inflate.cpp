@@ -0,0 +1,613 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  DEFLATE streams, in gzip files and zip archives, as written by zlib.
+ *  Truncated or corrupt input must fail with an error, and never be read
+ *  past its end.
+ */
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "files.h"
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  NROM image with 16 KB of PRG ROM and 8 KB of CHR ROM, repetitive enough
+ *  to compress well, with matches over long distances.
+ */
+auto rom_payload() -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{0x4e, 0x45, 0x53, 0x1a, 0x01, 0x01, 0x00, 0x00};
+    result.resize(16, 0x00);
+    for (auto index = 0u; index < 0x4000; ++index)
+        result.push_back(static_cast<std::uint8_t>(index % 256 == 0 ? index >> 8 : (index % 61) * 3));
+    for (auto index = 0u; index < 0x2000; ++index)
+        result.push_back(static_cast<std::uint8_t>(index % 128 == 0 ? index >> 7 : 0));
+    return result;
+}
+
+/**
+ *  Bytes in which the value n occurs with a probability of 2^-(n + 1), so
+ *  that the rarest get Huffman codes longer than the decoding table holds.
+ */
+auto skewed_payload() -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{};
+    auto state = std::uint32_t{1};
+    for (auto index = 0; index < 1536; ++index) {
+        state = state * 1103515245u + 12345u;
+        auto value = std::uint8_t{0};
+        for (auto bits = state >> 12 | 0x100000; (bits & 1) == 0; bits >>= 1) ++value;
+        result.push_back(value);
+    }
+    return result;
+}
+
+/**
+ *  The payloads above as raw DEFLATE streams from zlib 1.2.13 at level 9,
+ *  with the default strategy for dynamic Huffman codes, Z_FIXED for the
+ *  fixed ones and Z_HUFFMAN_ONLY for the skewed payload.
+ */
+const auto dynamic_stream = std::vector<std::uint8_t>{
+    0xe5, 0xdb, 0x6b, 0x67, 0xc2, 0x61, 0x1c, 0xc6, 0xf1, 0x75, 0x3e, 0xaf, 0xf3, 0xf9, 0xbc, 0xfd,
+    0xab, 0x75, 0x3e, 0xad, 0xb6, 0x56, 0x2d, 0x22, 0x62, 0xc4, 0x2c, 0x46, 0x44, 0x44, 0x44, 0x8c,
+    0x31, 0x22, 0xc6, 0x88, 0x88, 0x88, 0x31, 0x22, 0x22, 0x62, 0x8c, 0x88, 0x5e, 0xe0, 0x1e, 0xae,
+    0x77, 0x70, 0xb1, 0xeb, 0x7e, 0xfe, 0xf3, 0x71, 0x3f, 0xf9, 0x3e, 0xbb, 0x5a, 0x8d, 0x27, 0x97,
+    0x48, 0x74, 0xf6, 0xf7, 0x24, 0x72, 0x95, 0x56, 0x6f, 0xb2, 0x3a, 0xdc, 0xbe, 0xa0, 0x10, 0x89,
+    0x25, 0x33, 0xf9, 0x62, 0xa9, 0x52, 0xab, 0x37, 0x9a, 0x0f, 0xad, 0xc7, 0xf6, 0x73, 0xa7, 0xdb,
+    0xeb, 0x0f, 0x86, 0xa3, 0x97, 0xd7, 0xb7, 0xf1, 0xe4, 0xfd, 0x63, 0x3a, 0x9b, 0x2f, 0x96, 0x9f,
+    0x5f, 0xab, 0xf5, 0x66, 0xbb, 0xfb, 0xfe, 0xd9, 0x1f, 0x8e, 0xff, 0xe0, 0x58, 0x44, 0xf8, 0xe7,
+    0xd3, 0x63, 0x31, 0xe1, 0x9f, 0x4f, 0x8f, 0x25, 0x84, 0x7f, 0x3e, 0x3d, 0x96, 0x12, 0xfe, 0xf9,
+    0xf4, 0x58, 0x46, 0x1e, 0x40, 0xb9, 0xc0, 0x1d, 0x40, 0x45, 0x93, 0x3b, 0x80, 0xca, 0x11, 0x77,
+    0x00, 0x55, 0x4b, 0xee, 0x00, 0xaa, 0x8f, 0xdc, 0x01, 0xd4, 0x04, 0xb9, 0x03, 0xa8, 0x6d, 0x70,
+    0x07, 0x50, 0x37, 0xe4, 0x0e, 0xe0, 0xf9, 0x82, 0x3b, 0x80, 0xfa, 0x03, 0x77, 0x00, 0x0d, 0x3e,
+    0xee, 0x00, 0x1a, 0xeb, 0xdc, 0x01, 0x34, 0x0d, 0xb8, 0x03, 0x68, 0x9e, 0x73, 0x07, 0xd0, 0xb2,
+    0xe7, 0x0e, 0xa0, 0xd5, 0xcd, 0x1d, 0x40, 0x5b, 0x8d, 0x3b, 0x80, 0xf6, 0x3e, 0x77, 0x00, 0x1d,
+    0x33, 0xee, 0x00, 0x3a, 0x7f, 0xb8, 0x03, 0xe8, 0x72, 0x70, 0x07, 0xd0, 0x5d, 0xe1, 0x0e, 0xa0,
+    0xa7, 0xc7, 0x1d, 0x40, 0xef, 0x94, 0x3b, 0x80, 0xbe, 0x6f, 0xee, 0x00, 0xfa, 0xad, 0xdc, 0x01,
+    0x0c, 0x94, 0xb8, 0x03, 0x18, 0xec, 0x72, 0x07, 0xf0, 0xe2, 0x83, 0x3b, 0x80, 0x97, 0x3b, 0xee,
+    0x00, 0x0a, 0x26, 0xee, 0x00, 0x86, 0x8a, 0xdc, 0x01, 0x0c, 0x77, 0xb8, 0x03, 0x18, 0x79, 0xe7,
+    0x0e, 0xe0, 0xd5, 0x96, 0x3b, 0x80, 0x51, 0x3d, 0x77, 0x00, 0x63, 0x79, 0xee, 0x00, 0xc6, 0x9f,
+    0xb9, 0x03, 0x98, 0x98, 0x70, 0x07, 0x30, 0xb9, 0xe1, 0x0e, 0x60, 0x4a, 0xcb, 0x1d, 0xc0, 0x74,
+    0x86, 0x3b, 0x80, 0x99, 0x36, 0x77, 0x00, 0xb3, 0x63, 0xee, 0x00, 0xe6, 0xd6, 0xdc, 0x01, 0xcc,
+    0xab, 0xb8, 0x03, 0x78, 0x9d, 0xe4, 0x0e, 0x60, 0xe1, 0x91, 0x3b, 0x80, 0xc5, 0x37, 0xee, 0x00,
+    0xde, 0xac, 0xb8, 0x03, 0x78, 0xcb, 0x3d, 0xff, 0x13, 0x4a, 0xdc, 0xf3, 0xbf, 0xe6, 0x1d, 0xf7,
+    0xfc, 0x6f, 0x54, 0xe6, 0x9e, 0xff, 0x2d, 0x2b, 0xdc, 0xf3, 0xbf, 0x63, 0x95, 0x7c, 0xff, 0x7c,
+    0x4f, 0xbe, 0x7f, 0xae, 0x91, 0xef, 0x9f, 0xcf, 0xc0, 0x4f, 0x04, 0xf6, 0xc5, 0x60, 0x5f, 0x02,
+    0xf6, 0xa5, 0x60, 0x5f, 0x06, 0xf6, 0xe5, 0x60, 0x5f, 0x01, 0xf6, 0x95, 0x60, 0x5f, 0x05, 0xf6,
+    0xd5, 0x60, 0x5f, 0x03, 0xf6, 0xb5, 0x60, 0x5f, 0x07, 0xf6, 0xcf, 0xc1, 0xbe, 0x1e, 0xec, 0x1b,
+    0xc0, 0xbe, 0x11, 0xec, 0x9b, 0xc0, 0xbe, 0x19, 0xec, 0x5b, 0xc0, 0xbe, 0x15, 0xec, 0xdb, 0xc0,
+    0xbe, 0x1d, 0xec, 0x3b, 0xc0, 0xbe, 0x13, 0xec, 0xbb, 0xc0, 0xbe, 0x1b, 0xec, 0x7b, 0xc0, 0xbe,
+    0x17, 0xec, 0xfb, 0xc0, 0xbe, 0x1f, 0xec, 0x07, 0xc0, 0x7e, 0x10, 0xec, 0x5f, 0x80, 0xfd, 0x4b,
+    0xb0, 0x2f, 0x80, 0xfd, 0x10, 0xd8, 0x0f, 0x83, 0xfd, 0x08, 0xd8, 0xbf, 0x02, 0xfb, 0x51, 0xb0,
+    0x1f, 0x03, 0xfb, 0x71, 0xb0, 0x9f, 0x00, 0xfb, 0x49, 0xb0, 0x9f, 0x02, 0xfb, 0x69, 0xb0, 0x9f,
+    0x01, 0xfb, 0x59, 0xb0, 0x9f, 0x03, 0xfb, 0x79, 0xb0, 0x7f, 0x0d, 0xf6, 0x0b, 0x60, 0xbf, 0x08,
+    0xf6, 0x6f, 0xc0, 0xfe, 0x2d, 0xd8, 0x2f, 0x81, 0xfd, 0x3b, 0xb0, 0x5f, 0x06, 0xfb, 0x15, 0xb0,
+    0x5f, 0x05, 0xfb, 0xf7, 0x60, 0xbf, 0x06, 0xf6, 0x7f, 0x01
+};
+
+const auto fixed_stream = std::vector<std::uint8_t>{
+    0xf3, 0x73, 0x0d, 0x96, 0x62, 0x64, 0x64, 0x40, 0x00, 0x66, 0x36, 0x4e, 0x1e, 0x7e, 0x21, 0x51,
+    0x09, 0x69, 0x39, 0x45, 0x15, 0x75, 0x2d, 0x5d, 0x03, 0x63, 0x33, 0x4b, 0x1b, 0x7b, 0x27, 0x57,
+    0x0f, 0x6f, 0xbf, 0xc0, 0x90, 0xf0, 0xa8, 0xd8, 0x84, 0xe4, 0xb4, 0xcc, 0x9c, 0xfc, 0xa2, 0xd2,
+    0x8a, 0xea, 0xba, 0xc6, 0x96, 0xf6, 0xae, 0xde, 0x09, 0x93, 0xa7, 0xcd, 0x9c, 0x33, 0x7f, 0xd1,
+    0xd2, 0x15, 0xab, 0xd7, 0x6d, 0xdc, 0x32, 0x0c, 0x34, 0x33, 0x8e, 0x40, 0x3f, 0x23, 0x6b, 0x66,
+    0x1a, 0x81, 0x7e, 0x46, 0xd6, 0xcc, 0x3c, 0x02, 0xfd, 0x8c, 0xac, 0x99, 0x65, 0x04, 0xfa, 0x19,
+    0x59, 0x33, 0xeb, 0x08, 0x2f, 0x00, 0xd9, 0x54, 0x46, 0x76, 0x01, 0xc8, 0xee, 0x31, 0xb2, 0x0b,
+    0x40, 0x8e, 0x9c, 0x91, 0x5d, 0x00, 0x72, 0x4e, 0x18, 0xd9, 0x05, 0x20, 0xd7, 0x96, 0x91, 0x5d,
+    0x00, 0x72, 0x2b, 0x8e, 0xec, 0x02, 0x90, 0xc7, 0x75, 0x64, 0x17, 0x80, 0xbc, 0x99, 0x23, 0xbb,
+    0x00, 0xe4, 0xeb, 0x1d, 0xd9, 0x05, 0x20, 0xff, 0xc6, 0x91, 0x5d, 0x00, 0x0a, 0xc8, 0x8d, 0xec,
+    0x02, 0x50, 0xd0, 0x69, 0x64, 0x17, 0x80, 0x42, 0x69, 0x23, 0xbb, 0x00, 0x14, 0xee, 0x1a, 0xd9,
+    0x05, 0xa0, 0xc8, 0xba, 0x91, 0x5d, 0x00, 0x8a, 0x4a, 0x8f, 0xec, 0x02, 0x50, 0xcc, 0x7e, 0x64,
+    0x17, 0x80, 0xe2, 0xc9, 0x23, 0xbb, 0x00, 0x94, 0x68, 0x1f, 0xd9, 0x05, 0xa0, 0xe4, 0xea, 0x91,
+    0x5d, 0x00, 0x4a, 0x49, 0x8c, 0xec, 0x02, 0x50, 0xda, 0x66, 0x64, 0x17, 0x80, 0x32, 0x09, 0x23,
+    0xbb, 0x00, 0x94, 0x6d, 0x19, 0xd9, 0x05, 0xa0, 0xdc, 0x8a, 0x91, 0x5d, 0x00, 0xca, 0x8b, 0x8e,
+    0xec, 0x02, 0x50, 0xc1, 0x72, 0x64, 0x17, 0x80, 0x8a, 0xb1, 0x23, 0xbb, 0x00, 0x54, 0x6a, 0x1c,
+    0xd9, 0x05, 0xa0, 0xf2, 0xd2, 0x91, 0x5d, 0x00, 0xaa, 0x08, 0x8d, 0xec, 0x02, 0x50, 0xd5, 0x6c,
+    0x64, 0x17, 0x80, 0x6a, 0x51, 0x23, 0xbb, 0x00, 0x54, 0xaf, 0x1b, 0xd9, 0x05, 0xa0, 0xc6, 0xa2,
+    0x91, 0x5d, 0x00, 0x6a, 0xf2, 0x8f, 0xec, 0x02, 0x50, 0xcb, 0x78, 0x64, 0x17, 0x80, 0xda, 0xe1,
+    0x23, 0xbb, 0x00, 0xd4, 0xa9, 0x1e, 0xd9, 0x05, 0xa0, 0xee, 0xfc, 0x91, 0x5d, 0x00, 0xea, 0xf1,
+    0x8c, 0xec, 0x02, 0x50, 0xdf, 0x60, 0x64, 0x17, 0x80, 0x06, 0x21, 0x23, 0xbb, 0x00, 0x34, 0xac,
+    0x18, 0xd9, 0x05, 0xa0, 0xd1, 0x9c, 0x91, 0x5d, 0x00, 0x1a, 0x73, 0x8e, 0xec, 0x02, 0xd0, 0x44,
+    0x77, 0x64, 0x17, 0x80, 0xa6, 0x81, 0x23, 0xbb, 0x00, 0x34, 0x2b, 0x1d, 0xd9, 0x05, 0xa0, 0xf9,
+    0xcc, 0x91, 0x5d, 0x00, 0x5a, 0x8c, 0xec, 0xed, 0x7f, 0x2a, 0x96, 0x23, 0x7b, 0xfb, 0x9f, 0x87,
+    0xd5, 0xc8, 0xde, 0xfe, 0x97, 0x63, 0x3d, 0xb2, 0xb7, 0xff, 0x4d, 0xb0, 0x19, 0xd9, 0xdb, 0xff,
+    0xb6, 0xd8, 0x8e, 0xf0, 0xfd, 0xcf, 0x76, 0x23, 0x7c, 0xff, 0xb3, 0xfd, 0x08, 0xdf, 0xff, 0xcc,
+    0x30, 0xc0, 0x80, 0x71, 0x80, 0xed, 0x67, 0x1a, 0x60, 0xfb, 0x99, 0x07, 0xd8, 0x7e, 0x96, 0x01,
+    0xb6, 0x9f, 0x75, 0x80, 0xed, 0x67, 0x1b, 0x60, 0xfb, 0xd9, 0x07, 0xd8, 0x7e, 0x8e, 0x01, 0xb6,
+    0x9f, 0x73, 0x80, 0xed, 0xe7, 0x1a, 0x60, 0xfb, 0xb9, 0x07, 0xd8, 0x7e, 0x9e, 0x01, 0xb6, 0x9f,
+    0x77, 0x80, 0xed, 0xe7, 0x1b, 0x60, 0xfb, 0xf9, 0x07, 0xd8, 0x7e, 0x81, 0x01, 0xb6, 0x5f, 0x70,
+    0x80, 0xed, 0x17, 0x1a, 0x60, 0xfb, 0x85, 0x07, 0xd8, 0x7e, 0x91, 0x01, 0xb6, 0x5f, 0x74, 0x80,
+    0xed, 0x17, 0x1b, 0x60, 0xfb, 0xc5, 0x07, 0xd8, 0x7e, 0x89, 0x01, 0xb6, 0x5f, 0x72, 0x80, 0xed,
+    0x97, 0x1a, 0x60, 0xfb, 0xa5, 0x07, 0xd8, 0x7e, 0x99, 0x01, 0xb6, 0x5f, 0x76, 0x80, 0xed, 0x97,
+    0x1b, 0x60, 0xfb, 0xe5, 0x07, 0xd8, 0x7e, 0x85, 0x01, 0xb6, 0x5f, 0x71, 0x80, 0xed, 0x57, 0x1a,
+    0x60, 0xfb, 0x95, 0x07, 0xd8, 0x7e, 0x95, 0x01, 0xb6, 0x5f, 0x75, 0x80, 0xed, 0x57, 0x1b, 0x60,
+    0xfb, 0xd5, 0x07, 0xd8, 0x7e, 0x8d, 0x01, 0xb6, 0x5f, 0x73, 0x80, 0xed, 0xd7, 0x1a, 0x60, 0xfb,
+    0xb5, 0x07, 0xd8, 0x7e, 0x9d, 0x01, 0xb6, 0x5f, 0x77, 0x80, 0xed, 0xd7, 0x1b, 0x60, 0xfb, 0xf5,
+    0x07, 0xd8, 0x7e, 0x83, 0x01, 0xb6, 0xdf, 0x70, 0x80, 0xed, 0x37, 0x1a, 0x60, 0xfb, 0x8d, 0x07,
+    0xd8, 0x7e, 0x93, 0x01, 0xb6, 0xdf, 0x74, 0x80, 0xed, 0x37, 0x1b, 0x60, 0xfb, 0xcd, 0x07, 0xd8,
+    0x7e, 0x8b, 0x01, 0xb6, 0xdf, 0x72, 0x80, 0xed, 0xb7, 0x1a, 0x60, 0xfb, 0xad, 0x07, 0xd8, 0x7e,
+    0x9b, 0x01, 0xb6, 0xdf, 0x76, 0x80, 0xed, 0xb7, 0x1b, 0x60, 0xfb, 0xed, 0x07, 0xd8, 0x7e, 0x00
+};
+
+const auto skewed_stream = std::vector<std::uint8_t>{
+    0x05, 0xc1, 0x81, 0x91, 0x24, 0xc9, 0x11, 0x04, 0x31, 0x78, 0x64, 0xf5, 0xec, 0xbd, 0x19, 0xf5,
+    0x97, 0x97, 0x00, 0x41, 0x90, 0x25, 0x73, 0x8c, 0xb7, 0xbf, 0x2c, 0x40, 0x74, 0x61, 0x41, 0x8f,
+    0x64, 0xb6, 0x27, 0x24, 0x43, 0xc1, 0x2e, 0xb8, 0x78, 0x59, 0x9f, 0xf1, 0x81, 0x06, 0x62, 0xda,
+    0xe2, 0x6f, 0x47, 0x3f, 0x9e, 0x03, 0xf0, 0xd4, 0xec, 0xc1, 0xe7, 0x94, 0xb9, 0x7e, 0xb5, 0x72,
+    0x35, 0xdc, 0x7f, 0xa6, 0x78, 0x07, 0xf0, 0x31, 0x42, 0x3e, 0xb0, 0xb3, 0x59, 0x4d, 0xa6, 0x93,
+    0xb2, 0xca, 0xa7, 0xa8, 0x42, 0x2e, 0xc8, 0xd7, 0xca, 0x84, 0x79, 0x81, 0xbd, 0x7d, 0xb7, 0x7f,
+    0x9d, 0xe0, 0x46, 0xdb, 0x0c, 0xef, 0x6d, 0xef, 0x9c, 0x42, 0x8f, 0xef, 0x11, 0x9d, 0xc8, 0xac,
+    0x8b, 0xa7, 0x2d, 0xbf, 0x8d, 0xdb, 0xa6, 0x4f, 0xdf, 0xb4, 0x5e, 0x6d, 0x0f, 0xde, 0x16, 0x2b,
+    0xbc, 0xd8, 0x79, 0xef, 0x6c, 0x92, 0x2d, 0x99, 0x44, 0xd3, 0x5f, 0x03, 0x5f, 0x16, 0x6a, 0xc3,
+    0xf8, 0xb9, 0xb9, 0xa6, 0x8b, 0x31, 0x79, 0x84, 0xfe, 0x25, 0xaf, 0x00, 0x53, 0x48, 0xbb, 0x63,
+    0xdc, 0xe6, 0xdb, 0x93, 0x1a, 0x9d, 0xe0, 0xf1, 0xad, 0xe2, 0x8d, 0x39, 0x2b, 0x72, 0x09, 0xd3,
+    0x55, 0x85, 0xf3, 0x49, 0xa2, 0x7b, 0x5e, 0x66, 0x29, 0x65, 0x51, 0x33, 0x7e, 0x52, 0xe2, 0x13,
+    0x8b, 0x95, 0xea, 0xc2, 0x88, 0x49, 0x2c, 0x67, 0x1c, 0x31, 0xd5, 0xa5, 0xaf, 0x9f, 0x8e, 0xb7,
+    0x3f, 0x9c, 0xa8, 0x67, 0xb6, 0x1f, 0x8e, 0xcd, 0x95, 0xa3, 0x41, 0xef, 0x08, 0xe3, 0x27, 0xa1,
+    0x2a, 0x56, 0x8c, 0xcc, 0xdb, 0xc2, 0xf3, 0x8b, 0x38, 0xfb, 0x65, 0x83, 0x5a, 0x48, 0xb8, 0x63,
+    0x6e, 0x18, 0xc6, 0xdd, 0xef, 0xc2, 0x16, 0xdd, 0xd2, 0xb3, 0xff, 0x5d, 0xfa, 0xb6, 0x8f, 0xa4,
+    0xca, 0xef, 0xac, 0xa9, 0x15, 0x4c, 0xaf, 0x2d, 0x9f, 0x64, 0xf1, 0x66, 0x07, 0xf7, 0x7c, 0x7c,
+    0xd9, 0x6b, 0x9b, 0xb1, 0xd6, 0xfb, 0xf6, 0xcc, 0x5b, 0x93, 0x06, 0x6c, 0xd2, 0xab, 0x4c, 0xf4,
+    0x98, 0x0e, 0x51, 0xcc, 0x5d, 0xb8, 0xec, 0xa9, 0xbe, 0xe4, 0xaf, 0x9e, 0x34, 0xeb, 0x47, 0xcb,
+    0x11, 0x63, 0x2c, 0x10, 0x91, 0xc1, 0x19, 0x6e, 0xc6, 0x48, 0xf1, 0xe2, 0x9d, 0xd8, 0x2f, 0xb6,
+    0x89, 0x93, 0xb6, 0xf9, 0xe8, 0x44, 0x89, 0x5c, 0x55, 0x83, 0xb0, 0x13, 0x70, 0xed, 0xc7, 0x9c,
+    0x90, 0x00, 0x4f, 0x43, 0xeb, 0x47, 0xbc, 0x6d, 0xad, 0x8b, 0x71, 0x3b, 0xbf, 0xca, 0xde, 0xd6,
+    0x7a, 0x1d, 0x70, 0x09, 0xf8, 0x7e, 0xa6, 0x54, 0x2c, 0x88, 0xee, 0xdb, 0xc6, 0xdc, 0x91, 0x78,
+    0x97, 0xcf, 0x60, 0x4e, 0x6e, 0x9e, 0x68, 0x4d, 0xae, 0x16, 0x28, 0x82, 0x3a, 0x4c, 0x70, 0xf6,
+    0xdc, 0xcc, 0x3c, 0xee, 0x40, 0x99, 0x65, 0x2a, 0x1b, 0x53, 0xa1, 0x9c, 0xb7, 0x5c, 0xa6, 0x0d,
+    0xfc, 0x67, 0x05, 0x04, 0x9c, 0xda, 0xf1, 0xa9, 0x90, 0x48, 0x2a, 0x23, 0x2c, 0x8d, 0xf4, 0x8f,
+    0xb6, 0x9a, 0xee, 0xfd, 0x1f
+};
+
+
+auto inflated(const std::vector<std::uint8_t>& stream, std::size_t limit = 0x100000) -> std::vector<std::uint8_t>
+{
+    const auto input = std::vector<byte>(stream.begin(), stream.end());
+    auto output = std::vector<byte>{};
+    inflater{span<const byte>{input}}.inflate(output, limit);
+    return {output.begin(), output.end()};
+}
+
+auto bytes(const std::vector<std::uint8_t>& data) -> std::vector<byte>
+{
+    return {data.begin(), data.end()};
+}
+
+auto crc(const std::vector<std::uint8_t>& data) -> std::uint32_t
+{
+    auto check = crc32{};
+    check.update(span<const byte>{bytes(data)});
+    return check.value();
+}
+
+void check_bytes(const std::vector<std::uint8_t>& actual, const std::vector<std::uint8_t>& expected)
+{
+    CHECK_EQUAL(actual.size(), expected.size());
+    for (auto index = std::size_t{0}; index < std::min(actual.size(), expected.size()); ++index) {
+        if (actual[index] == expected[index]) continue;
+        const auto named = scope{"offset %zu", index};
+        CHECK_EQUAL(actual[index], expected[index]);
+        break;
+    }
+}
+
+void put(std::vector<std::uint8_t>& output, std::uint32_t value, int size)
+{
+    for (auto offset = 0; offset < size; ++offset) output.push_back(static_cast<std::uint8_t>(value >> (8 * offset)));
+}
+
+/**
+ *  Stored blocks of at most the given size, after an empty one.
+ */
+auto stored_stream(const std::vector<std::uint8_t>& data, std::size_t block) -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{data.empty() ? std::uint8_t{0x01} : std::uint8_t{0x00}, 0x00, 0x00, 0xff, 0xff};
+    for (auto start = std::size_t{0}; start < data.size(); start += block) {
+        const auto length = std::min(block, data.size() - start);
+        result.push_back(start + length == data.size() ? 0x01 : 0x00);
+        put(result, static_cast<std::uint32_t>(length), 2);
+        put(result, static_cast<std::uint32_t>(~length & 0xffff), 2);
+        result.insert(result.end(), data.begin() + start, data.begin() + start + length);
+    }
+    return result;
+}
+
+/**
+ *  gzip file of a single member, with every optional header field present.
+ */
+auto gzip(const std::vector<std::uint8_t>& stream, const std::vector<std::uint8_t>& data) -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{0x1f, 0x8b, 0x08, 0x1e, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03};
+    put(result, 4, 2);
+    put(result, 0x12345678, 4);
+    for (const auto text : {"game.nes", "comment"}) {
+        result.insert(result.end(), text, text + std::char_traits<char>::length(text));
+        result.push_back(0x00);
+    }
+    put(result, 0xffff, 2);
+    result.insert(result.end(), stream.begin(), stream.end());
+    put(result, crc(data), 4);
+    put(result, static_cast<std::uint32_t>(data.size()), 4);
+    return result;
+}
+
+struct zip_entry {
+    std::string name;
+    std::uint16_t method;
+    std::vector<std::uint8_t> stream;
+    std::vector<std::uint8_t> data;
+};
+
+/**
+ *  zip archive of the given files, found through its central directory.
+ */
+auto zip(const std::vector<zip_entry>& entries) -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{};
+    auto directory = std::vector<std::uint8_t>{};
+    for (const auto& entry : entries) {
+        const auto local = static_cast<std::uint32_t>(result.size());
+        const auto fields = [&](std::vector<std::uint8_t>& output) {
+            put(output, 20, 2);
+            put(output, 0, 2);
+            put(output, entry.method, 2);
+            put(output, 0, 4);
+            put(output, crc(entry.data), 4);
+            put(output, static_cast<std::uint32_t>(entry.stream.size()), 4);
+            put(output, static_cast<std::uint32_t>(entry.data.size()), 4);
+            put(output, static_cast<std::uint32_t>(entry.name.size()), 2);
+        };
+
+        put(result, 0x04034b50, 4);
+        fields(result);
+        put(result, 0, 2);
+        result.insert(result.end(), entry.name.begin(), entry.name.end());
+        result.insert(result.end(), entry.stream.begin(), entry.stream.end());
+
+        put(directory, 0x02014b50, 4);
+        put(directory, 20, 2);
+        fields(directory);
+        put(directory, 0, 4);
+        put(directory, 0, 4);
+        put(directory, 0, 4);
+        put(directory, local, 4);
+        directory.insert(directory.end(), entry.name.begin(), entry.name.end());
+    }
+
+    const auto offset = static_cast<std::uint32_t>(result.size());
+    result.insert(result.end(), directory.begin(), directory.end());
+    put(result, 0x06054b50, 4);
+    put(result, 0, 4);
+    put(result, static_cast<std::uint32_t>(entries.size()), 2);
+    put(result, static_cast<std::uint32_t>(entries.size()), 2);
+    put(result, static_cast<std::uint32_t>(directory.size()), 4);
+    put(result, offset, 4);
+    put(result, 0, 2);
+    return result;
+}
+
+auto gunzipped(const std::vector<std::uint8_t>& file) -> std::vector<std::uint8_t>
+{
+    const auto output = gunzip(span<const byte>{bytes(file)});
+    return {output.begin(), output.end()};
+}
+
+auto unzipped(const std::vector<std::uint8_t>& file) -> std::vector<std::uint8_t>
+{
+    const auto output = unzip(span<const byte>{bytes(file)});
+    return {output.begin(), output.end()};
+}
+
+/**
+ *  Writes DEFLATE bits: fields from their lowest bit, Huffman codes from
+ *  their highest.
+ */
+struct bit_writer {
+    std::vector<std::uint8_t> output;
+    int count = 0;
+
+    void bits(std::uint32_t value, int length)
+    {
+        for (auto bit = 0; bit < length; ++bit, ++count) {
+            if (count % 8 == 0) output.push_back(0x00);
+            output.back() |= static_cast<std::uint8_t>(((value >> bit) & 1) << (count % 8));
+        }
+    }
+
+    void code(std::uint32_t value, int length)
+    {
+        for (auto bit = length - 1; bit >= 0; --bit) bits(value >> bit, 1);
+    }
+
+    void fixed(int symbol)
+    {
+        if (symbol < 144) code(0x30 + symbol, 8);
+        else if (symbol < 256) code(0x190 + symbol - 144, 9);
+        else if (symbol < 280) code(symbol - 256, 7);
+        else code(0xc0 + symbol - 280, 8);
+    }
+};
+}
+
+
+/**
+ *  The payloads and streams are those the fixtures were made from.
+ */
+TEST(inflate_fixtures)
+{
+    CHECK_EQUAL(crc(rom_payload()), 0xb7fd152f);
+    CHECK_EQUAL(crc(skewed_payload()), 0x08c7a1ec);
+    CHECK_EQUAL((dynamic_stream[0] >> 1) & 3, 2);
+    CHECK_EQUAL((fixed_stream[0] >> 1) & 3, 1);
+    CHECK_EQUAL((skewed_stream[0] >> 1) & 3, 2);
+}
+
+TEST(inflate_stored)
+{
+    const auto payload = rom_payload();
+    for (const auto block : {std::size_t{0xffff}, std::size_t{5000}, std::size_t{1}}) {
+        const auto named = scope{"blocks of %zu bytes", block};
+        check_bytes(inflated(stored_stream(payload, block)), payload);
+    }
+    check_bytes(inflated(stored_stream({}, 1)), {});
+}
+
+TEST(inflate_fixed)
+{
+    check_bytes(inflated(fixed_stream), rom_payload());
+}
+
+TEST(inflate_dynamic)
+{
+    check_bytes(inflated(dynamic_stream), rom_payload());
+    check_bytes(inflated(skewed_stream), skewed_payload());
+}
+
+/**
+ *  Packed ROM files are told apart by their signature and inflated, and a
+ *  zip archive gives its .nes file, or else its only file.
+ */
+TEST(packed_roms)
+{
+    const auto payload = rom_payload();
+    const auto check_rom = [&](const std::vector<std::uint8_t>& contents) {
+        const auto file = temporary_file{"packed", contents};
+        const auto rom = read_rom(file.path());
+        CHECK_EQUAL(rom.mapper, 0);
+        CHECK_EQUAL(rom.prg_rom.size(), 0x4000);
+        CHECK_EQUAL(rom.chr_rom.size(), 0x2000);
+        CHECK_EQUAL(rom.prg_rom[0x0101], payload[16 + 0x0101]);
+        CHECK_EQUAL(rom.chr_rom[0x1f80], payload[16 + 0x4000 + 0x1f80]);
+    };
+
+    {
+        const auto named = scope{"gzip"};
+        check_bytes(gunzipped(gzip(dynamic_stream, payload)), payload);
+        check_bytes(gunzipped(gzip(fixed_stream, payload)), payload);
+        check_bytes(gunzipped(gzip(stored_stream(payload, 0xffff), payload)), payload);
+        check_rom(gzip(dynamic_stream, payload));
+    }
+    {
+        const auto named = scope{"zip"};
+        const auto readme = std::vector<std::uint8_t>{'r', 'e', 'a', 'd', ' ', 'm', 'e'};
+        const auto archive = zip({{"readme.txt", 0, readme, readme}, {"Game.NES", 8, dynamic_stream, payload}});
+        check_bytes(unzipped(archive), payload);
+        check_rom(archive);
+        check_bytes(unzipped(zip({{"game", 8, fixed_stream, payload}})), payload);
+        check_bytes(unzipped(zip({{"game.nes", 0, payload, payload}})), payload);
+        CHECK_THROWS(std::runtime_error, unzipped(zip({{"a.txt", 0, readme, readme}, {"b.txt", 0, readme, readme}})));
+    }
+}
+
+/**
+ *  Every stream cut short runs out of input before its end-of-block code,
+ *  and every file cut short loses its trailer or central directory.
+ */
+TEST(truncated_streams)
+{
+    const auto payload = rom_payload();
+    for (const auto* stream : {&dynamic_stream, &fixed_stream, &skewed_stream}) {
+        for (auto length = std::size_t{0}; length < stream->size(); ++length) {
+            const auto named = scope{"%zu of %zu bytes", length, stream->size()};
+            CHECK_THROWS(std::runtime_error, inflated({stream->begin(), stream->begin() + length}));
+        }
+    }
+
+    const auto stored = stored_stream(payload, 5000);
+    for (auto length = std::size_t{0}; length < stored.size(); length += 7) {
+        const auto named = scope{"%zu stored bytes", length};
+        CHECK_THROWS(std::runtime_error, inflated({stored.begin(), stored.begin() + length}));
+    }
+
+    const auto packed = gzip(dynamic_stream, payload);
+    for (auto length = std::size_t{0}; length < packed.size(); ++length) {
+        const auto named = scope{"gzip of %zu bytes", length};
+        CHECK_THROWS(std::runtime_error, gunzipped({packed.begin(), packed.begin() + length}));
+    }
+
+    const auto archive = zip({{"readme.txt", 0, {'r'}, {'r'}}, {"game.nes", 8, dynamic_stream, payload}});
+    for (auto length = std::size_t{0}; length < archive.size(); ++length) {
+        const auto named = scope{"zip of %zu bytes", length};
+        CHECK_THROWS(std::runtime_error, unzipped({archive.begin(), archive.begin() + length}));
+    }
+}
+
+/**
+ *  Streams that break the format, each in a single way.
+ */
+TEST(corrupt_streams)
+{
+    const auto invalid = [](const char* name, const bit_writer& stream) {
+        const auto named = scope{"%s", name};
+        CHECK_THROWS(std::runtime_error, inflated(stream.output));
+    };
+
+    auto reserved = bit_writer{};
+    reserved.bits(1, 1);
+    reserved.bits(3, 2);
+    invalid("reserved block type", reserved);
+
+    auto complement = bit_writer{};
+    complement.bits(1, 1);
+    complement.bits(0, 2);
+    complement.output.insert(complement.output.end(), {0x01, 0x00, 0xff, 0xff, 0x00});
+    invalid("stored length and complement differ", complement);
+
+    auto distance = bit_writer{};
+    distance.bits(1, 1);
+    distance.bits(1, 2);
+    distance.fixed('A');
+    distance.fixed(257);
+    distance.code(1, 5);
+    distance.fixed(256);
+    invalid("distance beyond the output", distance);
+
+    auto length_symbol = bit_writer{};
+    length_symbol.bits(1, 1);
+    length_symbol.bits(1, 2);
+    length_symbol.fixed('A');
+    length_symbol.fixed(286);
+    length_symbol.code(0, 5);
+    length_symbol.fixed(256);
+    invalid("length symbol 286", length_symbol);
+
+    auto distance_symbol = bit_writer{};
+    distance_symbol.bits(1, 1);
+    distance_symbol.bits(1, 2);
+    distance_symbol.fixed('A');
+    distance_symbol.fixed(257);
+    distance_symbol.code(30, 5);
+    distance_symbol.fixed(256);
+    invalid("distance symbol 30", distance_symbol);
+
+    auto literals = bit_writer{};
+    literals.bits(1, 1);
+    literals.bits(2, 2);
+    literals.bits(30, 5);
+    literals.bits(0, 5);
+    literals.bits(0, 4);
+    invalid("287 literal and length codes", literals);
+
+    auto oversubscribed = bit_writer{};
+    oversubscribed.bits(1, 1);
+    oversubscribed.bits(2, 2);
+    oversubscribed.bits(0, 5);
+    oversubscribed.bits(0, 5);
+    oversubscribed.bits(15, 4);
+    for (auto index = 0; index < 19; ++index) oversubscribed.bits(1, 3);
+    invalid("oversubscribed code length code", oversubscribed);
+
+    // Code lengths 16 and 17 are given one bit each, so 16 is coded as 0.
+    auto repeat = bit_writer{};
+    repeat.bits(1, 1);
+    repeat.bits(2, 2);
+    repeat.bits(0, 5);
+    repeat.bits(0, 5);
+    repeat.bits(0, 4);
+    repeat.bits(1, 3);
+    repeat.bits(1, 3);
+    repeat.bits(0, 3);
+    repeat.bits(0, 3);
+    repeat.code(0, 1);
+    repeat.bits(0, 2);
+    invalid("repeat of the first code length", repeat);
+
+    // Code lengths 17 and 18 are given one bit each, so 18 is coded as 1.
+    auto unterminated = bit_writer{};
+    unterminated.bits(1, 1);
+    unterminated.bits(2, 2);
+    unterminated.bits(0, 5);
+    unterminated.bits(0, 5);
+    unterminated.bits(0, 4);
+    unterminated.bits(0, 3);
+    unterminated.bits(1, 3);
+    unterminated.bits(1, 3);
+    unterminated.bits(0, 3);
+    unterminated.code(1, 1);
+    unterminated.bits(127, 7);
+    unterminated.code(1, 1);
+    unterminated.bits(109, 7);
+    invalid("no end-of-block code", unterminated);
+
+    auto overlong = bit_writer{};
+    overlong.bits(1, 1);
+    overlong.bits(1, 2);
+    for (auto index = 0; index < 4; ++index) overlong.fixed('A');
+    overlong.fixed(256);
+    {
+        const auto named = scope{"output beyond the limit"};
+        CHECK_THROWS(std::runtime_error, inflated(overlong.output, 3));
+        check_bytes(inflated(overlong.output, 4), {'A', 'A', 'A', 'A'});
+        CHECK_THROWS(std::runtime_error, inflated(dynamic_stream, rom_payload().size() - 1));
+        CHECK_THROWS(std::runtime_error, inflated(stored_stream(rom_payload(), 5000), rom_payload().size() - 1));
+    }
+}
+
+/**
+ *  Any byte of a file changed is caught, by the decoder or by the checks on
+ *  its output; changes to parts that do not matter, such as the name in a
+ *  gzip header, leave the output as it was.
+ */
+TEST(corrupt_files)
+{
+    const auto payload = rom_payload();
+    const auto check_corrupted = [](const std::vector<std::uint8_t>& file, auto unpack, const std::vector<std::uint8_t>& payload) {
+        for (auto index = std::size_t{0}; index < file.size(); ++index) {
+            for (const auto mask : {0x01, 0x80, 0xff}) {
+                auto corrupted = file;
+                corrupted[index] ^= static_cast<std::uint8_t>(mask);
+                try {
+                    const auto output = unpack(corrupted);
+                    const auto named = scope{"byte %zu ^ $%02x", index, mask};
+                    CHECK(output == payload);
+                } catch (const std::runtime_error&) {
+                }
+            }
+        }
+    };
+
+    {
+        const auto named = scope{"gzip"};
+        check_corrupted(gzip(dynamic_stream, payload), gunzipped, payload);
+        check_corrupted(gzip(fixed_stream, payload), gunzipped, payload);
+    }
+    {
+        const auto named = scope{"zip"};
+        const auto readme = std::vector<std::uint8_t>{'r', 'e', 'a', 'd', ' ', 'm', 'e'};
+        check_corrupted(zip({{"game.nes", 8, dynamic_stream, payload}}), unzipped, payload);
+        check_corrupted(zip({{"readme.txt", 0, readme, readme}}), unzipped, readme);
+    }
+
+    auto trailer = gzip(dynamic_stream, payload);
+    trailer[trailer.size() - 8] ^= 0x01;
+    CHECK_THROWS(std::runtime_error, gunzipped(trailer));
+    trailer = gzip(dynamic_stream, payload);
+    trailer[trailer.size() - 4] ^= 0x01;
+    CHECK_THROWS(std::runtime_error, gunzipped(trailer));
+}
@@ -0,0 +1,168 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  The binary index of the ROM library, written and read back.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cartridge/library.h"
+#include "files.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  Entries that differ in every field, so that a field written or read in
+ *  the wrong place shows up.
+ */
+auto sample_entries() -> std::vector<library_entry>
+{
+    auto first = library_entry{};
+    first.path = "games/Первая игра (E).nes.gz";
+    first.digest.crc32 = 0x89abcdef;
+    for (auto index = 0u; index < first.digest.sha1.size(); ++index) first.digest.sha1[index] = static_cast<std::uint8_t>(index * 13 + 1);
+    first.mapper = 0x0123;
+    first.submapper = 0x0a;
+    first.timing = region::pal;
+    first.vertical_mirroring = true;
+    first.four_screen_vram = false;
+    first.persistent_memory = true;
+    first.prg_size = 0x00080000;
+    first.chr_size = 0x00040000;
+    first.prg_ram_size = 0x00002000;
+    first.prg_nvram_size = 0x00008000;
+    first.chr_ram_size = 0x00001000;
+    first.chr_nvram_size = 0x00000800;
+
+    auto second = library_entry{};
+    second.path = std::string(300, 'x') + ".nes";
+    second.digest.crc32 = 0x01234567;
+    for (auto index = 0u; index < second.digest.sha1.size(); ++index) second.digest.sha1[index] = static_cast<std::uint8_t>(0xff - index);
+    second.mapper = 4;
+    second.submapper = 1;
+    second.timing = region::dendy;
+    second.vertical_mirroring = false;
+    second.four_screen_vram = true;
+    second.persistent_memory = false;
+    second.prg_size = 0x00020000;
+    second.chr_size = 0;
+    second.prg_ram_size = 0x00000400;
+    second.prg_nvram_size = 0;
+    second.chr_ram_size = 0x00002000;
+    second.chr_nvram_size = 0x00010000;
+    return {first, second};
+}
+
+void check_entry(const library_entry& actual, const library_entry& expected)
+{
+    CHECK(actual.path == expected.path);
+    CHECK_EQUAL(actual.digest.crc32, expected.digest.crc32);
+    CHECK(actual.digest.sha1 == expected.digest.sha1);
+    CHECK_EQUAL(actual.mapper, expected.mapper);
+    CHECK_EQUAL(actual.submapper, expected.submapper);
+    CHECK(actual.timing == expected.timing);
+    CHECK_EQUAL(actual.vertical_mirroring, expected.vertical_mirroring);
+    CHECK_EQUAL(actual.four_screen_vram, expected.four_screen_vram);
+    CHECK_EQUAL(actual.persistent_memory, expected.persistent_memory);
+    CHECK_EQUAL(actual.prg_size, expected.prg_size);
+    CHECK_EQUAL(actual.chr_size, expected.chr_size);
+    CHECK_EQUAL(actual.prg_ram_size, expected.prg_ram_size);
+    CHECK_EQUAL(actual.prg_nvram_size, expected.prg_nvram_size);
+    CHECK_EQUAL(actual.chr_ram_size, expected.chr_ram_size);
+    CHECK_EQUAL(actual.chr_nvram_size, expected.chr_nvram_size);
+}
+
+/**
+ *  The bytes of the index saved for the sample entries.
+ */
+auto saved_index() -> std::vector<std::uint8_t>
+{
+    const auto index = temporary_file{"saved.index", {}};
+    rom_library{sample_entries()}.save(index.path());
+    auto stream = std::ifstream{index.path(), std::ios::binary};
+    return {std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+}
+}
+
+
+/**
+ *  Every field of every entry comes back as saved, and the entries are
+ *  still found by CRC and by title.
+ */
+TEST(library_round_trip)
+{
+    const auto library = rom_library{sample_entries()};
+    const auto index = temporary_file{"round_trip.index", {}};
+    library.save(index.path());
+    const auto loaded = rom_library::load(index.path());
+
+    CHECK_EQUAL(loaded.entries().size(), library.entries().size());
+    for (auto entry = 0u; entry < loaded.entries().size() && entry < library.entries().size(); ++entry) {
+        const auto named = scope{"entry %u", entry};
+        check_entry(loaded.entries()[entry], library.entries()[entry]);
+    }
+    for (const auto& expected : sample_entries()) {
+        const auto named = scope{"CRC %08x", expected.digest.crc32};
+        const auto by_crc = loaded.find(expected.digest.crc32);
+        CHECK(by_crc != nullptr);
+        if (by_crc != nullptr) check_entry(*by_crc, expected);
+        CHECK(loaded.find(expected.title()) == by_crc);
+    }
+
+    const auto empty = temporary_file{"empty_library.index", {}};
+    rom_library{}.save(empty.path());
+    CHECK_EQUAL(rom_library::load(empty.path()).entries().size(), 0);
+}
+
+/**
+ *  Files that are not an index, or that end before the last entry does,
+ *  are rejected rather than read past their end.
+ */
+TEST(invalid_index)
+{
+    const auto saved = saved_index();
+    CHECK(saved.size() > 8);
+
+    auto magic = saved;
+    magic[3] = 'J';
+    const auto wrong = temporary_file{"wrong_magic.index", magic};
+    CHECK_THROWS(std::runtime_error, rom_library::load(wrong.path()));
+
+    for (auto size = std::size_t{0}; size < saved.size(); ++size) {
+        const auto named = scope{"%zu of %zu bytes", size, saved.size()};
+        const auto truncated = temporary_file{"truncated.index", {saved.begin(), saved.begin() + size}};
+        CHECK_THROWS(std::runtime_error, rom_library::load(truncated.path()));
+    }
+
+    auto inflated = std::vector<std::uint8_t>(saved.begin(), saved.begin() + 8);
+    inflated[4] = inflated[5] = inflated[6] = inflated[7] = 0xff;
+    const auto counted = temporary_file{"inflated.index", inflated};
+    CHECK_THROWS(std::runtime_error, rom_library::load(counted.path()));
+
+    CHECK_THROWS(std::invalid_argument, rom_library::load(fs::temp_directory_path() / "nes-tester-missing.index"));
+}
@@ -0,0 +1,95 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  A console put together from its devices, running ROM images built in
+ *  memory, for the tests.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "console/console.h"
+#include "image.h"
+#include "test.h"
+
+namespace nes::test {
+/**
+ *  The console, with accessors for the tests.
+ */
+template<typename Variant = ricoh_2a03, typename Dispatch = default_dispatch>
+struct machine : basic_console<Variant, Dispatch> {
+    using basic_console<Variant, Dispatch>::basic_console;
+
+    auto read(std::uint16_t address) -> std::uint8_t
+    {
+        return this->memory.read(word{address});
+    }
+
+    void write(std::uint16_t address, std::uint8_t data)
+    {
+        this->memory.write(word{address}, byte{data});
+    }
+
+    /**
+     *  Steps until the program counter reaches the given address, giving up
+     *  after the given number of instructions.
+     */
+    auto step_to(std::uint16_t address, int limit = 100000) -> bool
+    {
+        for (auto count = 0; count < limit; ++count) {
+            if (this->processor().state().program_counter == address) return true;
+            this->processor().step();
+        }
+        return false;
+    }
+};
+
+/**
+ *  Runs the given code from $8000 on a new machine until it runs off its end.
+ */
+template<typename Variant = ricoh_2a03, typename Dispatch = default_dispatch>
+auto run_code(const std::vector<std::uint8_t>& code) -> std::unique_ptr<machine<Variant, Dispatch>>
+{
+    auto result = std::make_unique<machine<Variant, Dispatch>>(nrom_image(code));
+    result->step_to(static_cast<std::uint16_t>(0x8000 + code.size()));
+    return result;
+}
+
+
+/**
+ *  Runs the given check once for each dispatch engine, which it is given as
+ *  a tag.
+ */
+template<typename Check>
+void for_each_dispatch(Check check)
+{
+    {
+        const auto named = scope{"switch dispatch"};
+        check(switch_dispatch{});
+    }
+    {
+        const auto named = scope{"threaded dispatch"};
+        check(threaded_dispatch{});
+    }
+}
+}
@@ -0,0 +1,279 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Bank layouts and mirroring of the mappers, as set through their registers.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  Cartridge for the given board, with the given number of 16 KB PRG and
+ *  8 KB CHR banks. Every 8 KB PRG bank and 1 KB CHR bank is filled with its
+ *  own number, so that reads tell which bank is mapped.
+ */
+auto numbered(std::uint8_t mapper, std::size_t prg_banks, std::size_t chr_banks) -> cartridge
+{
+    auto prg = std::vector<std::uint8_t>(prg_banks * 0x4000);
+    for (auto index = 0u; index < prg.size(); ++index) prg[index] = static_cast<std::uint8_t>(index / 0x2000);
+    auto chr = std::vector<std::uint8_t>(chr_banks * 0x2000);
+    for (auto index = 0u; index < chr.size(); ++index) chr[index] = static_cast<std::uint8_t>(index / 0x400);
+    return cartridge{read_rom(make_image(mapper, prg, chr))};
+}
+
+/**
+ *  The 8 KB PRG banks mapped at $8000, $a000, $c000 and $e000.
+ */
+void check_prg(const cartridge& cart, std::uint8_t first, std::uint8_t second, std::uint8_t third, std::uint8_t fourth)
+{
+    CHECK_EQUAL(cart.read(word{0x8000}), first);
+    CHECK_EQUAL(cart.read(word{0xbfff}), second);
+    CHECK_EQUAL(cart.read(word{0xc000}), third);
+    CHECK_EQUAL(cart.read(word{0xffff}), fourth);
+    for (auto window = 0; window < 4; ++window) {
+        const auto address = word{0x8000 + window * 0x2000};
+        CHECK_EQUAL(cart.bank(address), cart.read(address));
+        CHECK_EQUAL(cart.read_page(address)[0], cart.read(address));
+    }
+}
+
+/**
+ *  The 1 KB CHR banks mapped at $0000 and $1000.
+ */
+void check_chr(const cartridge& cart, std::uint8_t lower, std::uint8_t upper)
+{
+    CHECK_EQUAL(cart.read_chr(word{0x0000}), lower);
+    CHECK_EQUAL(cart.read_chr(word{0x0400}), lower + 1);
+    CHECK_EQUAL(cart.read_chr(word{0x1000}), upper);
+    CHECK_EQUAL(cart.read_chr(word{0x1c00}), upper + 3);
+}
+
+void check_remapped(cartridge& cart, std::uint32_t begin, std::uint32_t end)
+{
+    const auto moved = cart.remapped();
+    CHECK_EQUAL(moved.begin, begin);
+    CHECK_EQUAL(moved.end, end);
+    const auto again = cart.remapped();
+    CHECK_EQUAL(again.end - again.begin, 0);
+}
+
+/**
+ *  MMC1 registers are loaded with five writes of one bit each, least
+ *  significant first; the address of the last write selects the register.
+ */
+void serial(cartridge& cart, std::uint16_t address, std::uint8_t value)
+{
+    for (auto bit = 0; bit < 5; ++bit) cart.write(word{address}, byte{(value >> bit) & 0x01});
+}
+}
+
+
+TEST(mmc1_power_on)
+{
+    auto cart = numbered(1, 8, 4);
+    check_prg(cart, 0, 1, 14, 15);
+    check_chr(cart, 0, 4);
+    check_remapped(cart, 0, 0);
+}
+
+/**
+ *  Nothing changes until the fifth write; four writes leave the register
+ *  as it was, and the fifth completes it.
+ */
+TEST(mmc1_serial_writes)
+{
+    auto cart = numbered(1, 8, 4);
+    for (auto bit = 0; bit < 4; ++bit) {
+        const auto named = scope{"write %d", bit};
+        cart.write(word{0xe000}, byte{(0x05 >> bit) & 0x01});
+        check_prg(cart, 0, 1, 14, 15);
+        check_remapped(cart, 0, 0);
+    }
+    cart.write(word{0xe000}, byte{0x00});
+    check_prg(cart, 10, 11, 14, 15);
+    check_remapped(cart, 0x8000, 0x10000);
+
+    // The last write picks the register, whatever the earlier ones went to.
+    for (auto bit = 0; bit < 4; ++bit) cart.write(word{0x8000}, byte{(0x03 >> bit) & 0x01});
+    cart.write(word{0xe000}, byte{0x00});
+    check_prg(cart, 6, 7, 14, 15);
+}
+
+/**
+ *  A write with bit 7 set empties the shift register, so that the next
+ *  five writes load a register from scratch, and sets PRG mode 3.
+ */
+TEST(mmc1_reset)
+{
+    auto cart = numbered(1, 8, 4);
+    serial(cart, 0x8000, 0x00);
+    serial(cart, 0xe000, 0x02);
+    check_prg(cart, 4, 5, 6, 7);
+    check_remapped(cart, 0x8000, 0x10000);
+
+    cart.write(word{0xe000}, byte{0x01});
+    cart.write(word{0xe000}, byte{0x01});
+    cart.write(word{0x8000}, byte{0x80});
+    check_prg(cart, 4, 5, 14, 15);
+    check_remapped(cart, 0x8000, 0x10000);
+
+    serial(cart, 0xe000, 0x06);
+    check_prg(cart, 12, 13, 14, 15);
+}
+
+TEST(mmc1_prg_modes)
+{
+    struct layout {
+        std::uint8_t control;
+        std::uint8_t banks[4];
+    };
+    const layout layouts[] = {
+        {0x00, {8, 9, 10, 11}},     // 32 KB, ignoring the lowest bit
+        {0x04, {8, 9, 10, 11}},
+        {0x08, {0, 1, 10, 11}},     // first bank fixed at $8000
+        {0x0c, {10, 11, 14, 15}},   // last bank fixed at $c000
+    };
+
+    for (const auto& tested : layouts) {
+        const auto named = scope{"control $%02x", tested.control};
+        auto cart = numbered(1, 8, 4);
+        serial(cart, 0xe000, 0x05);
+        cart.remapped();
+        serial(cart, 0x8000, tested.control);
+        check_prg(cart, tested.banks[0], tested.banks[1], tested.banks[2], tested.banks[3]);
+        check_remapped(cart, 0x8000, 0x10000);
+    }
+}
+
+TEST(mmc1_chr_modes)
+{
+    auto cart = numbered(1, 8, 4);
+    serial(cart, 0xa000, 0x03);
+    serial(cart, 0xc000, 0x06);
+    check_chr(cart, 8, 12);
+
+    serial(cart, 0x8000, 0x1c);
+    check_chr(cart, 12, 24);
+}
+
+/**
+ *  The two lowest control bits select the mirroring, which only changes
+ *  once the control register is complete.
+ */
+TEST(mmc1_mirroring)
+{
+    const mirroring arrangements[] = {
+        mirroring::single_lower, mirroring::single_upper, mirroring::vertical, mirroring::horizontal
+    };
+    for (auto control = 0; control < 4; ++control) {
+        const auto named = scope{"control $%02x", control};
+        auto cart = numbered(1, 8, 4);
+        serial(cart, 0x8000, static_cast<std::uint8_t>(0x0c | control));
+        CHECK(cart.arrangement() == arrangements[control]);
+    }
+
+    auto cart = numbered(1, 8, 4);
+    serial(cart, 0x8000, 0x0e);
+    for (auto bit = 0; bit < 4; ++bit) cart.write(word{0x8000}, byte{(0x0f >> bit) & 0x01});
+    CHECK(cart.arrangement() == mirroring::vertical);
+    cart.write(word{0x8000}, byte{0x00});
+    CHECK(cart.arrangement() == mirroring::horizontal);
+}
+
+
+/**
+ *  UxROM switches the 16 KB bank at $8000 and keeps the last at $c000.
+ */
+TEST(uxrom_banks)
+{
+    auto cart = numbered(2, 8, 0);
+    check_prg(cart, 0, 1, 14, 15);
+
+    cart.write(word{0x8000}, byte{0x03});
+    check_prg(cart, 6, 7, 14, 15);
+    check_remapped(cart, 0x8000, 0xc000);
+
+    cart.write(word{0xffff}, byte{0x09});
+    check_prg(cart, 2, 3, 14, 15);
+    check_remapped(cart, 0x8000, 0xc000);
+
+    // Boards without CHR ROM have CHR RAM instead.
+    cart.write_chr(word{0x1234}, byte{0x56});
+    CHECK_EQUAL(cart.read_chr(word{0x1234}), 0x56);
+}
+
+/**
+ *  CNROM switches 8 KB of CHR ROM, and never remaps PRG ROM.
+ */
+TEST(cnrom_banks)
+{
+    auto cart = numbered(3, 2, 4);
+    check_prg(cart, 0, 1, 2, 3);
+    check_chr(cart, 0, 4);
+
+    cart.write(word{0x8000}, byte{0x02});
+    check_chr(cart, 16, 20);
+    check_prg(cart, 0, 1, 2, 3);
+    check_remapped(cart, 0, 0);
+
+    cart.write_chr(word{0x0000}, byte{0xff});
+    CHECK_EQUAL(cart.read_chr(word{0x0000}), 16);
+}
+
+/**
+ *  AxROM switches all 32 KB of PRG ROM, and selects a single nametable.
+ */
+TEST(axrom_banks)
+{
+    auto cart = numbered(7, 8, 0);
+    check_prg(cart, 0, 1, 2, 3);
+    CHECK(cart.arrangement() == mirroring::single_lower);
+
+    cart.write(word{0x8000}, byte{0x12});
+    check_prg(cart, 8, 9, 10, 11);
+    check_remapped(cart, 0x8000, 0x10000);
+    CHECK(cart.arrangement() == mirroring::single_upper);
+
+    cart.write(word{0x8000}, byte{0x07});
+    check_prg(cart, 12, 13, 14, 15);
+    CHECK(cart.arrangement() == mirroring::single_lower);
+}
+
+/**
+ *  Banks switched through the bus are seen at once by reads through it.
+ */
+TEST(switching_through_the_bus)
+{
+    auto prg = std::vector<std::uint8_t>(0x20000);
+    for (auto index = 0u; index < prg.size(); ++index) prg[index] = static_cast<std::uint8_t>(index / 0x2000);
+    auto system = machine<>{read_rom(make_image(2, prg))};
+    CHECK_EQUAL(system.read(0x8000), 0);
+    system.write(0x8000, 0x05);
+    CHECK_EQUAL(system.read(0x8000), 10);
+    CHECK_EQUAL(system.read(0xbfff), 11);
+    CHECK_EQUAL(system.read(0xc000), 14);
+}
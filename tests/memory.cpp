@@ -0,0 +1,407 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Decoding of bus accesses through the page table, and what it keeps track
+ *  of on the way: dirty pages and watchpoints.
+ */
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  Pages marked in the given dirty map, in order.
+ */
+template<std::size_t pages>
+auto marked(const dirty_map<pages>& map) -> std::vector<std::size_t>
+{
+    auto result = std::vector<std::size_t>{};
+    for (auto page = std::size_t{0}; page < pages; ++page)
+        if (map.dirty(page)) result.push_back(page);
+    return result;
+}
+
+void check_marked(const std::vector<std::size_t>& actual, const std::vector<std::size_t>& expected)
+{
+    CHECK_EQUAL(actual.size(), expected.size());
+    for (auto index = std::size_t{0}; index < actual.size() && index < expected.size(); ++index) {
+        const auto named = scope{"entry %zu", index};
+        CHECK_EQUAL(actual[index], expected[index]);
+    }
+}
+
+/**
+ *  Plain memory at $0000-$017f, of which the second page is shared with a
+ *  register device at $0180-$01ff, so that it is reached through the
+ *  devices' handlers.
+ */
+struct partial_ram {
+    auto read(word address) const -> byte { return storage[address]; }
+    void write(word address, byte data) { storage[address] = data; }
+    bool contains(word address) const { return address < 0x180; }
+    auto read_page(word address) const -> const byte* { return storage.data() + address; }
+    auto write_page(word address) -> byte* { return storage.data() + address; }
+
+    std::array<byte, 0x200> storage = {};
+};
+
+struct partial_registers {
+    auto read(word) const -> byte { return byte{0x00}; }
+    void write(word, byte) {}
+    bool contains(word address) const { return address >= 0x180 && address < 0x200; }
+};
+}
+
+
+/**
+ *  Stores by the program are decoded through the page table, which marks
+ *  the page written in the dirty map, by the first page mapping the same
+ *  RAM; stores to registers mark nothing.
+ */
+TEST(decoded_writes_mark_dirty)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({
+        0xa9, 0x5a,         // LDA #$5a
+        0x85, 0x12,         // STA $12
+        0x8d, 0x45, 0x0b,   // STA $0b45, mirroring $0345
+        0x8d, 0x00, 0x20,   // STA $2000
+    }));
+    system->memory.dirty().snapshot();
+    CHECK(system->step_to(0x800a));
+    CHECK_EQUAL(system->read(0x0012), 0x5a);
+    CHECK_EQUAL(system->read(0x0345), 0x5a);
+    check_marked(marked(system->memory.dirty().snapshot()), {0x00, 0x03});
+
+    system->write(0x1812, 0xa5);
+    CHECK_EQUAL(system->read(0x0012), 0xa5);
+    check_marked(marked(system->memory.dirty().snapshot()), {0x00});
+}
+
+/**
+ *  The program's stores to RAM, the zero page and the stack mark their pages,
+ *  and OAM DMA marks the PPU's OAM; taking a snapshot clears both maps.
+ */
+TEST(dirty_pages)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({
+        0xa9, 0x11,         // $8000: LDA #$11
+        0x8d, 0x45, 0x03,   // $8002: STA $0345
+        0x85, 0x10,         // $8005: STA $10
+        0x48,               // $8007: PHA
+        0xa9, 0x02,         // $8008: LDA #$02
+        0x8d, 0x14, 0x40,   // $800a: STA $4014
+        0x4c, 0x0d, 0x80,   // $800d: JMP $800d
+    }));
+    system->write(0x0205, 0x77);
+    system->memory.dirty().snapshot();
+    system->ppu.dirty().snapshot();
+
+    system->processor().run(2000);
+    CHECK_EQUAL(system->processor().state().program_counter, 0x800d);
+    CHECK_EQUAL(system->read(0x01fd), 0x11);
+    check_marked(marked(system->memory.dirty()), {0x00, 0x01, 0x03});
+    CHECK(system->ppu.dirty().dirty(0));
+
+    check_marked(marked(system->memory.dirty().snapshot()), {0x00, 0x01, 0x03});
+    CHECK(system->ppu.dirty().snapshot().dirty(0));
+    check_marked(marked(system->memory.dirty()), {});
+    CHECK(!system->ppu.dirty().dirty(0));
+
+    system->write(0x2003, 0x05);
+    CHECK_EQUAL(system->read(0x2004), 0x77);
+    check_marked(marked(system->memory.dirty()), {});
+}
+
+/**
+ *  Writes that reach plain memory through its device's handler, rather than
+ *  through the page table, mark the page as well.
+ */
+TEST(device_writes_mark_dirty)
+{
+    auto ram = partial_ram{};
+    auto registers = partial_registers{};
+    auto bus = memory<partial_ram, partial_registers>{ram, registers};
+    bus.remap();
+
+    bus.write(word{0x0110}, byte{0x42});
+    CHECK_EQUAL(ram.storage[0x110], 0x42);
+    bus.write(word{0x0190}, byte{0x42});
+    check_marked(marked(bus.dirty().snapshot()), {0x01});
+
+    bus.write(word{0x0010}, byte{0x42});
+    check_marked(marked(bus.dirty().snapshot()), {0x00});
+}
+
+/**
+ *  Pushes and pulls go through the bus, so watchpoints on the stack page see
+ *  them, once for each access.
+ */
+TEST(stack_watchpoints)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({
+        0xa9, 0x33,         // $8000: LDA #$33
+        0x48,               // $8002: PHA
+        0x68,               // $8003: PLA
+        0x20, 0x0a, 0x80,   // $8004: JSR $800a
+        0x4c, 0x07, 0x80,   // $8007: JMP $8007
+        0x60,               // $800a: RTS
+    }));
+    auto seen = std::map<std::pair<watchpoint, std::uint16_t>, int>{};
+    auto data = std::map<std::pair<watchpoint, std::uint16_t>, std::uint8_t>{};
+    system->memory.on_watch([&](watchpoint type, word address, byte value) {
+        ++seen[{type, address}];
+        data[{type, address}] = value;
+    });
+    system->memory.watch(word{0x01fd}, watchpoint::write);
+    system->memory.watch(word{0x01fd}, watchpoint::read);
+    system->memory.watch(word{0x01fc}, watchpoint::write);
+
+    CHECK(system->step_to(0x8004));
+    CHECK_EQUAL((seen[{watchpoint::write, 0x01fd}]), 1);
+    CHECK_EQUAL((data[{watchpoint::write, 0x01fd}]), 0x33);
+    CHECK_EQUAL((seen[{watchpoint::read, 0x01fd}]), 1);
+
+    system->processor().run(100);
+    CHECK_EQUAL(system->processor().state().program_counter, 0x8007);
+    CHECK_EQUAL((seen[{watchpoint::write, 0x01fd}]), 2);
+    CHECK_EQUAL((data[{watchpoint::write, 0x01fd}]), 0x80);
+    CHECK_EQUAL((seen[{watchpoint::write, 0x01fc}]), 1);
+    CHECK_EQUAL((data[{watchpoint::write, 0x01fc}]), 0x06);
+    CHECK_EQUAL((seen[{watchpoint::read, 0x01fd}]), 2);
+}
+
+/**
+ *  A bank switch through the bus updates the page table, so that reads by
+ *  every path see the new bank at once, also on a page that was watched
+ *  while the bank was switched and is unwatched after.
+ */
+TEST(page_table_after_bank_switch)
+{
+    auto prg = std::vector<std::uint8_t>(0x20000);
+    for (auto index = 0u; index < prg.size(); ++index) prg[index] = static_cast<std::uint8_t>(index / 0x2000);
+    auto system = std::make_unique<machine<>>(read_rom(make_image(2, prg)));
+
+    system->write(0x8000, 0x05);
+    for (auto page = 0x80; page < 0xc0; ++page) {
+        const auto named = scope{"page $%02x", page};
+        const auto address = word{page << 8 | 0x80};
+        const auto expected = page < 0xa0 ? 10 : 11;
+        CHECK_EQUAL(system->memory.read(address), expected);
+        CHECK_EQUAL(system->memory.peek(address), expected);
+        CHECK_EQUAL(system->memory.read_word(address), expected << 8 | expected);
+        CHECK_EQUAL(system->memory.bank(address), system->cart.bank(address));
+    }
+    CHECK_EQUAL(system->read(0xc000), 14);
+    CHECK_EQUAL(system->read(0xffff), 15);
+
+    auto seen = std::vector<std::uint8_t>{};
+    system->memory.on_watch([&](watchpoint, word, byte data) { seen.push_back(data); });
+    system->memory.watch(word{0x8123}, watchpoint::read);
+    system->write(0x8000, 0x03);
+    CHECK_EQUAL(system->read(0x8123), 6);
+    CHECK_EQUAL(system->read(0x8124), 6);
+    CHECK_EQUAL(seen.size(), 1);
+    if (!seen.empty()) CHECK_EQUAL(seen[0], 6);
+
+    system->memory.unwatch(word{0x8123}, watchpoint::read);
+    system->write(0x8000, 0x01);
+    CHECK_EQUAL(system->read(0x8123), 2);
+    CHECK_EQUAL(system->memory.read_word(word{0x8123}), 0x0202);
+    CHECK_EQUAL(seen.size(), 1);
+}
+
+/**
+ *  The 2 KB of internal RAM appear four times over $0000-$1fff, and the eight
+ *  PPU registers every 8 bytes over $2000-$3fff.
+ */
+TEST(mirrored_addresses)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({}));
+    for (const auto offset : {0x000, 0x0ff, 0x100, 0x456, 0x7ff}) {
+        for (auto mirror = 0; mirror < 4; ++mirror) {
+            const auto named = scope{"offset $%03x, written through mirror %d", offset, mirror};
+            const auto value = static_cast<std::uint8_t>(offset + mirror * 0x40 + 1);
+            system->write(static_cast<std::uint16_t>(mirror * 0x800 + offset), value);
+            for (auto other = 0; other < 4; ++other)
+                CHECK_EQUAL(system->read(static_cast<std::uint16_t>(other * 0x800 + offset)), value);
+        }
+    }
+
+    for (const auto base : {0x2000, 0x2008, 0x2bc0, 0x3ff8}) {
+        const auto named = scope{"registers at $%04x", base};
+        const auto value = static_cast<std::uint8_t>(base >> 4);
+        system->write(static_cast<std::uint16_t>(base + 3), 0x20);
+        system->write(static_cast<std::uint16_t>(base + 4), value);
+        system->write(0x2003, 0x20);
+        CHECK_EQUAL(system->read(0x3ffc), value);
+        system->write(static_cast<std::uint16_t>(base + 3), 0x20);
+        CHECK_EQUAL(system->read(static_cast<std::uint16_t>(base + 4)), value);
+    }
+}
+
+/**
+ *  Block transfers copy pages of plain memory at once and go byte by byte
+ *  through devices and watched pages, so a block that spans both must come
+ *  out as the same accesses made one at a time.
+ */
+TEST(block_transfers)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({}));
+    auto source = std::vector<byte>{};
+    for (auto index = 0; index < 0x20; ++index) source.push_back(byte{0x40 + index});
+
+    system->memory.dirty().snapshot();
+    system->memory.write_block(word{0x02f0}, source);
+    for (auto index = 0; index < 0x20; ++index) {
+        const auto named = scope{"offset %d", index};
+        CHECK_EQUAL(system->read(static_cast<std::uint16_t>(0x02f0 + index)), 0x40 + index);
+    }
+    check_marked(marked(system->memory.dirty().snapshot()), {0x02, 0x03});
+
+    auto copied = std::vector<byte>(0x20);
+    system->memory.read_block(word{0x0af0}, copied);
+    for (auto index = 0; index < 0x20; ++index) CHECK_EQUAL(copied[index], 0x40 + index);
+
+    // From the end of RAM into the PPU registers: the last two bytes of RAM,
+    // then PPUCTRL, PPUMASK, PPUSTATUS, OAMADDR, OAMDATA and PPUSCROLL.
+    const auto spanning = std::vector<byte>{byte{0x11}, byte{0x22}, byte{0x00}, byte{0x00},
+        byte{0x00}, byte{0x30}, byte{0x99}, byte{0x00}};
+    system->memory.write_block(word{0x1ffe}, spanning);
+    CHECK_EQUAL(system->read(0x07fe), 0x11);
+    CHECK_EQUAL(system->read(0x07ff), 0x22);
+    system->write(0x2003, 0x30);
+    auto oam = std::vector<byte>(1);
+    system->memory.read_block(word{0x2004}, oam);
+    CHECK_EQUAL(oam[0], 0x99);
+
+    auto watched = std::vector<std::uint16_t>{};
+    system->memory.on_watch([&](watchpoint, word address, byte) { watched.push_back(address); });
+    system->memory.watch(word{0x0305}, watchpoint::write);
+    system->memory.dirty().snapshot();
+    system->memory.write_block(word{0x02f0}, std::vector<byte>(0x20, byte{0x5a}));
+    CHECK_EQUAL(watched.size(), 1);
+    if (!watched.empty()) CHECK_EQUAL(watched[0], 0x0305);
+    CHECK_EQUAL(system->read(0x0305), 0x5a);
+    CHECK_EQUAL(system->read(0x02f0), 0x5a);
+    check_marked(marked(system->memory.dirty().snapshot()), {0x02, 0x03});
+}
+
+/**
+ *  Every watched access is reported once, with its data, and only for the
+ *  kind of access watched. Unwatching one kind leaves the others at the
+ *  same address in place; unwatching the last removes the watchpoint.
+ */
+TEST(watchpoints)
+{
+    auto system = std::make_unique<machine<>>(nrom_image({
+        0xad, 0x00, 0x03,   // $8000: LDA $0300
+        0x8d, 0x01, 0x03,   // $8003: STA $0301
+        0xea,               // $8006: NOP
+        0xad, 0x01, 0x03,   // $8007: LDA $0301
+        0x4c, 0x00, 0x80,   // $800a: JMP $8000
+    }));
+    system->write(0x0300, 0x66);
+    auto seen = std::map<std::pair<watchpoint, std::uint16_t>, int>{};
+    auto data = std::map<std::pair<watchpoint, std::uint16_t>, std::uint8_t>{};
+    system->memory.on_watch([&](watchpoint type, word address, byte value) {
+        ++seen[{type, address}];
+        data[{type, address}] = value;
+    });
+    system->memory.watch(word{0x0300}, watchpoint::read);
+    system->memory.watch(word{0x0300}, watchpoint::write);
+    system->memory.watch(word{0x0301}, watchpoint::write);
+    system->processor().breakpoint(word{0x8006});
+
+    CHECK(system->step_to(0x800a));
+    CHECK_EQUAL(seen.size(), 3);
+    CHECK_EQUAL((seen[{watchpoint::read, 0x0300}]), 1);
+    CHECK_EQUAL((data[{watchpoint::read, 0x0300}]), 0x66);
+    CHECK_EQUAL((seen[{watchpoint::write, 0x0301}]), 1);
+    CHECK_EQUAL((data[{watchpoint::write, 0x0301}]), 0x66);
+    CHECK_EQUAL((seen[{watchpoint::execute, 0x8006}]), 1);
+    CHECK_EQUAL((data[{watchpoint::execute, 0x8006}]), 0xea);
+
+    system->memory.unwatch(word{0x0300}, watchpoint::write);
+    system->memory.unwatch(word{0x0301}, watchpoint::write);
+    system->processor().clear_breakpoint(word{0x8006});
+    CHECK(!system->memory.watching(watchpoint::write));
+    CHECK(!system->memory.watching(watchpoint::execute));
+    system->processor().step();
+    CHECK(system->step_to(0x800a));
+    CHECK_EQUAL((seen[{watchpoint::read, 0x0300}]), 2);
+    CHECK_EQUAL((seen[{watchpoint::write, 0x0301}]), 1);
+    CHECK_EQUAL((seen[{watchpoint::execute, 0x8006}]), 1);
+
+    system->memory.unwatch(word{0x0300}, watchpoint::read);
+    CHECK(!system->memory.watching(watchpoint::read));
+    system->processor().run(1000);
+    CHECK_EQUAL((seen[{watchpoint::read, 0x0300}]), 2);
+    CHECK_EQUAL((seen[{watchpoint::write, 0x0301}]), 1);
+    CHECK_EQUAL((seen[{watchpoint::execute, 0x8006}]), 1);
+    CHECK_EQUAL(seen.size(), 3);
+}
+
+/**
+ *  Words read at the end of a page: read_word() takes the high byte from the
+ *  next page, read_word_wrapped() from the start of the same page, as JMP
+ *  ($10ff) does, whether the page is plain memory, watched or ROM. Within a
+ *  page both read the two bytes that follow each other.
+ */
+TEST(word_reads)
+{
+    auto code = std::vector<std::uint8_t>(0x200, 0xea);
+    code[0x0ff] = 0x78;
+    code[0x000] = 0x56;
+    code[0x100] = 0x9a;
+    auto system = std::make_unique<machine<>>(nrom_image(code));
+    system->write(0x10ff, 0x34);
+    system->write(0x1000, 0x12);
+    system->write(0x1100, 0x56);
+    system->write(0x10fe, 0x21);
+
+    const auto check_ram = [&] {
+        CHECK_EQUAL(system->memory.read_word(word{0x10ff}), 0x5634);
+        CHECK_EQUAL(system->memory.read_word_wrapped(word{0x10ff}), 0x1234);
+        CHECK_EQUAL(system->memory.read_word(word{0x10fe}), 0x3421);
+        CHECK_EQUAL(system->memory.read_word_wrapped(word{0x10fe}), 0x3421);
+        CHECK_EQUAL(system->memory.read_word_wrapped(word{0x00ff}), 0x1234);
+    };
+    check_ram();
+    {
+        const auto named = scope{"watched"};
+        system->memory.watch(word{0x1080}, watchpoint::read);
+        check_ram();
+        system->memory.unwatch(word{0x1080}, watchpoint::read);
+    }
+
+    CHECK_EQUAL(system->memory.read_word(word{0x80ff}), 0x9a78);
+    CHECK_EQUAL(system->memory.read_word_wrapped(word{0x80ff}), 0x5678);
+    CHECK_EQUAL(system->memory.read_word(word{0xfffc}), 0x8000);
+}
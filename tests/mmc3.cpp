@@ -0,0 +1,207 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  The MMC3 counts scanlines in closed form and schedules its IRQ ahead;
+ *  the IRQs it raises must be those of a counter clocked once per scanline.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+constexpr std::int64_t dots_per_scanline = 341;
+constexpr std::int64_t dots_per_frame = 262 * dots_per_scanline;
+constexpr std::int64_t frames = 3;
+
+/**
+ *  A write to a mapper register at the given CPU cycle.
+ */
+struct register_write {
+    std::int64_t cycle;
+    std::uint16_t address;
+    std::uint8_t data;
+};
+
+/**
+ *  CPU cycle in the middle of the given scanline, well away from its rise.
+ */
+constexpr auto during(std::int64_t frame, std::int64_t line) -> std::int64_t
+{
+    return (frame * dots_per_frame + line * dots_per_scanline + 100) / 3;
+}
+
+/**
+ *  The counter as the hardware runs it: clocked at every rise of A12 on the
+ *  visible and pre-render scanlines, raising its IRQ whenever a clock
+ *  leaves it at zero while enabled. Returns the CPU cycles of the IRQs.
+ */
+auto stepped(const std::vector<register_write>& writes, std::int64_t rise) -> std::vector<std::int64_t>
+{
+    auto latch = 0, counter = 0;
+    auto reload = false, enabled = false;
+    auto pending = writes.begin();
+    auto result = std::vector<std::int64_t>{};
+
+    for (auto frame = 0; frame < frames; ++frame) {
+        for (auto line = 0; line < 262; ++line) {
+            if (line >= 240 && line != 261) continue;
+            const auto dot = frame * dots_per_frame + line * dots_per_scanline + rise;
+            for (; pending != writes.end() && pending->cycle * 3 < dot; ++pending) {
+                switch (pending->address & 0xe001) {
+                case 0xc000: latch = pending->data; break;
+                case 0xc001: counter = 0; reload = true; break;
+                case 0xe000: enabled = false; break;
+                case 0xe001: enabled = true; break;
+                }
+            }
+
+            if (counter == 0 || reload) {
+                counter = latch;
+                reload = false;
+            } else {
+                --counter;
+            }
+            if (counter == 0 && enabled) result.push_back((dot + 2) / 3);
+        }
+    }
+    return result;
+}
+
+/**
+ *  The cartridge's counter, connected to a scheduler whose events are
+ *  delivered as the processor does, catching the cartridge up each time.
+ */
+auto predicted(const std::vector<register_write>& writes, std::int64_t rise) -> std::vector<std::int64_t>
+{
+    auto cart = cartridge{read_rom(make_image(4, std::vector<std::uint8_t>(0x8000), std::vector<std::uint8_t>(0x2000)))};
+    auto events = scheduler{};
+    auto result = std::vector<std::int64_t>{};
+    cart.connect(events);
+    cart.retime(0, rise);
+
+    const auto deliver = [&](std::int64_t until) {
+        while (events.next() <= until) {
+            const auto due = events.next();
+            if (events.pop() == event::mapper_irq) result.push_back(due);
+            cart.catch_up(due);
+        }
+    };
+
+    for (const auto& write : writes) {
+        deliver(write.cycle);
+        cart.catch_up(write.cycle);
+        cart.write(word{write.address}, byte{write.data});
+    }
+    deliver(frames * dots_per_frame / 3);
+    return result;
+}
+
+void check_irqs(const std::vector<register_write>& writes)
+{
+    for (const auto rise : {260, 324}) {
+        const auto named = scope{"rise at dot %d", rise};
+        const auto expected = stepped(writes, rise);
+        const auto actual = predicted(writes, rise);
+        CHECK(!expected.empty());
+        CHECK_EQUAL(actual.size(), expected.size());
+        for (auto index = 0u; index < std::min(actual.size(), expected.size()); ++index) {
+            if (actual[index] == expected[index]) continue;
+            const auto irq = scope{"IRQ %u", index};
+            CHECK_EQUAL(actual[index], expected[index]);
+            break;
+        }
+    }
+}
+}
+
+
+/**
+ *  The counter reloads from the latch when it reaches zero, raising its
+ *  IRQ every latch + 1 scanlines.
+ */
+TEST(mmc3_irq_reload)
+{
+    check_irqs({
+        {10, 0xc000, 10},
+        {11, 0xc001, 0},
+        {12, 0xe001, 0},
+    });
+}
+
+/**
+ *  Writing $c001 clears the counter, so that it reloads on the next rise;
+ *  a new latch only takes effect at the next reload.
+ */
+TEST(mmc3_irq_reload_mid_frame)
+{
+    check_irqs({
+        {10, 0xc000, 10},
+        {11, 0xc001, 0},
+        {12, 0xe001, 0},
+        {during(0, 105), 0xc001, 0},
+        {during(0, 150), 0xc000, 3},
+        {during(0, 200), 0xc000, 40},
+        {during(0, 201), 0xc001, 0},
+        {during(1, 50), 0xc000, 7},
+        {during(1, 50) + 1, 0xc001, 0},
+    });
+}
+
+/**
+ *  With a latch of zero the counter is reloaded with zero on every rise,
+ *  and so raises its IRQ on every scanline.
+ */
+TEST(mmc3_irq_latch_of_zero)
+{
+    check_irqs({
+        {10, 0xc000, 0},
+        {11, 0xc001, 0},
+        {12, 0xe001, 0},
+        {during(0, 120), 0xc000, 5},
+        {during(1, 10), 0xc000, 0},
+        {during(1, 10) + 1, 0xc001, 0},
+    });
+}
+
+/**
+ *  Writing $e000 acknowledges and disables the IRQ, while the counter keeps
+ *  counting; $e001 enables it again from the next time it reaches zero.
+ */
+TEST(mmc3_irq_acknowledge)
+{
+    check_irqs({
+        {10, 0xc000, 20},
+        {11, 0xc001, 0},
+        {12, 0xe001, 0},
+        {during(0, 70), 0xe000, 0},
+        {during(1, 30), 0xe001, 0},
+        {during(1, 100), 0xe000, 0},
+        {during(1, 100) + 1, 0xe001, 0},
+        {during(2, 5), 0xe000, 0},
+        {during(2, 200), 0xe001, 0},
+    });
+}
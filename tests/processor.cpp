@@ -0,0 +1,866 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Behaviour, flags and timing of the instructions, as executed by step()
+ *  through either dispatch engine.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+constexpr std::uint8_t carry = 0x01, zero = 0x02, interrupt = 0x04, decimal = 0x08, overflow = 0x40, negative = 0x80;
+constexpr std::uint8_t arithmetic_flags = carry | zero | overflow | negative;
+
+/**
+ *  Cycles taken by each opcode without penalties, as given by the MOS
+ *  programming manual, with branches not taken; 0 for the opcodes that jam.
+ */
+constexpr std::uint8_t reference_cycles[256] = {
+    7, 6, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+    6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+    6, 6, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+    6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+    2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+    2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
+    2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+    2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
+    2, 6, 2, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+    2, 6, 2, 0, 3, 3, 5, 0, 2, 2, 2, 2, 4, 4, 6, 0,
+    2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0,
+};
+
+/**
+ *  Runs the setup code from $8000, or from the given origin, and then steps
+ *  the instruction following it, returning the cycles that took.
+ */
+template<typename Dispatch>
+auto measure(const std::vector<std::uint8_t>& setup, const std::vector<std::uint8_t>& instruction,
+             std::uint16_t origin = 0x8000) -> std::pair<unsigned, processor_state>
+{
+    auto code = setup;
+    code.insert(code.end(), instruction.begin(), instruction.end());
+    auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code, origin));
+    CHECK(system->step_to(static_cast<std::uint16_t>(origin + setup.size())));
+    const auto cycles = system->processor().step();
+    return {cycles, system->processor().state()};
+}
+
+auto flags(const processor_state& state) -> std::uint8_t
+{
+    return state.status & arithmetic_flags;
+}
+}
+
+
+/**
+ *  Every opcode, with operands that neither cross a page nor take a branch.
+ *  The zero page pointer at $10 is cleared, and the flags are all clear
+ *  before the instruction, so only BPL, BVC, BCC and BNE branch.
+ */
+TEST(opcode_cycles)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        const auto setup = std::vector<std::uint8_t>{
+            0xa9, 0x00,     // LDA #$00
+            0x85, 0x10,     // STA $10
+            0x85, 0x11,     // STA $11
+            0xa9, 0x01,     // LDA #$01
+        };
+        for (auto code = 0; code < 256; ++code) {
+            if (reference_cycles[code] == 0) continue;
+            const auto named = scope{"opcode $%02x", code};
+            const auto taken = code == 0x10 || code == 0x50 || code == 0x90 || code == 0xd0;
+            const auto [cycles, state] = measure<Dispatch>(setup, {static_cast<std::uint8_t>(code), 0x10, 0x02});
+            CHECK_EQUAL(cycles, reference_cycles[code] + (taken ? 1 : 0));
+            CHECK_EQUAL(opcodes[code].cycles, reference_cycles[code]);
+        }
+    });
+}
+
+/**
+ *  Indexed reads take a cycle more when indexing crosses into the next
+ *  page; indexed writes and read-modify-writes always take their longest.
+ */
+TEST(page_crossing)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto index : {std::uint8_t{0x0f}, std::uint8_t{0x10}}) {
+            const auto setup = std::vector<std::uint8_t>{
+                0xa9, 0xf0,     // LDA #$f0
+                0x85, 0x10,     // STA $10
+                0xa9, 0x02,     // LDA #$02
+                0x85, 0x11,     // STA $11
+                0xa2, index,    // LDX #index
+                0xa0, index,    // LDY #index
+            };
+            const auto crossed = index == 0x10;
+
+            for (auto code = 0; code < 256; ++code) {
+                const auto& decoded = opcodes[code];
+                const auto indexed = decoded.mode == addressing::absolute_x || decoded.mode == addressing::absolute_y
+                    || decoded.mode == addressing::indirect_indexed;
+                if (!indexed || decoded.instruction == operation::jam) continue;
+
+                const auto named = scope{"opcode $%02x, index $%02x", code, index};
+                const auto operand = decoded.mode == addressing::indirect_indexed ? 0x10 : 0xf0;
+                const auto [cycles, state] = measure<Dispatch>(setup, {static_cast<std::uint8_t>(code), static_cast<std::uint8_t>(operand), 0x02});
+                const auto penalty = crossed && decoded.extra == penalty::page_cross ? 1 : 0;
+                CHECK_EQUAL(cycles, reference_cycles[code] + penalty);
+            }
+        }
+
+        const auto [cycles, state] = measure<Dispatch>({0xa2, 0xff}, {0xb5, 0x10});  // LDX #$ff; LDA $10,X
+        CHECK_EQUAL(cycles, 4);
+    });
+}
+
+/**
+ *  Branches take a cycle more when taken, and another if they land in a
+ *  different page, whether forwards or backwards.
+ */
+TEST(branch_penalties)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto [cycles, state] = measure<Dispatch>({}, {0xf0, 0x10});   // BEQ, not taken
+        CHECK_EQUAL(cycles, 2);
+        CHECK_EQUAL(state.program_counter, 0x8002);
+
+        std::tie(cycles, state) = measure<Dispatch>({}, {0xd0, 0x10});  // BNE, taken
+        CHECK_EQUAL(cycles, 3);
+        CHECK_EQUAL(state.program_counter, 0x8012);
+
+        std::tie(cycles, state) = measure<Dispatch>({}, {0xd0, 0x10}, 0x80fd);
+        CHECK_EQUAL(cycles, 4);
+        CHECK_EQUAL(state.program_counter, 0x810f);
+
+        std::tie(cycles, state) = measure<Dispatch>({}, {0xd0, 0xf0}, 0x8100);
+        CHECK_EQUAL(cycles, 4);
+        CHECK_EQUAL(state.program_counter, 0x80f2);
+
+        std::tie(cycles, state) = measure<Dispatch>({}, {0xd0, 0xfe}, 0x8100);
+        CHECK_EQUAL(cycles, 3);
+        CHECK_EQUAL(state.program_counter, 0x8100);
+    });
+}
+
+/**
+ *  Each branch is taken on its own flag, which is loaded through PLP.
+ */
+TEST(branch_conditions)
+{
+    struct branch {
+        std::uint8_t code;
+        std::uint8_t flag;
+        bool when_set;
+    };
+    const branch branches[] = {
+        {0x10, negative, false}, {0x30, negative, true}, {0x50, overflow, false}, {0x70, overflow, true},
+        {0x90, carry, false}, {0xb0, carry, true}, {0xd0, zero, false}, {0xf0, zero, true},
+    };
+
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto& tested : branches) {
+            for (const auto status : {std::uint8_t{0x00}, std::uint8_t{0xff}}) {
+                const auto named = scope{"opcode $%02x, status $%02x", tested.code, status};
+                const auto setup = std::vector<std::uint8_t>{0xa9, status, 0x48, 0x28};  // LDA #status; PHA; PLP
+                const auto [cycles, state] = measure<Dispatch>(setup, {tested.code, 0x10});
+                const auto taken = ((status & tested.flag) != 0) == tested.when_set;
+                CHECK_EQUAL(cycles, taken ? 3 : 2);
+                CHECK_EQUAL(state.program_counter, taken ? 0x8016 : 0x8006);
+            }
+        }
+    });
+}
+
+
+TEST(addition)
+{
+    struct sum {
+        std::uint8_t accumulator, operand, carry_in, result, flags;
+    };
+    const sum sums[] = {
+        {0x50, 0x10, 0, 0x60, 0},
+        {0x50, 0x50, 0, 0xa0, overflow | negative},
+        {0xd0, 0x90, 0, 0x60, carry | overflow},
+        {0xff, 0x01, 0, 0x00, carry | zero},
+        {0x7f, 0x00, 1, 0x80, overflow | negative},
+        {0xff, 0xff, 1, 0xff, carry | negative},
+    };
+
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto& tested : sums) {
+            const auto named = scope{"$%02x + $%02x + %d", tested.accumulator, tested.operand, tested.carry_in};
+            const auto system = run_code<ricoh_2a03, Dispatch>({
+                static_cast<std::uint8_t>(tested.carry_in ? 0x38 : 0x18),   // SEC or CLC
+                0xa9, tested.accumulator,                                  // LDA #accumulator
+                0x69, tested.operand,                                      // ADC #operand
+            });
+            const auto state = system->processor().state();
+            CHECK_EQUAL(state.accumulator, tested.result);
+            CHECK_EQUAL(flags(state), tested.flags);
+        }
+    });
+}
+
+TEST(subtraction)
+{
+    struct difference {
+        std::uint8_t accumulator, operand, carry_in, result, flags;
+    };
+    const difference differences[] = {
+        {0x50, 0xf0, 1, 0x60, 0},
+        {0x50, 0xb0, 1, 0xa0, overflow | negative},
+        {0x00, 0x01, 1, 0xff, negative},
+        {0x05, 0x05, 1, 0x00, carry | zero},
+        {0x05, 0x04, 0, 0x00, carry | zero},
+        {0xd0, 0x70, 1, 0x60, carry | overflow},
+    };
+
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto& tested : differences) {
+            const auto named = scope{"$%02x - $%02x - %d", tested.accumulator, tested.operand, 1 - tested.carry_in};
+            const auto system = run_code<ricoh_2a03, Dispatch>({
+                static_cast<std::uint8_t>(tested.carry_in ? 0x38 : 0x18),   // SEC or CLC
+                0xa9, tested.accumulator,                                  // LDA #accumulator
+                0xe9, tested.operand,                                      // SBC #operand
+            });
+            const auto state = system->processor().state();
+            CHECK_EQUAL(state.accumulator, tested.result);
+            CHECK_EQUAL(flags(state), tested.flags);
+        }
+    });
+}
+
+/**
+ *  Comparisons set the carry if the register is at least the operand, and
+ *  the zero and negative flags from their difference; overflow is kept.
+ */
+TEST(comparison)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto load : {std::uint8_t{0xa9}, std::uint8_t{0xa2}, std::uint8_t{0xa0}}) {
+            const auto compare = std::uint8_t(load == 0xa9 ? 0xc9 : load == 0xa2 ? 0xe0 : 0xc0);
+            for (const auto& [value, operand] : {std::pair{0x05, 0x05}, std::pair{0x04, 0x05}, std::pair{0x06, 0x05}, std::pair{0x01, 0xff}}) {
+                const auto named = scope{"opcode $%02x, $%02x against $%02x", compare, value, operand};
+                const auto system = run_code<ricoh_2a03, Dispatch>({
+                    0xa9, 0x40, 0x69, 0x40,                         // LDA #$40; ADC #$40, setting overflow
+                    load, static_cast<std::uint8_t>(value),
+                    compare, static_cast<std::uint8_t>(operand),
+                });
+                const auto difference = static_cast<std::uint8_t>(value - operand);
+                auto expected = std::uint8_t{overflow};
+                if (value >= operand) expected |= carry;
+                if (difference == 0) expected |= zero;
+                if (difference & 0x80) expected |= negative;
+                CHECK_EQUAL(flags(system->processor().state()), expected);
+            }
+        }
+    });
+}
+
+TEST(shifts_and_rotations)
+{
+    struct shift {
+        std::uint8_t code, value, carry_in, result, flags;
+    };
+    const shift shifts[] = {
+        {0x0a, 0x81, 0, 0x02, carry},               // ASL A
+        {0x0a, 0x40, 1, 0x80, negative},            // ASL A
+        {0x4a, 0x01, 0, 0x00, carry | zero},        // LSR A
+        {0x4a, 0x80, 1, 0x40, 0},                   // LSR A
+        {0x2a, 0x80, 1, 0x01, carry},               // ROL A
+        {0x2a, 0x40, 0, 0x80, negative},            // ROL A
+        {0x6a, 0x01, 1, 0x80, carry | negative},    // ROR A
+        {0x6a, 0x01, 0, 0x00, carry | zero},        // ROR A
+    };
+
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto& tested : shifts) {
+            const auto named = scope{"opcode $%02x on $%02x", tested.code, tested.value};
+            const auto carry_code = static_cast<std::uint8_t>(tested.carry_in ? 0x38 : 0x18);
+            const auto on_accumulator = run_code<ricoh_2a03, Dispatch>({carry_code, 0xa9, tested.value, tested.code});
+            CHECK_EQUAL(on_accumulator->processor().state().accumulator, tested.result);
+            CHECK_EQUAL(flags(on_accumulator->processor().state()), tested.flags);
+
+            // The zero page form of the same operation, with the accumulator left alone.
+            const auto on_memory = run_code<ricoh_2a03, Dispatch>({
+                0xa9, tested.value, 0x85, 0x20, 0xa9, 0x33, carry_code, static_cast<std::uint8_t>(tested.code - 0x04), 0x20,
+            });
+            CHECK_EQUAL(on_memory->read(0x0020), tested.result);
+            CHECK_EQUAL(on_memory->processor().state().accumulator, 0x33);
+            CHECK_EQUAL(flags(on_memory->processor().state()), tested.flags);
+        }
+    });
+}
+
+TEST(increment_and_decrement)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xff, 0x85, 0x20, 0xe6, 0x20});   // INC $20 from $ff
+        CHECK_EQUAL(system->read(0x0020), 0x00);
+        CHECK_EQUAL(flags(system->processor().state()), zero);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xc6, 0x20});                              // DEC $20 from $00
+        CHECK_EQUAL(system->read(0x0020), 0xff);
+        CHECK_EQUAL(flags(system->processor().state()), negative);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa2, 0x7f, 0xe8, 0xa0, 0x01, 0x88});      // INX from $7f; DEY from $01
+        CHECK_EQUAL(system->processor().state().x, 0x80);
+        CHECK_EQUAL(system->processor().state().y, 0x00);
+        CHECK_EQUAL(flags(system->processor().state()), zero);
+    });
+}
+
+/**
+ *  BIT takes the negative and overflow flags from the operand, and the
+ *  zero flag from its conjunction with the accumulator.
+ */
+TEST(bit_test)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xc0, 0x85, 0x20, 0xa9, 0x3f, 0x24, 0x20});
+        CHECK_EQUAL(system->processor().state().accumulator, 0x3f);
+        CHECK_EQUAL(flags(system->processor().state()), zero | overflow | negative);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa9, 0x01, 0x8d, 0x00, 0x03, 0x2c, 0x00, 0x03});
+        CHECK_EQUAL(flags(system->processor().state()), 0);
+    });
+}
+
+TEST(logical_operations)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xf0, 0x29, 0x0f});    // AND
+        CHECK_EQUAL(system->processor().state().accumulator, 0x00);
+        CHECK_EQUAL(flags(system->processor().state()), zero);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xf0, 0x09, 0x0f});         // ORA
+        CHECK_EQUAL(system->processor().state().accumulator, 0xff);
+        CHECK_EQUAL(flags(system->processor().state()), negative);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xff, 0x49, 0xf0});         // EOR
+        CHECK_EQUAL(system->processor().state().accumulator, 0x0f);
+        CHECK_EQUAL(flags(system->processor().state()), 0);
+    });
+}
+
+/**
+ *  Transfers set the zero and negative flags, except TXS.
+ */
+TEST(transfers)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = run_code<ricoh_2a03, Dispatch>({0xa9, 0x80, 0xaa, 0xa9, 0x00, 0xa8});    // TAX; TAY
+        auto state = system->processor().state();
+        CHECK_EQUAL(state.x, 0x80);
+        CHECK_EQUAL(state.y, 0x00);
+        CHECK_EQUAL(flags(state), zero);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa2, 0x00, 0xa0, 0x90, 0x8a, 0x98});         // TXA; TYA
+        state = system->processor().state();
+        CHECK_EQUAL(state.accumulator, 0x90);
+        CHECK_EQUAL(flags(state), negative);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa2, 0x00, 0x9a, 0xba});                     // TXS; TSX
+        state = system->processor().state();
+        CHECK_EQUAL(state.stack_pointer, 0x00);
+        CHECK_EQUAL(flags(state), zero);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa2, 0x01, 0xa9, 0x80, 0x9a});               // TXS keeps N
+        state = system->processor().state();
+        CHECK_EQUAL(state.stack_pointer, 0x01);
+        CHECK_EQUAL(flags(state), negative);
+    });
+}
+
+/**
+ *  PHP pushes the status with the break flag set, and PLP ignores it.
+ */
+TEST(stack_operations)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto system = run_code<ricoh_2a03, Dispatch>({0x38, 0xa9, 0x00, 0x08, 0xa9, 0x12, 0x48});  // SEC; LDA #0; PHP; PHA
+        auto state = system->processor().state();
+        CHECK_EQUAL(state.stack_pointer, 0xfb);
+        CHECK_EQUAL(system->read(0x01fd), 0x20 | 0x10 | interrupt | zero | carry);
+        CHECK_EQUAL(system->read(0x01fc), 0x12);
+
+        system = run_code<ricoh_2a03, Dispatch>({0xa9, 0xff, 0x48, 0x48, 0x28, 0x68});           // LDA #$ff; PHA; PHA; PLP; PLA
+        state = system->processor().state();
+        CHECK_EQUAL(state.status, 0xed);
+        CHECK_EQUAL(state.accumulator, 0xff);
+        CHECK_EQUAL(state.stack_pointer, 0xfd);
+    });
+}
+
+/**
+ *  JSR pushes the address of its last byte, and RTS returns past it.
+ */
+TEST(subroutines)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto code = std::vector<std::uint8_t>(0x11, 0xea);
+        code[0x00] = 0x20;      // $8000: JSR $8010
+        code[0x01] = 0x10;
+        code[0x02] = 0x80;
+        code[0x10] = 0x60;      // $8010: RTS
+        auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+        CHECK_EQUAL(system->processor().step(), 6);
+        auto state = system->processor().state();
+        CHECK_EQUAL(state.program_counter, 0x8010);
+        CHECK_EQUAL(state.stack_pointer, 0xfb);
+        CHECK_EQUAL(system->read(0x01fd), 0x80);
+        CHECK_EQUAL(system->read(0x01fc), 0x02);
+
+        CHECK_EQUAL(system->processor().step(), 6);
+        state = system->processor().state();
+        CHECK_EQUAL(state.program_counter, 0x8003);
+        CHECK_EQUAL(state.stack_pointer, 0xfd);
+    });
+}
+
+/**
+ *  JMP ($xxff) takes the high byte of its target from the start of the
+ *  same page, and zero page indexing and pointers wrap within the zero page.
+ */
+TEST(address_wrapping)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto jump = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image({
+            0xa9, 0x34, 0x8d, 0xff, 0x02,   // LDA #$34; STA $02ff
+            0xa9, 0x92, 0x8d, 0x00, 0x02,   // LDA #$92; STA $0200
+            0x6c, 0xff, 0x02,               // JMP ($02ff)
+        }));
+        CHECK(jump->step_to(0x800a));
+        CHECK_EQUAL(jump->processor().step(), 5);
+        CHECK_EQUAL(jump->processor().state().program_counter, 0x9234);
+
+        auto system = run_code<ricoh_2a03, Dispatch>({
+            0xa9, 0x5a, 0x85, 0x10,         // LDA #$5a; STA $10
+            0xa2, 0x20, 0xb5, 0xf0,         // LDX #$20; LDA $f0,X
+        });
+        CHECK_EQUAL(system->processor().state().accumulator, 0x5a);
+
+        system = run_code<ricoh_2a03, Dispatch>({
+            0xa9, 0x00, 0x85, 0xff,         // LDA #$00; STA $ff
+            0xa9, 0x03, 0x85, 0x00,         // LDA #$03; STA $00
+            0xa9, 0x77, 0x8d, 0x00, 0x03,   // LDA #$77; STA $0300
+            0xa2, 0x00, 0xa9, 0x00,         // LDX #$00; LDA #$00
+            0xa1, 0xff,                     // LDA ($ff,X)
+        });
+        CHECK_EQUAL(system->processor().state().accumulator, 0x77);
+    });
+}
+
+/**
+ *  BRK pushes the address past its padding byte and the status with the
+ *  break flag set, and RTI returns there with the pulled status.
+ */
+TEST(break_and_return)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto code = std::vector<std::uint8_t>(0x1001, 0xea);
+        code[0x0000] = 0x38;    // $8000: SEC
+        code[0x0001] = 0x00;    // $8001: BRK
+        code[0x1000] = 0x40;    // $9000: RTI
+        auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+        system->processor().step();
+        CHECK_EQUAL(system->processor().step(), 7);
+
+        auto state = system->processor().state();
+        CHECK_EQUAL(state.program_counter, 0x9000);
+        CHECK_EQUAL(state.stack_pointer, 0xfa);
+        CHECK_EQUAL(system->read(0x01fd), 0x80);
+        CHECK_EQUAL(system->read(0x01fc), 0x03);
+        CHECK_EQUAL(system->read(0x01fb), 0x20 | 0x10 | interrupt | carry);
+        CHECK(state.status & interrupt);
+
+        CHECK_EQUAL(system->processor().step(), 6);
+        state = system->processor().state();
+        CHECK_EQUAL(state.program_counter, 0x8003);
+        CHECK_EQUAL(state.stack_pointer, 0xfd);
+        CHECK_EQUAL(flags(state), carry);
+    });
+}
+
+/**
+ *  The lazily evaluated flags are kept separately for each operation that
+ *  sets them: each flag must come out as set by the last operation that
+ *  affected it, whether read by a branch, pushed or taken from the state.
+ */
+TEST(lazy_flags)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        const auto system = run_code<ricoh_2a03, Dispatch>({
+            0xa9, 0x50, 0x69, 0x50,     // LDA #$50; ADC #$50: V, N
+            0x18,                       // CLC: keeps V
+            0xa9, 0x00,                 // LDA #$00: Z, clears N, keeps V
+            0x08, 0x68, 0x85, 0x20,     // PHP; PLA; STA $20
+            0xa9, 0x80, 0xc9, 0x7f,     // LDA #$80; CMP #$7f: C, keeps V
+            0x08, 0x68, 0x85, 0x21,     // PHP; PLA; STA $21
+            0xb8, 0xa2, 0xff, 0xe8,     // CLV; LDX #$ff; INX: Z, keeps C
+            0x08, 0x68, 0x85, 0x22,     // PHP; PLA; STA $22
+            0xa9, 0xc3, 0x48, 0x28,     // LDA #$c3; PHA; PLP: all four
+            0x50, 0x02, 0xa2, 0x55,     // BVC over LDX #$55, not taken: clears N and Z
+            0x08, 0x68, 0x85, 0x23,     // PHP; PLA; STA $23
+        });
+        CHECK_EQUAL(system->read(0x0020), 0x30 | interrupt | overflow | zero);
+        CHECK_EQUAL(system->read(0x0021), 0x30 | interrupt | overflow | carry);
+        CHECK_EQUAL(system->read(0x0022), 0x30 | interrupt | zero | carry);
+        CHECK_EQUAL(system->read(0x0023), 0x30 | overflow | carry);
+        CHECK_EQUAL(system->processor().state().x, 0x55);
+        CHECK_EQUAL(system->processor().state().status, 0x20 | overflow | carry);
+    });
+}
+
+
+/**
+ *  The NMOS 6502 adds and subtracts in BCD with the decimal flag set, while
+ *  the 2A03 ignores it.
+ */
+TEST(decimal_mode)
+{
+    struct arithmetic {
+        std::uint8_t code, accumulator, operand, carry_in, result, carry_out;
+    };
+    const arithmetic operations[] = {
+        {0x69, 0x15, 0x27, 0, 0x42, 0},
+        {0x69, 0x58, 0x46, 1, 0x05, 1},
+        {0x69, 0x99, 0x01, 0, 0x00, 1},
+        {0xe9, 0x46, 0x12, 1, 0x34, 1},
+        {0xe9, 0x40, 0x13, 1, 0x27, 1},
+        {0xe9, 0x32, 0x02, 0, 0x29, 1},
+        {0xe9, 0x12, 0x21, 1, 0x91, 0},
+        {0xe9, 0x00, 0x01, 1, 0x99, 0},
+    };
+
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (const auto& tested : operations) {
+            const auto named = scope{"opcode $%02x, $%02x and $%02x", tested.code, tested.accumulator, tested.operand};
+            const auto code = std::vector<std::uint8_t>{
+                0xf8,                                                       // SED
+                static_cast<std::uint8_t>(tested.carry_in ? 0x38 : 0x18),   // SEC or CLC
+                0xa9, tested.accumulator, tested.code, tested.operand,
+            };
+
+            const auto nmos = run_code<mos_6502, Dispatch>(code);
+            CHECK_EQUAL(nmos->processor().state().accumulator, tested.result);
+            CHECK_EQUAL(nmos->processor().state().status & carry, tested.carry_out);
+            CHECK(nmos->processor().state().status & decimal);
+
+            const auto ricoh = run_code<ricoh_2a03, Dispatch>(code);
+            const auto operand = tested.code == 0x69 ? tested.operand : static_cast<std::uint8_t>(~tested.operand);
+            CHECK_EQUAL(ricoh->processor().state().accumulator, static_cast<std::uint8_t>(tested.accumulator + operand + tested.carry_in));
+        }
+
+        // The NMOS flags: zero from the binary sum, negative and overflow
+        // from the sum before its high nibble is corrected.
+        auto nmos = run_code<mos_6502, Dispatch>({0xf8, 0x18, 0xa9, 0x99, 0x69, 0x01});
+        CHECK_EQUAL(flags(nmos->processor().state()), carry | negative);
+        nmos = run_code<mos_6502, Dispatch>({0xf8, 0x38, 0xa9, 0x79, 0x69, 0x00});
+        CHECK_EQUAL(nmos->processor().state().accumulator, 0x80);
+        CHECK_EQUAL(flags(nmos->processor().state()), overflow | negative);
+    });
+}
+
+
+namespace {
+/**
+ *  Runs the code from $8000 for the given number of cycles past reset on
+ *  three machines: one through run(), which fast-forwards idle loops up to
+ *  the end of its batch, one through run_native(), and one stepping an
+ *  instruction at a time up to the same cycle. All must stop at the same
+ *  instruction boundary, in the same state.
+ */
+template<typename Dispatch>
+void check_fast_forward(const std::vector<std::uint8_t>& code, std::int64_t cycles)
+{
+    const auto named = scope{"%lld cycles", static_cast<long long>(cycles)};
+    auto stepped = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+    const auto end = stepped->processor().cycles() + cycles;
+    while (stepped->processor().cycles() < end) stepped->processor().step();
+    const auto expected = stepped->processor().state();
+
+    const auto check = [&](const auto& fast) {
+        const auto actual = fast->processor().state();
+        CHECK_EQUAL(fast->processor().cycles(), stepped->processor().cycles());
+        CHECK_EQUAL(actual.program_counter, expected.program_counter);
+        CHECK_EQUAL(actual.accumulator, expected.accumulator);
+        CHECK_EQUAL(actual.x, expected.x);
+        CHECK_EQUAL(actual.y, expected.y);
+        CHECK_EQUAL(actual.stack_pointer, expected.stack_pointer);
+        CHECK_EQUAL(actual.status, expected.status);
+    };
+
+    auto cached = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+    cached->processor().run(cycles);
+    check(cached);
+
+    auto native = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+    native->processor().run_native(cycles);
+    check(native);
+}
+
+/**
+ *  Cycles until the program counter first reaches the given address,
+ *  stepping from reset.
+ */
+template<typename Dispatch>
+auto cycles_to(const std::vector<std::uint8_t>& code, std::uint16_t address) -> std::int64_t
+{
+    auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+    const auto start = system->processor().cycles();
+    CHECK(system->step_to(address));
+    return system->processor().cycles() - start;
+}
+}
+
+
+/**
+ *  Waiting for vblank by polling PPUSTATUS is an idle loop, which run()
+ *  skips through up to the vblank, when the PPU sets the flag. Every length
+ *  in a range of consecutive ones is run, so that the cycles left after the
+ *  last whole iteration take every value, down to one short of a whole
+ *  iteration, both while waiting and around the end of the wait.
+ */
+TEST(fast_forward_vblank_wait)
+{
+    const auto code = std::vector<std::uint8_t>{
+        0xad, 0x02, 0x20,   // $8000: LDA $2002
+        0x10, 0xfb,         // $8003: BPL $8000
+        0xe8,               // $8005: INX
+        0x4c, 0x06, 0x80,   // $8006: JMP $8006
+    };
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (auto cycles = 1000; cycles < 1020; ++cycles) check_fast_forward<Dispatch>(code, cycles);
+
+        const auto vblank = cycles_to<Dispatch>(code, 0x8005);
+        CHECK(vblank > 20000);
+        for (auto cycles = vblank - 20; cycles < vblank + 20; ++cycles) check_fast_forward<Dispatch>(code, cycles);
+    });
+}
+
+/**
+ *  A counting loop is not idle, as every iteration changes X, but the jump
+ *  to itself after it is; the loop and the jump must run as stepped, from
+ *  within the count, through the exit, into the jump.
+ */
+TEST(fast_forward_spin)
+{
+    const auto code = std::vector<std::uint8_t>{
+        0xa2, 0x20,         // $8000: LDX #$20
+        0xca,               // $8002: DEX
+        0xd0, 0xfd,         // $8003: BNE $8002
+        0x4c, 0x05, 0x80,   // $8005: JMP $8005
+    };
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        const auto spin = cycles_to<Dispatch>(code, 0x8005);
+        for (auto cycles = std::int64_t{1}; cycles < spin + 40; ++cycles) check_fast_forward<Dispatch>(code, cycles);
+    });
+}
+
+
+/**
+ *  A block runs whole only if its last instruction starts within the batch
+ *  even when every instruction takes its penalties. Here the loads cross a
+ *  page each time, taking four cycles more than their base cycles, and the
+ *  loop runs long enough to be translated.
+ */
+TEST(block_penalties)
+{
+    const auto code = std::vector<std::uint8_t>{
+        0xa2, 0xff,         // $8000: LDX #$ff
+        0xbd, 0x01, 0x80,   // $8002: LDA $8001,X
+        0xbd, 0x01, 0x80,   // $8005: LDA $8001,X
+        0xbd, 0x01, 0x80,   // $8008: LDA $8001,X
+        0xbd, 0x01, 0x80,   // $800b: LDA $8001,X
+        0xc8,               // $800e: INY
+        0x4c, 0x02, 0x80,   // $800f: JMP $8002
+    };
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for (auto cycles = std::int64_t{1}; cycles < 400; ++cycles) check_fast_forward<Dispatch>(code, cycles);
+    });
+}
+
+
+namespace {
+/**
+ *  Waits about 1286 cycles for every count in Y, with X counting the inner
+ *  loop, then runs the given code; the processor runs with IRQs disabled
+ *  from reset. The code starts at $800a.
+ */
+auto after_delay(std::uint8_t count, const std::vector<std::uint8_t>& code) -> std::vector<std::uint8_t>
+{
+    auto result = std::vector<std::uint8_t>{
+        0xa0, count,        // $8000: LDY #count
+        0xa2, 0x00,         // $8002: LDX #$00
+        0xca,               // $8004: DEX
+        0xd0, 0xfd,         // $8005: BNE $8004
+        0x88,               // $8007: DEY
+        0xd0, 0xf8,         // $8008: BNE $8002
+    };
+    result.insert(result.end(), code.begin(), code.end());
+    return result;
+}
+
+/**
+ *  Runs the given check with each way of running a batch.
+ */
+template<typename Check>
+void for_each_engine(Check check)
+{
+    {
+        const auto named = scope{"interpreted"};
+        check([](auto& processor, std::int64_t cycles) { processor.interpret(cycles); });
+    }
+    {
+        const auto named = scope{"cached"};
+        check([](auto& processor, std::int64_t cycles) { processor.run(cycles); });
+    }
+    {
+        const auto named = scope{"native"};
+        check([](auto& processor, std::int64_t cycles) { processor.run_native(cycles); });
+    }
+}
+}
+
+
+/**
+ *  Enabling the NMI during vblank raises it at once, in the middle of the
+ *  batch that writes PPUCTRL. It is taken as soon as that write has ended,
+ *  pushing the address of the next instruction and the status with the
+ *  break flag clear, and taking 7 cycles to reach the handler at $9000.
+ */
+TEST(nmi_within_batch)
+{
+    const auto code = after_delay(22, {
+        0xa9, 0x80,         // $800a: LDA #$80
+        0x8d, 0x00, 0x20,   // $800c: STA $2000
+        0xea,               // $800f: NOP
+    });
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        auto stepped = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+        CHECK(stepped->step_to(0x800f));
+        const auto written = stepped->processor().cycles();
+        CHECK(stepped->read(0x2002) & 0x80);
+
+        for_each_engine([&](auto run) {
+            auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(nrom_image(code));
+            run(system->processor(), written + 7 - system->processor().cycles());
+            const auto state = system->processor().state();
+            CHECK_EQUAL(system->processor().cycles(), written + 7);
+            CHECK_EQUAL(state.program_counter, 0x9000);
+            CHECK_EQUAL(state.stack_pointer, 0xfa);
+            CHECK_EQUAL(system->read(0x01fd), 0x80);
+            CHECK_EQUAL(system->read(0x01fc), 0x0f);
+            CHECK_EQUAL(system->read(0x01fb), 0x20 | negative | interrupt);
+            CHECK(state.status & interrupt);
+        });
+    });
+}
+
+/**
+ *  The APU raises its frame IRQ about 29830 cycles after reset, while IRQs
+ *  are still disabled. CLI enables them only after the poll that follows
+ *  it, so the instruction after it runs before the IRQ is taken. The
+ *  handler acknowledges the IRQ by reading $4015, so it is taken once; a
+ *  handler that does not read $4015 is entered over and over, as the IRQ
+ *  line stays asserted.
+ */
+TEST(irq_after_cli)
+{
+    const auto code = after_delay(24, {
+        0x58,               // $800a: CLI
+        0xa2, 0x42,         // $800b: LDX #$42
+        0x4c, 0x0d, 0x80,   // $800d: JMP $800d
+    });
+    const auto rom = [&](bool acknowledge) {
+        auto image = code;
+        image.resize(0x1000, 0xea);
+        const auto handler = acknowledge
+            ? std::vector<std::uint8_t>{0xe6, 0x10, 0xad, 0x15, 0x40, 0x85, 0x11, 0x40}  // INC $10; LDA $4015; STA $11; RTI
+            : std::vector<std::uint8_t>{0xe6, 0x10, 0x40};                              // INC $10; RTI
+        image.insert(image.end(), handler.begin(), handler.end());
+        return nrom_image(image);
+    };
+    for_each_dispatch([&](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        for_each_engine([&](auto run) {
+            auto system = std::make_unique<machine<ricoh_2a03, Dispatch>>(rom(true));
+            run(system->processor(), 29000);
+            CHECK_EQUAL(system->read(0x0010), 0);
+            CHECK(system->processor().state().program_counter < 0x800a);
+
+            run(system->processor(), 6000);
+            const auto state = system->processor().state();
+            CHECK_EQUAL(system->read(0x0010), 1);
+            CHECK_EQUAL(system->read(0x0011), 0x40);
+            CHECK_EQUAL(system->read(0x01fd), 0x80);
+            CHECK_EQUAL(system->read(0x01fc), 0x0d);
+            CHECK_EQUAL(system->read(0x01fb), 0x20);
+            CHECK_EQUAL(state.x, 0x42);
+            CHECK_EQUAL(state.program_counter, 0x800d);
+            CHECK_EQUAL(state.stack_pointer, 0xfd);
+            CHECK(!(state.status & interrupt));
+            CHECK_EQUAL(system->read(0x4015), 0x00);
+
+            auto unacknowledged = std::make_unique<machine<ricoh_2a03, Dispatch>>(rom(false));
+            run(unacknowledged->processor(), 35000);
+            CHECK(unacknowledged->read(0x0010) > 1);
+        });
+    });
+}
@@ -0,0 +1,301 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  The block cache and the recompiler must run programs exactly as the
+ *  interpreter does: the same programs are run through each for the same
+ *  number of cycles, after which registers, flags, cycles and RAM must all
+ *  be equal. The programs loop often enough for their blocks to be
+ *  translated.
+ */
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+/**
+ *  Arithmetic, shifts and flags over 256 rounds, logged to $0300 and $0400.
+ *  The first byte is a NOP, to be replaced by SED for decimal mode.
+ */
+const auto arithmetic = std::vector<std::uint8_t>{
+    0xea,               // $8000: NOP
+    0xa2, 0x00,         // $8001: LDX #$00
+    0xa0, 0x00,         // $8003: LDY #$00
+    0x8a,               // $8005: TXA
+    0x18,               // $8006: CLC
+    0x79, 0xf0, 0x90,   // $8007: ADC $90f0,Y
+    0x2a,               // $800a: ROL A
+    0x45, 0x10,         // $800b: EOR $10
+    0x85, 0x10,         // $800d: STA $10
+    0xe9, 0x03,         // $800f: SBC #$03
+    0x4a,               // $8011: LSR A
+    0xc9, 0x40,         // $8012: CMP #$40
+    0x08,               // $8014: PHP
+    0x68,               // $8015: PLA
+    0x9d, 0x00, 0x03,   // $8016: STA $0300,X
+    0x66, 0x11,         // $8019: ROR $11
+    0x26, 0x12,         // $801b: ROL $12
+    0xe6, 0x13,         // $801d: INC $13
+    0x24, 0x13,         // $801f: BIT $13
+    0x50, 0x02,         // $8021: BVC $8025
+    0xc6, 0x14,         // $8023: DEC $14
+    0x06, 0x15,         // $8025: ASL $15
+    0x05, 0x10,         // $8027: ORA $10
+    0x99, 0x00, 0x04,   // $8029: STA $0400,Y
+    0xc8,               // $802c: INY
+    0xe8,               // $802d: INX
+    0xd0, 0xd5,         // $802e: BNE $8005
+    0x4c, 0x30, 0x80,   // $8030: JMP $8030
+};
+
+/**
+ *  Indirect and indexed addressing, with page crossings and zero page
+ *  wrapping, and a subroutine, over three pages of RAM.
+ */
+const auto addressing_modes = [] {
+    auto code = std::vector<std::uint8_t>{
+        0xa9, 0x00,         // $8000: LDA #$00
+        0x85, 0x20,         // $8002: STA $20
+        0xa9, 0x03,         // $8004: LDA #$03
+        0x85, 0x21,         // $8006: STA $21
+        0xa2, 0x00,         // $8008: LDX #$00
+        0xa0, 0x00,         // $800a: LDY #$00
+        0x20, 0x40, 0x80,   // $800c: JSR $8040
+        0xb1, 0x20,         // $800f: LDA ($20),Y
+        0x75, 0xf0,         // $8011: ADC $f0,X
+        0x91, 0x20,         // $8013: STA ($20),Y
+        0xfe, 0x00, 0x05,   // $8015: INC $0500,X
+        0xbd, 0xff, 0x04,   // $8018: LDA $04ff,X
+        0x96, 0x30,         // $801b: STX $30,Y
+        0xb6, 0x30,         // $801d: LDX $30,Y
+        0xe8,               // $801f: INX
+        0xc8,               // $8020: INY
+        0xc8,               // $8021: INY
+        0xd0, 0xe8,         // $8022: BNE $800c
+        0xe6, 0x21,         // $8024: INC $21
+        0xa5, 0x21,         // $8026: LDA $21
+        0xc9, 0x06,         // $8028: CMP #$06
+        0xd0, 0xe0,         // $802a: BNE $800c
+        0x4c, 0x2c, 0x80,   // $802c: JMP $802c
+    };
+    code.resize(0x40, 0xea);
+    const std::uint8_t subroutine[] = {
+        0x48,               // $8040: PHA
+        0x8a,               // $8041: TXA
+        0x48,               // $8042: PHA
+        0x98,               // $8043: TYA
+        0x4a,               // $8044: LSR A
+        0xaa,               // $8045: TAX
+        0x5d, 0x00, 0x03,   // $8046: EOR $0300,X
+        0x9d, 0x00, 0x06,   // $8049: STA $0600,X
+        0x68,               // $804c: PLA
+        0xaa,               // $804d: TAX
+        0x68,               // $804e: PLA
+        0x60,               // $804f: RTS
+    };
+    code.insert(code.end(), std::begin(subroutine), std::end(subroutine));
+    return code;
+}();
+
+/**
+ *  A routine copied to RAM, whose immediate operands are rewritten by its
+ *  caller between calls and by itself ahead of their execution.
+ */
+const auto self_modifying = [] {
+    auto code = std::vector<std::uint8_t>{
+        0xa2, 0x00,         // $8000: LDX #$00
+        0xbd, 0x40, 0x80,   // $8002: LDA $8040,X
+        0x9d, 0x00, 0x02,   // $8005: STA $0200,X
+        0xe8,               // $8008: INX
+        0xe0, 0x10,         // $8009: CPX #$10
+        0xd0, 0xf5,         // $800b: BNE $8002
+        0xa0, 0x00,         // $800d: LDY #$00
+        0x20, 0x00, 0x02,   // $800f: JSR $0200
+        0x99, 0x00, 0x03,   // $8012: STA $0300,Y
+        0x8c, 0x01, 0x02,   // $8015: STY $0201
+        0xc8,               // $8018: INY
+        0xd0, 0xf4,         // $8019: BNE $800f
+        0x4c, 0x1b, 0x80,   // $801b: JMP $801b
+    };
+    code.resize(0x40, 0xea);
+    const std::uint8_t routine[] = {
+        0xa9, 0x00,         // $0200: LDA #$00
+        0x18,               // $0202: CLC
+        0x65, 0x80,         // $0203: ADC $80
+        0x85, 0x80,         // $0205: STA $80
+        0x8d, 0x0b, 0x02,   // $0207: STA $020b
+        0x69, 0x00,         // $020a: ADC #$00
+        0x85, 0x81,         // $020c: STA $81
+        0x60,               // $020e: RTS
+    };
+    code.insert(code.end(), std::begin(routine), std::end(routine));
+    return code;
+}();
+
+/**
+ *  A routine copied to RAM, run often enough to be translated before it
+ *  once writes into its own code, ahead of executing what it wrote.
+ */
+const auto code_in_ram = [] {
+    auto code = std::vector<std::uint8_t>{
+        0xa2, 0x00,         // $8000: LDX #$00
+        0xbd, 0x40, 0x80,   // $8002: LDA $8040,X
+        0x9d, 0x00, 0x02,   // $8005: STA $0200,X
+        0xe8,               // $8008: INX
+        0xe0, 0x10,         // $8009: CPX #$10
+        0xd0, 0xf5,         // $800b: BNE $8002
+        0xa0, 0x0b,         // $800d: LDY #$0b
+        0xa2, 0x00,         // $800f: LDX #$00
+        0xa9, 0x04,         // $8011: LDA #$04
+        0xe0, 0x80,         // $8013: CPX #$80
+        0xd0, 0x02,         // $8015: BNE $8019
+        0xa9, 0x02,         // $8017: LDA #$02
+        0x85, 0x21,         // $8019: STA $21
+        0x20, 0x00, 0x02,   // $801b: JSR $0200
+        0x9d, 0x00, 0x03,   // $801e: STA $0300,X
+        0xe8,               // $8021: INX
+        0xd0, 0xed,         // $8022: BNE $8011
+        0x4c, 0x24, 0x80,   // $8024: JMP $8024
+    };
+    code.resize(0x40, 0xea);
+    const std::uint8_t routine[] = {
+        0xa9, 0x01,         // $0200: LDA #$01
+        0x18,               // $0202: CLC
+        0x65, 0x80,         // $0203: ADC $80
+        0x85, 0x80,         // $0205: STA $80
+        0x8a,               // $0207: TXA
+        0x91, 0x20,         // $0208: STA ($20),Y, which is $020b once
+        0x69, 0x00,         // $020a: ADC #$00
+        0x85, 0x81,         // $020c: STA $81
+        0x60,               // $020e: RTS
+    };
+    code.insert(code.end(), std::begin(routine), std::end(routine));
+    return code;
+}();
+
+struct snapshot {
+    processor_state state;
+    std::int64_t cycles;
+    std::vector<std::uint8_t> ram;
+};
+
+template<typename Variant, typename Dispatch, typename Run>
+auto run_for(const std::vector<std::uint8_t>& code, std::int64_t cycles, Run run) -> snapshot
+{
+    auto system = std::make_unique<machine<Variant, Dispatch>>(nrom_image(code));
+    run(system->processor(), cycles);
+    auto result = snapshot{system->processor().state(), system->processor().cycles(), {}};
+    for (auto address = 0; address < 0x800; ++address)
+        result.ram.push_back(system->read(static_cast<std::uint16_t>(address)));
+    return result;
+}
+
+void compare(const snapshot& actual, const snapshot& expected)
+{
+    CHECK_EQUAL(actual.state.accumulator, expected.state.accumulator);
+    CHECK_EQUAL(actual.state.x, expected.state.x);
+    CHECK_EQUAL(actual.state.y, expected.state.y);
+    CHECK_EQUAL(actual.state.stack_pointer, expected.state.stack_pointer);
+    CHECK_EQUAL(actual.state.status, expected.state.status);
+    CHECK_EQUAL(actual.state.program_counter, expected.state.program_counter);
+    CHECK_EQUAL(actual.cycles, expected.cycles);
+    for (auto address = 0; address < 0x800; ++address) {
+        if (actual.ram[address] == expected.ram[address]) continue;
+        const auto named = scope{"address $%04x", address};
+        CHECK_EQUAL(actual.ram[address], expected.ram[address]);
+        break;
+    }
+}
+
+/**
+ *  Runs the program for several lengths, ending both within its loops and
+ *  after it has finished, through each engine.
+ */
+template<typename Variant, typename Dispatch>
+void check_engines(const std::vector<std::uint8_t>& code)
+{
+    for (const auto cycles : {1000, 4321, 12345, 40000}) {
+        const auto named = scope{"%d cycles", cycles};
+        const auto expected = run_for<Variant, Dispatch>(code, cycles, [](auto& processor, auto length) {
+            processor.interpret(length);
+        });
+        CHECK(expected.cycles >= cycles);
+        {
+            const auto engine = scope{"cached"};
+            compare(run_for<Variant, Dispatch>(code, cycles, [](auto& processor, auto length) {
+                processor.run(length);
+            }), expected);
+        }
+        {
+            const auto engine = scope{"native"};
+            compare(run_for<Variant, Dispatch>(code, cycles, [](auto& processor, auto length) {
+                processor.run_native(length);
+            }), expected);
+        }
+    }
+}
+}
+
+
+TEST(engines_agree_on_arithmetic)
+{
+    for_each_dispatch([](auto dispatch) {
+        using Dispatch = decltype(dispatch);
+        check_engines<ricoh_2a03, Dispatch>(arithmetic);
+        {
+            const auto named = scope{"NMOS 6502"};
+            check_engines<mos_6502, Dispatch>(arithmetic);
+        }
+        {
+            const auto named = scope{"NMOS 6502 in decimal mode"};
+            auto decimal = arithmetic;
+            decimal[0] = 0xf8;
+            check_engines<mos_6502, Dispatch>(decimal);
+        }
+    });
+}
+
+TEST(engines_agree_on_addressing)
+{
+    for_each_dispatch([](auto dispatch) {
+        check_engines<ricoh_2a03, decltype(dispatch)>(addressing_modes);
+    });
+}
+
+TEST(engines_agree_on_self_modifying_code)
+{
+    for_each_dispatch([](auto dispatch) {
+        check_engines<ricoh_2a03, decltype(dispatch)>(self_modifying);
+    });
+}
+
+TEST(engines_agree_on_code_in_ram)
+{
+    for_each_dispatch([](auto dispatch) {
+        check_engines<ricoh_2a03, decltype(dispatch)>(code_in_ram);
+    });
+}
@@ -0,0 +1,113 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  ROM files read from disk through a memory mapping, which must never be
+ *  read past its end, however short the file is.
+ */
+
+#include <cstdint>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+
+#include "files.h"
+#include "machine.h"
+#include "test.h"
+
+using namespace nes;
+using namespace nes::test;
+
+namespace {
+auto raw(const std::vector<byte>& image) -> std::vector<std::uint8_t>
+{
+    return {image.begin(), image.end()};
+}
+
+/**
+ *  Image of an NROM board with 32 KB of PRG ROM and 8 KB of CHR ROM, whose
+ *  every byte holds the low byte of its offset into the file.
+ */
+auto numbered_image() -> std::vector<std::uint8_t>
+{
+    auto image = raw(make_image(0, std::vector<std::uint8_t>(0x8000), std::vector<std::uint8_t>(0x2000)));
+    for (auto offset = 16u; offset < image.size(); ++offset) image[offset] = static_cast<std::uint8_t>(offset);
+    return image;
+}
+}
+
+
+TEST(mapped_rom)
+{
+    const auto file = temporary_file{"mapped.nes", numbered_image()};
+    const auto rom = read_rom(file.path());
+    CHECK(std::holds_alternative<mapped_file>(rom.image));
+    CHECK_EQUAL(rom.mapper, 0);
+    CHECK_EQUAL(rom.prg_rom.size(), 0x8000);
+    CHECK_EQUAL(rom.chr_rom.size(), 0x2000);
+    CHECK_EQUAL(rom.prg_rom[0], 16);
+    CHECK_EQUAL(rom.chr_rom[0x1fff], static_cast<std::uint8_t>(16 + 0x8000 + 0x1fff));
+
+    // The regions point into the mapping, without copies.
+    const auto& mapping = std::get<mapped_file>(rom.image);
+    CHECK(rom.prg_rom.data() == mapping.data() + 16);
+    CHECK(rom.chr_rom.data() == mapping.data() + 16 + 0x8000);
+}
+
+/**
+ *  Files that end before the regions their header announces are rejected,
+ *  whichever region they end in.
+ */
+TEST(truncated_rom)
+{
+    const auto image = numbered_image();
+    for (const auto length : {std::size_t{16}, std::size_t{0x4010}, std::size_t{0x8010}, std::size_t{0x9000}, image.size() - 1}) {
+        const auto named = scope{"%zu bytes", length};
+        const auto file = temporary_file{"truncated.nes", {image.begin(), image.begin() + length}};
+        CHECK_THROWS(std::runtime_error, read_rom(file.path()));
+        CHECK_THROWS(std::runtime_error, cartridge{file.path()});
+    }
+
+    // A trainer announced but not present.
+    auto trainer = image;
+    trainer[6] |= 0x04;
+    const auto file = temporary_file{"trainer.nes", trainer};
+    CHECK_THROWS(std::runtime_error, read_rom(file.path()));
+}
+
+/**
+ *  An empty file has nothing to map, and headers shorter than 16 bytes are
+ *  rejected before any of their fields are read.
+ */
+TEST(empty_and_short_files)
+{
+    const auto empty = temporary_file{"empty.nes", {}};
+    CHECK_EQUAL(mapped_file{empty.path()}.size(), 0);
+    CHECK(mapped_file{empty.path()}.data() == nullptr);
+    CHECK_THROWS(std::runtime_error, read_rom(empty.path()));
+
+    const auto image = numbered_image();
+    for (const auto length : {std::size_t{1}, std::size_t{4}, std::size_t{15}}) {
+        const auto named = scope{"%zu bytes", length};
+        const auto file = temporary_file{"short.nes", {image.begin(), image.begin() + length}};
+        CHECK_THROWS(std::runtime_error, read_rom(file.path()));
+    }
+
+    CHECK_THROWS(std::invalid_argument, read_rom(fs::temp_directory_path() / "nes-tester-missing.nes"));
+}
@@ -1,3 +1,42 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cstdio>
+#include <exception>
+
+#include "test.h"
+
 int main() {
-    return 0;
-}
\ No newline at end of file
+    auto failed_cases = 0;
+    for (const auto& test : nes::test::cases()) {
+        const auto before = nes::test::failures();
+        try {
+            test.run();
+        } catch (const std::exception& error) {
+            std::printf("%s: unexpected exception: %s\n", test.name, error.what());
+            ++nes::test::failures();
+        }
+        if (nes::test::failures() != before) {
+            std::printf("FAILED %s\n", test.name);
+            ++failed_cases;
+        }
+    }
+    std::printf("%zu test cases, %d failed\n", nes::test::cases().size(), failed_cases);
+    return failed_cases == 0 ? 0 : 1;
+}
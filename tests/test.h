@@ -0,0 +1,129 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Minimal test framework: test cases register themselves, and checks that
+ *  fail are reported without stopping the test, with the context set by
+ *  the test at that point.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nes::test {
+struct test_case {
+    const char* name;
+    void (*run)();
+};
+
+inline auto cases() -> std::vector<test_case>&
+{
+    static auto registered = std::vector<test_case>{};
+    return registered;
+}
+
+inline auto add(const char* name, void (*run)()) -> bool
+{
+    cases().push_back({name, run});
+    return true;
+}
+
+inline auto failures() -> int&
+{
+    static auto count = 0;
+    return count;
+}
+
+/**
+ *  Describes what a test is checking, such as the opcode under test, for
+ *  the failures reported while it is in scope. Nested scopes add to the
+ *  description of the enclosing ones.
+ */
+inline auto context() -> std::string&
+{
+    static auto current = std::string{};
+    return current;
+}
+
+class scope {
+public:
+    template<typename... Arguments>
+    explicit scope(const char* format, Arguments... arguments)
+    {
+        char buffer[128];
+        std::snprintf(buffer, sizeof(buffer), format, arguments...);
+        _previous = context();
+        context() = _previous.empty() ? std::string{buffer} : _previous + ", " + buffer;
+    }
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    ~scope()
+    {
+        context() = std::move(_previous);
+    }
+
+private:
+    std::string _previous;
+};
+
+inline void fail(const char* file, int line, const char* expression, long long actual = 0, long long expected = 0, bool values = false)
+{
+    std::printf("%s:%d: check failed: %s", file, line, expression);
+    if (values) std::printf(" (got %lld, expected %lld)", actual, expected);
+    if (!context().empty()) std::printf(" [%s]", context().c_str());
+    std::printf("\n");
+    ++failures();
+}
+}
+
+#define NES_TEST_CONCAT_(left, right) left##right
+#define NES_TEST_CONCAT(left, right) NES_TEST_CONCAT_(left, right)
+
+#define TEST(name) \
+    static void name(); \
+    static const bool NES_TEST_CONCAT(name, _registered) = nes::test::add(#name, &name); \
+    static void name()
+
+#define CHECK(...) \
+    ((__VA_ARGS__) ? void() : nes::test::fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        const auto nes_actual_ = static_cast<long long>(actual); \
+        const auto nes_expected_ = static_cast<long long>(expected); \
+        if (nes_actual_ != nes_expected_) \
+            nes::test::fail(__FILE__, __LINE__, #actual " == " #expected, nes_actual_, nes_expected_, true); \
+    } while (false)
+
+#define CHECK_THROWS(type, ...) \
+    do { \
+        auto nes_thrown_ = false; \
+        try { \
+            static_cast<void>(__VA_ARGS__); \
+        } catch (const type&) { \
+            nes_thrown_ = true; \
+        } \
+        if (!nes_thrown_) nes::test::fail(__FILE__, __LINE__, #__VA_ARGS__ " throws " #type); \
+    } while (false)
@@ -0,0 +1,96 @@
+/**
+ *  project: NES Emulator
+ *  author: Quinten van Woerkom
+ *
+ *  Copyright 2018 Quinten van Woerkom
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/**
+ *  Builds the index of a ROM library, and finds ROMs in it.
+ *
+ *      indexer scan <directory> <index> [database]
+ *      indexer find <index> <crc32 or title>
+ *
+ *  Headers are corrected by the database, if given, which is read in the
+ *  XML format of the NES 2.0 header database.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "cartridge/database.h"
+#include "cartridge/library.h"
+
+using namespace nes;
+
+/**
+ *  Keys of eight hexadecimal digits are taken to be CRCs, anything else to
+ *  be a title.
+ */
+auto find(const rom_library& library, std::string_view key) -> const library_entry*
+{
+    const auto hexadecimal = key.size() == 8 && key.find_first_not_of("0123456789abcdefABCDEF") == std::string_view::npos;
+    if (hexadecimal) {
+        if (const auto entry = library.find(static_cast<std::uint32_t>(std::stoul(std::string{key}, nullptr, 16)))) return entry;
+    }
+    return library.find(key);
+}
+
+void print(const library_entry& entry)
+{
+    const auto mirroring = entry.four_screen_vram ? '4' : entry.vertical_mirroring ? 'V' : 'H';
+    std::printf("%08x  mapper %3u.%u  %c  %-7s  PRG %4u KB  CHR %4u KB  PRG RAM %3u KB  CHR RAM %3u KB  %s\n",
+        entry.digest.crc32, entry.mapper, entry.submapper, mirroring, entry.persistent_memory ? "battery" : "",
+        entry.prg_size / 1024, entry.chr_size / 1024, (entry.prg_ram_size + entry.prg_nvram_size) / 1024,
+        (entry.chr_ram_size + entry.chr_nvram_size) / 1024, entry.path.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    const auto command = std::string_view{argc > 1 ? argv[1] : ""};
+    try {
+        if (command == "scan" && (argc == 4 || argc == 5)) {
+            const auto start = std::chrono::steady_clock::now();
+            const auto database = argc == 5 ? read_database(argv[4]) : rom_database{{}};
+            const auto library = rom_library::scan(argv[2], database);
+            library.save(argv[3]);
+            const auto stop = std::chrono::steady_clock::now();
+            std::cout << "Indexed " << library.entries().size() << " ROMs in "
+                << std::chrono::duration<double>(stop - start).count() << " s.\n";
+            return 0;
+        }
+        if (command == "find" && argc == 4) {
+            const auto library = rom_library::load(argv[2]);
+            const auto entry = find(library, argv[3]);
+            if (entry == nullptr) {
+                std::cerr << "Not found.\n";
+                return 1;
+            }
+            print(*entry);
+            return 0;
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << '\n';
+        return 1;
+    }
+
+    std::cerr << "Usage: indexer scan <directory> <index> [database]\n"
+        << "       indexer find <index> <crc32 or title>\n";
+    return 1;
+}